@@ -2,4 +2,9 @@ require 'mkmf'
 if RUBY_VERSION =~ /1.9/ then  
     $CPPFLAGS += " -DRUBY_19"  
 end
+# fallocate(2) is a GNU extension
+$CPPFLAGS += " -D_GNU_SOURCE"
+have_func("fallocate", "fcntl.h")
+# inotify(7), for the watch server. Linux only.
+have_header("sys/inotify.h")
 create_makefile("amp/CSupport")
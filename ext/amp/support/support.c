@@ -1,6 +1,14 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "ruby.h"
+#ifdef HAVE_FALLOCATE
+# include <fcntl.h>
+#endif
+#ifdef HAVE_SYS_INOTIFY_H
+# include <errno.h>
+# include <sys/inotify.h>
+#endif
 
 static int little_endian = -1;
 
@@ -33,6 +41,11 @@ static uint32_t ntohl(uint32_t x)
 # include <inttypes.h>
 #endif
 
+// 1.8 doesn't have this; a volatile reference keeps the value on the stack
+#ifndef RB_GC_GUARD
+# define RB_GC_GUARD(v) (*(volatile VALUE *)&(v))
+#endif
+
 /**
  * Byte-swaps a 64-bit fixnum.
  * Bignum arithmetic is quite, quite slow. By implementing this in C, we save ourselves
@@ -215,6 +228,536 @@ static VALUE amp_string_unhexlify(VALUE self) {
     return out;
 }
 
+/**
+ * A node in a PrefixSet's trie. Children are kept in a small array, sorted
+ * by the byte that leads to them, since ignore patterns rarely branch much
+ * at any one character.
+ */
+typedef struct prefix_node {
+    char terminal;                  // does a stored string end here?
+    int child_count, child_capacity;
+    unsigned char *keys;            // the byte leading to each child
+    struct prefix_node **children;
+} prefix_node;
+
+static VALUE rb_cPrefixSet;
+
+static prefix_node *prefix_node_new() {
+    prefix_node *node = ALLOC(prefix_node);
+    node->terminal = 0;
+    node->child_count = node->child_capacity = 0;
+    node->keys = NULL;
+    node->children = NULL;
+    return node;
+}
+
+static void prefix_node_free(prefix_node *node) {
+    int i;
+    for (i = 0; i < node->child_count; i++)
+        prefix_node_free(node->children[i]);
+    xfree(node->keys);
+    xfree(node->children);
+    xfree(node);
+}
+
+/**
+ * Finds the child of +node+ reached by +key+, or NULL if there isn't one.
+ */
+static prefix_node *prefix_node_child(prefix_node *node, unsigned char key) {
+    int low = 0, high = node->child_count - 1, mid;
+    while (low <= high) {
+        mid = (low + high) / 2;
+        if (node->keys[mid] == key)
+            return node->children[mid];
+        else if (node->keys[mid] < key)
+            low = mid + 1;
+        else
+            high = mid - 1;
+    }
+    return NULL;
+}
+
+/**
+ * Finds the child of +node+ reached by +key+, creating it if need be.
+ */
+static prefix_node *prefix_node_child_create(prefix_node *node, unsigned char key) {
+    prefix_node *child = prefix_node_child(node, key);
+    int i;
+    if (child) return child;
+    
+    if (node->child_count == node->child_capacity) {
+        node->child_capacity = node->child_capacity ? node->child_capacity * 2 : 2;
+        REALLOC_N(node->keys, unsigned char, node->child_capacity);
+        REALLOC_N(node->children, prefix_node *, node->child_capacity);
+    }
+    // shift the bigger keys over to keep the array sorted
+    for (i = node->child_count; i > 0 && node->keys[i - 1] > key; i--) {
+        node->keys[i] = node->keys[i - 1];
+        node->children[i] = node->children[i - 1];
+    }
+    child = prefix_node_new();
+    node->keys[i] = key;
+    node->children[i] = child;
+    node->child_count++;
+    return child;
+}
+
+static VALUE amp_prefix_set_alloc(VALUE klass) {
+    return Data_Wrap_Struct(klass, 0, prefix_node_free, prefix_node_new());
+}
+
+/**
+ * Adds a string to the set.
+ *
+ * @param self [in] the set
+ * @param str [in] the string to add
+ * @return the set
+ */
+static VALUE amp_prefix_set_add(VALUE self, VALUE str) {
+    prefix_node *node;
+    unsigned char *ptr;
+    long len;
+    
+    StringValue(str);
+    Data_Get_Struct(self, prefix_node, node);
+    ptr = (unsigned char *)RSTRING_PTR(str);
+    len = RSTRING_LEN(str);
+    while (len--)
+        node = prefix_node_child_create(node, *ptr++);
+    node->terminal = 1;
+    return self;
+}
+
+/**
+ * Checks whether any string in the set is a prefix of the given string.
+ * This walks the trie once, so it costs the same no matter how many
+ * strings are in the set.
+ *
+ * @param self [in] the set
+ * @param str [in] the string to check
+ * @return true if some member of the set is a prefix of +str+
+ */
+static VALUE amp_prefix_set_prefix_of(VALUE self, VALUE str) {
+    prefix_node *node;
+    unsigned char *ptr;
+    long len;
+    
+    StringValue(str);
+    Data_Get_Struct(self, prefix_node, node);
+    ptr = (unsigned char *)RSTRING_PTR(str);
+    len = RSTRING_LEN(str);
+    while (node && !node->terminal && len--)
+        node = prefix_node_child(node, *ptr++);
+    return (node && node->terminal) ? Qtrue : Qfalse;
+}
+
+/**
+ * Is the set empty?
+ *
+ * @param self [in] the set
+ * @return true if nothing has been added to the set
+ */
+static VALUE amp_prefix_set_empty(VALUE self) {
+    prefix_node *node;
+    Data_Get_Struct(self, prefix_node, node);
+    return (node->child_count == 0 && !node->terminal) ? Qtrue : Qfalse;
+}
+
+/**
+ * A growable byte buffer, for building up encoded paths.
+ */
+typedef struct {
+    char *ptr;
+    long len, capa;
+} path_buffer;
+
+static VALUE rb_mStoreEncoding;
+
+static void path_buffer_init(path_buffer *buf, long capa) {
+    buf->capa = capa > 16 ? capa : 16;
+    buf->len = 0;
+    buf->ptr = ALLOC_N(char, buf->capa);
+}
+
+static void path_buffer_append(path_buffer *buf, const char *data, long len) {
+    if (buf->len + len > buf->capa) {
+        while (buf->len + len > buf->capa)
+            buf->capa *= 2;
+        REALLOC_N(buf->ptr, char, buf->capa);
+    }
+    memcpy(buf->ptr + buf->len, data, len);
+    buf->len += len;
+}
+
+static void path_buffer_append_byte(path_buffer *buf, char byte) {
+    path_buffer_append(buf, &byte, 1);
+}
+
+/**
+ * Appends +byte+ as "~xx", in lowercase hex.
+ */
+static void path_buffer_append_escape(path_buffer *buf, unsigned char byte) {
+    static const char hex[] = "0123456789abcdef";
+    char escaped[3];
+    escaped[0] = '~';
+    escaped[1] = hex[byte >> 4];
+    escaped[2] = hex[byte & 0xf];
+    path_buffer_append(buf, escaped, 3);
+}
+
+/**
+ * Turns the buffer into a ruby string, and frees it.
+ */
+static VALUE path_buffer_finish(path_buffer *buf) {
+    VALUE result = rb_str_new(buf->ptr, buf->len);
+    xfree(buf->ptr);
+    return result;
+}
+
+/**
+ * Does the store have to escape this byte? Control characters, anything
+ * past '}', and the characters windows won't allow in filenames.
+ */
+static int store_byte_needs_escape(unsigned char byte) {
+    return byte < 32 || byte >= 126 || (byte && strchr("\\:*?\"<>|", byte) != NULL);
+}
+
+/**
+ * The reversible store encoding: capitals and underscores become "_x" (or
+ * just lowercase, without +underscore+), and unsafe bytes become "~xx".
+ */
+static void store_encode(path_buffer *buf, const unsigned char *ptr, long len, int underscore) {
+    unsigned char byte;
+    while (len--) {
+        byte = *ptr++;
+        if ((byte >= 'A' && byte <= 'Z') || byte == '_') {
+            if (underscore)
+                path_buffer_append_byte(buf, '_');
+            path_buffer_append_byte(buf, byte == '_' ? '_' : byte - 'A' + 'a');
+        } else if (store_byte_needs_escape(byte)) {
+            path_buffer_append_escape(buf, byte);
+        } else {
+            path_buffer_append_byte(buf, byte);
+        }
+    }
+}
+
+// can't name a file one of these on windows. (com9 has never been on the
+// list, and fixing that now would rename existing stores' files)
+static const char *windows_reserved_filenames[] = {
+    "con", "prn", "aux", "nul", "com1", "com2", "com3", "com4", "com5", "com6",
+    "com7", "com8", "lpt1", "lpt2", "lpt3", "lpt4", "lpt5", "lpt6", "lpt7",
+    "lpt8", "lpt9", NULL
+};
+
+static int store_reserved_name(const unsigned char *ptr, long len) {
+    const char **name;
+    for (name = windows_reserved_filenames; *name; name++)
+        if ((long)strlen(*name) == len && memcmp(*name, ptr, len) == 0)
+            return 1;
+    return 0;
+}
+
+/**
+ * Appends one path component, escaping the third byte of a windows-reserved
+ * name ("aux.c" => "au~78.c") and a trailing space or period.
+ */
+static void store_auxiliary_component(path_buffer *buf, const unsigned char *ptr, long len) {
+    long base = 0;
+    
+    if (len == 0) return;
+    while (base < len && ptr[base] != '.')
+        base++;
+    if (base > 0 && store_reserved_name(ptr, base)) {
+        path_buffer_append(buf, (const char *)ptr, 2);
+        path_buffer_append_escape(buf, ptr[2]);
+        ptr += 3;
+        len -= 3;
+    }
+    if (len > 0 && (ptr[len - 1] == '.' || ptr[len - 1] == ' ')) {
+        path_buffer_append(buf, (const char *)ptr, len - 1);
+        path_buffer_append_escape(buf, ptr[len - 1]);
+    } else {
+        path_buffer_append(buf, (const char *)ptr, len);
+    }
+}
+
+/**
+ * Applies the auxiliary encoding to each component of a path. Trailing
+ * slashes are dropped, as String#split would.
+ */
+static void store_auxiliary_encode(path_buffer *buf, const unsigned char *ptr, long len) {
+    long start = 0, i;
+    
+    while (len > 0 && ptr[len - 1] == '/')
+        len--;
+    for (i = 0; i <= len; i++) {
+        if (i == len || ptr[i] == '/') {
+            if (start > 0)
+                path_buffer_append_byte(buf, '/');
+            store_auxiliary_component(buf, ptr + start, i - start);
+            start = i + 1;
+        }
+    }
+}
+
+/**
+ * Encodes a file's path the reversible way.
+ *
+ * @param self [in] the StoreEncoding module
+ * @param path [in] the path to encode
+ * @param underscore [in] should capitals be prefixed with underscores?
+ * @return the encoded path
+ */
+static VALUE amp_store_encode(int argc, VALUE *argv, VALUE self) {
+    VALUE path, underscore;
+    path_buffer buf;
+    
+    rb_scan_args(argc, argv, "11", &path, &underscore);
+    StringValue(path);
+    path_buffer_init(&buf, RSTRING_LEN(path) * 2);
+    store_encode(&buf, (unsigned char *)RSTRING_PTR(path), RSTRING_LEN(path),
+                 argc < 2 || RTEST(underscore));
+    return path_buffer_finish(&buf);
+}
+
+static int store_hex_value(unsigned char byte) {
+    if (byte >= '0' && byte <= '9') return byte - '0';
+    if (byte >= 'a' && byte <= 'f') return byte - 'a' + 10;
+    return -1;
+}
+
+/**
+ * Decodes a path encoded by amp_store_encode. Anything that isn't a valid
+ * encoding is copied through untouched.
+ *
+ * @param self [in] the StoreEncoding module
+ * @param path [in] the encoded path
+ * @return the decoded path
+ */
+static VALUE amp_store_decode(VALUE self, VALUE path) {
+    unsigned char *ptr, byte;
+    long len, i = 0;
+    int high, low;
+    path_buffer buf;
+    
+    StringValue(path);
+    ptr = (unsigned char *)RSTRING_PTR(path);
+    len = RSTRING_LEN(path);
+    path_buffer_init(&buf, len);
+    while (i < len) {
+        byte = ptr[i];
+        if (byte == '_' && i + 1 < len && (ptr[i + 1] == '_' || (ptr[i + 1] >= 'a' && ptr[i + 1] <= 'z'))) {
+            path_buffer_append_byte(&buf, ptr[i + 1] == '_' ? '_' : ptr[i + 1] - 'a' + 'A');
+            i += 2;
+        } else if (byte == '~' && i + 2 < len &&
+                   (high = store_hex_value(ptr[i + 1])) >= 0 &&
+                   (low  = store_hex_value(ptr[i + 2])) >= 0 &&
+                   store_byte_needs_escape(high * 16 + low)) {
+            path_buffer_append_byte(&buf, high * 16 + low);
+            i += 3;
+        } else {
+            path_buffer_append_byte(&buf, byte);
+            i++;
+        }
+    }
+    return path_buffer_finish(&buf);
+}
+
+/**
+ * Escapes the parts of a path windows can't cope with: reserved names and
+ * trailing spaces and periods.
+ *
+ * @param self [in] the StoreEncoding module
+ * @param path [in] the path to encode
+ * @return the encoded path
+ */
+static VALUE amp_store_auxiliary_encode(VALUE self, VALUE path) {
+    path_buffer buf;
+    
+    StringValue(path);
+    path_buffer_init(&buf, RSTRING_LEN(path) + 8);
+    store_auxiliary_encode(&buf, (unsigned char *)RSTRING_PTR(path), RSTRING_LEN(path));
+    return path_buffer_finish(&buf);
+}
+
+#define MAX_PATH_LEN_IN_HGSTORE 120
+#define DIR_PREFIX_LEN 8
+#define MAX_SHORTENED_DIRS_LEN (8 * (DIR_PREFIX_LEN + 1) - 4)
+
+/**
+ * The encoding used by fncache stores: the reversible encoding, unless that
+ * would be longer than 120 bytes, in which case the path is shortened and
+ * its SHA1 is worked in to keep it unique.
+ *
+ * @param self [in] the StoreEncoding module
+ * @param path [in] the path to encode
+ * @return the encoded path, or +path+ itself if it isn't under data/
+ */
+static VALUE amp_store_hybrid_encode(VALUE self, VALUE path) {
+    path_buffer encoded, lowered, res;
+    unsigned char *ptr, *aep;
+    long len, aep_len, i, start, end, dir_len, dirs_len, ext_start, base_start, base_end, space_left;
+    char *digest;
+    VALUE hexdigest;
+    
+    StringValue(path);
+    ptr = (unsigned char *)RSTRING_PTR(path);
+    len = RSTRING_LEN(path);
+    for (i = 0; i + 5 <= len && memcmp(ptr + i, "data/", 5) != 0; i++) ;
+    if (i + 5 > len)
+        return path;
+    
+    path_buffer_init(&encoded, len * 2);
+    store_encode(&encoded, ptr + 5, len - 5, 1);
+    path_buffer_init(&res, encoded.len + 16);
+    path_buffer_append(&res, "data/", 5);
+    store_auxiliary_encode(&res, (unsigned char *)encoded.ptr, encoded.len);
+    xfree(encoded.ptr);
+    if (res.len <= MAX_PATH_LEN_IN_HGSTORE)
+        return path_buffer_finish(&res);
+    
+    // too long: start over with the shortened form
+    res.len = 0;
+    hexdigest = rb_funcall(rb_funcall(path, rb_intern("sha1"), 0), rb_intern("hexdigest"), 0);
+    digest = RSTRING_PTR(hexdigest);
+    
+    path_buffer_init(&encoded, len * 2);
+    store_encode(&encoded, ptr + 5, len - 5, 0);
+    path_buffer_init(&lowered, encoded.len + 16);
+    store_auxiliary_encode(&lowered, (unsigned char *)encoded.ptr, encoded.len);
+    xfree(encoded.ptr);
+    aep = (unsigned char *)lowered.ptr;
+    aep_len = lowered.len;
+    
+    // the basename, and the extension within it (leading periods don't
+    // start an extension)
+    base_end = aep_len;
+    while (base_end > 0 && aep[base_end - 1] == '/')
+        base_end--;
+    base_start = base_end;
+    while (base_start > 0 && aep[base_start - 1] != '/')
+        base_start--;
+    if (base_end == 0 && aep_len > 0)
+        base_end = 1; // the path was all slashes
+    for (i = base_start; i < aep_len && aep[i] == '.'; i++) ;
+    ext_start = aep_len;
+    for (; i < base_end; i++)
+        if (aep[i] == '.')
+            ext_start = i;
+    if (base_end < aep_len)
+        ext_start = aep_len; // a trailing slash means there's no extension
+    
+    // the first few bytes of each directory, as many as fit
+    path_buffer_append(&res, "dh/", 3);
+    dirs_len = 0;
+    for (start = 0, end = 0; end < base_start; start = end + 1) {
+        for (end = start; end < aep_len && aep[end] != '/'; end++) ;
+        if (end >= base_start) break; // that was the last component
+        dir_len = end - start < DIR_PREFIX_LEN ? end - start : DIR_PREFIX_LEN;
+        if (dirs_len + 1 + dir_len > MAX_SHORTENED_DIRS_LEN) break;
+        
+        if (dirs_len > 0)
+            path_buffer_append_byte(&res, '/');
+        path_buffer_append(&res, (char *)aep + start, dir_len);
+        if (dir_len > 0 && (aep[start + dir_len - 1] == '.' || aep[start + dir_len - 1] == ' '))
+            res.ptr[res.len - 1] = '_';
+        dirs_len += (dirs_len > 0 ? 1 : 0) + dir_len;
+    }
+    if (dirs_len > 0)
+        path_buffer_append_byte(&res, '/');
+    
+    space_left = MAX_PATH_LEN_IN_HGSTORE - (res.len + 40 + (aep_len - ext_start));
+    if (space_left > 0)
+        path_buffer_append(&res, (char *)aep + base_start,
+                           base_end - base_start < space_left ? base_end - base_start : space_left);
+    path_buffer_append(&res, digest, 40);
+    path_buffer_append(&res, (char *)aep + ext_start, aep_len - ext_start);
+    xfree(lowered.ptr);
+    // digest and ptr point into these, and we've allocated since we took them
+    RB_GC_GUARD(hexdigest);
+    RB_GC_GUARD(path);
+    return path_buffer_finish(&res);
+}
+
+/**
+ * Reserves space on disk for the first +length+ bytes of an open file, so
+ * that writing a big file in pieces doesn't fragment it, and running out of
+ * space is noticed up front. The file's size isn't changed. This is only a
+ * hint: where it isn't supported, nothing happens.
+ *
+ * @param [IO] io the file, opened for writing
+ * @param [Integer] length how many bytes will be written
+ * @return [Boolean] whether the space was reserved
+ */
+static VALUE amp_support_preallocate(VALUE self, VALUE io, VALUE length) {
+#if defined(HAVE_FALLOCATE) && defined(FALLOC_FL_KEEP_SIZE)
+    long len = NUM2LONG(length);
+    int fd;
+    
+    if (len <= 0 || !rb_respond_to(io, rb_intern("fileno"))) return Qfalse;
+    fd = NUM2INT(rb_funcall(io, rb_intern("fileno"), 0));
+    return fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)len) == 0 ? Qtrue : Qfalse;
+#else
+    return Qfalse;
+#endif
+}
+
+static VALUE rb_mInotify;
+
+/**
+ * Creates an inotify instance. Read events from it with IO.for_fd.
+ *
+ * @return [Integer, nil] the file descriptor, or nil where there's no inotify
+ */
+static VALUE amp_inotify_init(VALUE self) {
+#ifndef HAVE_SYS_INOTIFY_H
+    return Qnil;
+#else
+#ifdef IN_CLOEXEC
+    int fd = inotify_init1(IN_CLOEXEC);
+#else
+    int fd = inotify_init();
+#endif
+    if (fd < 0) rb_sys_fail("inotify_init");
+    return INT2NUM(fd);
+#endif
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+/**
+ * Starts watching a path.
+ *
+ * @param [Integer] fd the inotify instance
+ * @param [String] path the path to watch
+ * @param [Integer] mask the events to watch for
+ * @return [Integer] the watch descriptor, which events name the path by
+ */
+static VALUE amp_inotify_add_watch(VALUE self, VALUE fd, VALUE path, VALUE mask) {
+    int wd;
+    
+    StringValue(path);
+    wd = inotify_add_watch(NUM2INT(fd), StringValueCStr(path), NUM2UINT(mask));
+    if (wd < 0) rb_sys_fail(StringValueCStr(path));
+    return INT2NUM(wd);
+}
+
+/**
+ * Stops watching a path. A watch the kernel has already dropped (because
+ * its directory went away) is ignored.
+ *
+ * @param [Integer] fd the inotify instance
+ * @param [Integer] wd the watch descriptor
+ * @return [nil]
+ */
+static VALUE amp_inotify_rm_watch(VALUE self, VALUE fd, VALUE wd) {
+    if (inotify_rm_watch(NUM2INT(fd), NUM2INT(wd)) < 0 && errno != EINVAL)
+        rb_sys_fail("inotify_rm_watch");
+    return Qnil;
+}
+#endif
+
 /**
  * Initializes the Support module's C extension.
  * This function is the entry point to the module - when the code is require'd,
@@ -247,4 +790,46 @@ void Init_CSupport() {
     
     // method added to the Integer class
     rb_define_method(rb_cInteger, "to_dirstate_symbol", amp_integer_to_dirstate_symbol, 0);
+    
+    // Amp::Support::PrefixSet, for matching many literal prefixes at once
+    rb_cPrefixSet = rb_define_class_under(rb_define_module_under(rb_define_module("Amp"), "Support"),
+                                          "PrefixSet", rb_cObject);
+    rb_define_alloc_func(rb_cPrefixSet, amp_prefix_set_alloc);
+    rb_define_method(rb_cPrefixSet, "<<", amp_prefix_set_add, 1);
+    rb_define_method(rb_cPrefixSet, "prefix_of?", amp_prefix_set_prefix_of, 1);
+    rb_define_method(rb_cPrefixSet, "empty?", amp_prefix_set_empty, 0);
+    
+    // Amp::Support::StoreEncoding, for turning tracked paths into store paths
+    rb_mStoreEncoding = rb_define_module_under(rb_define_module_under(rb_define_module("Amp"), "Support"),
+                                               "StoreEncoding");
+    rb_define_module_function(rb_mStoreEncoding, "encode", amp_store_encode, -1);
+    rb_define_module_function(rb_mStoreEncoding, "decode", amp_store_decode, 1);
+    rb_define_module_function(rb_mStoreEncoding, "auxiliary_encode", amp_store_auxiliary_encode, 1);
+    rb_define_module_function(rb_mStoreEncoding, "hybrid_encode", amp_store_hybrid_encode, 1);
+    
+    // Amp::Support.preallocate, for reserving space for files we're about to write
+    rb_define_module_function(rb_define_module_under(rb_define_module("Amp"), "Support"),
+                              "preallocate", amp_support_preallocate, 2);
+    
+    // Amp::Support::Inotify, for the watch server
+    rb_mInotify = rb_define_module_under(rb_define_module_under(rb_define_module("Amp"), "Support"),
+                                         "Inotify");
+    rb_define_module_function(rb_mInotify, "init", amp_inotify_init, 0);
+#ifdef HAVE_SYS_INOTIFY_H
+    rb_define_module_function(rb_mInotify, "add_watch", amp_inotify_add_watch, 3);
+    rb_define_module_function(rb_mInotify, "rm_watch", amp_inotify_rm_watch, 2);
+    rb_define_const(rb_mInotify, "MODIFY",      UINT2NUM(IN_MODIFY));
+    rb_define_const(rb_mInotify, "ATTRIB",      UINT2NUM(IN_ATTRIB));
+    rb_define_const(rb_mInotify, "CREATE",      UINT2NUM(IN_CREATE));
+    rb_define_const(rb_mInotify, "DELETE",      UINT2NUM(IN_DELETE));
+    rb_define_const(rb_mInotify, "MOVED_FROM",  UINT2NUM(IN_MOVED_FROM));
+    rb_define_const(rb_mInotify, "MOVED_TO",    UINT2NUM(IN_MOVED_TO));
+    rb_define_const(rb_mInotify, "DELETE_SELF", UINT2NUM(IN_DELETE_SELF));
+    rb_define_const(rb_mInotify, "MOVE_SELF",   UINT2NUM(IN_MOVE_SELF));
+    rb_define_const(rb_mInotify, "Q_OVERFLOW",  UINT2NUM(IN_Q_OVERFLOW));
+    rb_define_const(rb_mInotify, "IGNORED",     UINT2NUM(IN_IGNORED));
+    rb_define_const(rb_mInotify, "ISDIR",       UINT2NUM(IN_ISDIR));
+    rb_define_const(rb_mInotify, "ONLYDIR",     UINT2NUM(IN_ONLYDIR));
+    rb_define_const(rb_mInotify, "DONT_FOLLOW", UINT2NUM(IN_DONT_FOLLOW));
+#endif
 }
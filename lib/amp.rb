@@ -53,14 +53,21 @@ module Amp
   autoload :Statistics,                "amp/support/statistics.rb"
   
   module Git
+    autoload :Ignore,                    "amp/support/git/ignore.rb"
+    
     autoload :Changeset,                 "amp/repository/git/repo_format/changeset.rb"
     autoload :WorkingDirectoryChangeset, "amp/repository/git/repo_format/changeset.rb"
     autoload :VersionedFile,             "amp/repository/git/repo_format/versioned_file.rb"
     autoload :VersionedWorkingFile,      "amp/repository/git/repo_format/versioned_file.rb"
+    autoload :ObjectStore,               "amp/repository/git/repo_format/object_store.rb"
+    autoload :PackFile,                  "amp/repository/git/repo_format/pack_file.rb"
+    autoload :Index,                     "amp/repository/git/repo_format/index.rb"
+    autoload :CatFile,                   "amp/repository/git/repo_format/cat_file.rb"
   end
   
   module Mercurial
     autoload :Ignore,                    "amp/support/mercurial/ignore.rb"
+    autoload :Batch,                     "amp/support/mercurial/batch.rb"
     
     autoload :Journal,                   "amp/repository/mercurial/repo_format/journal.rb"
     autoload :VersionedFile,             "amp/repository/mercurial/revlogs/versioned_file.rb"
@@ -115,6 +122,7 @@ module Amp
     autoload :AncestorCalculator,        "amp/graphs/ancestor.rb"
     module Mercurial
       autoload :CopyCalculator,          "amp/graphs/copies.rb"
+      autoload :Discovery,               "amp/graphs/discovery.rb"
     end
   end                                      
   
@@ -156,6 +164,7 @@ module Amp
       autoload :BranchManager,           "amp/repository/mercurial/repo_format/branch_manager.rb"
       autoload :BundleRepository,        "amp/repository/mercurial/repositories/bundle_repository.rb"
       autoload :DirState,                "amp/repository/mercurial/repo_format/dir_state.rb"
+      autoload :HashCache,               "amp/repository/mercurial/repo_format/hash_cache.rb"
       autoload :HTTPRepository,          "amp/repository/mercurial/repositories/http_repository.rb"
       autoload :HTTPSRepository,         "amp/repository/mercurial/repositories/http_repository.rb"
       autoload :LocalRepository,         "amp/repository/mercurial/repositories/local_repository.rb"
@@ -167,23 +176,33 @@ module Amp
       autoload :TagManager,              "amp/repository/mercurial/repo_format/tag_manager.rb"
       autoload :Updatable,               "amp/repository/mercurial/repo_format/updatable.rb"
       autoload :Verification,            "amp/repository/mercurial/repo_format/verification.rb"
+      autoload :WatchState,              "amp/repository/mercurial/repo_format/watch_state.rb"
     end
   end
   
 
   
   module Servers
+    autoload :BundleCache,               "amp/server/bundle_cache.rb"
+    autoload :CommandChannel,            "amp/server/command_channel.rb"
+    autoload :CommandServer,             "amp/server/command_server.rb"
     autoload :FancyHTTPServer,           "amp/server/fancy_http_server.rb"
     autoload :HTTPServer,                "amp/server/http_server.rb"
     autoload :HTTPAuthorizedServer,      "amp/server/http_server.rb"
     autoload :RepoUserManagement,        "amp/server/repo_user_management.rb"
     autoload :User,                      "amp/server/amp_user.rb"
+    autoload :WatchServer,               "amp/server/watch_server.rb"
   end                                    
                                          
   module Support                         
+    autoload :Archiver,                  "amp/support/archiver.rb"
     autoload :Logger,                    "amp/support/logger.rb"
     autoload :MultiIO,                   "amp/support/multi_io.rb"
+    autoload :OrderedPool,               "amp/support/ordered_pool.rb"
+    autoload :QueuedReader,              "amp/support/queued_reader.rb"
     autoload :Template,                  "amp/templates/template.rb"
+    autoload :FileTemplate,              "amp/templates/template.rb"
+    autoload :RawERbTemplate,            "amp/templates/template.rb"
   end
 end
 
@@ -212,15 +231,14 @@ require "amp/dependencies/amp_support.rb"
 require "amp/support/ruby_19_compatibility.rb"
 require "amp/support/support.rb"              
 require "amp/dependencies/highline_extensions.rb"
-require "amp/templates/template.rb"
 require "amp/repository/mercurial/repository.rb" # we're just loading in
 require 'amp/repository/git/repository.rb'       # all of the base repositories
 
 if $cl # if it's a command line app
-  include Amp::KernelMethods
   require       "amp/commands/command.rb"
+  include Amp::KernelMethods
   require_dir { "amp/commands/*.rb"              }
-  require_dir { "amp/commands/commands/*.rb"     }
+  # the commands themselves are loaded on demand - see Amp::CommandIndex
 else
   # it's not a command line app
  require     'amp/support/docs.rb' # live documentation access
@@ -142,16 +142,18 @@ module Amp
       # @param  [Symbol] the workflow to use for the lookup
       # @return [Amp::Command] the command for the given name and workflow
       def command_for_workflow(cmd, flow)
-        all_for_workflow(flow)[cmd.to_sym]
+        all_for_workflow(flow)[cmd.to_sym] ||
+          (CommandIndex.require_command(cmd, flow) && all_for_workflow(flow)[cmd.to_sym])
       end
       
       ##
-      # Returns all of the commands registered in the system.
+      # Returns all of the commands registered in the system. Commands that
+      # haven't been loaded yet are loaded from the {CommandIndex}.
       # 
       # @return [Hash<Symbol => Amp::Command>, NilClass] the commands, keyed by
       #   command name as a symbol. returns nil if nothing is found
       def [](arg)
-        all[arg.to_sym]
+        all[arg.to_sym] || (CommandIndex.require_command(arg) && all[arg.to_sym])
       end
     end
 
@@ -284,6 +286,7 @@ module Amp
         @synonyms << arg
         self.class.all_synonyms[arg.to_sym] = self
       end
+      @synonyms
     end
     alias_method :synonyms, :synonym
     
@@ -519,5 +522,17 @@ module Amp
       yield
       Amp::Command.pop_namespace
     end
+    
+    ##
+    # Defines a template, for ampfiles and ~/.amprc. The template classes
+    # are autoloaded, so this costs nothing until it's used.
+    def template(name, *args)
+      if args.size > 2 || args.empty?
+        raise ArgumentError.new('Usage of template: template(name, text)'+
+                                'or template(name, renderer, text)')
+      end
+      template = (args.size > 1) ? args[0] : :erb
+      Support::Template.new(:all, name, template, args.last)
+    end
   end
 end
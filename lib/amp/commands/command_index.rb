@@ -0,0 +1,228 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+module Amp
+
+  ##
+  # = CommandIndex
+  # A summary of amp's built-in commands for one workflow: each command's
+  # name, synonyms, description, options, and the file that defines it.
+  # With it, the dispatcher only has to load the one command it's about
+  # to run, instead of every command there is.
+  #
+  # The index is generated the first time a workflow's commands are loaded
+  # in full, and saved in the user's cache directory, under a name that's
+  # unique to this copy of amp. It goes stale (and gets regenerated on the
+  # next run) as soon as a command file is added, removed, or modified.
+  module CommandIndex
+    # Where the commands shared by all workflows live, relative to CODE_ROOT
+    GLOBAL_COMMANDS   = "amp/commands/commands/*.rb"
+    # Where the commands of each workflow live, relative to CODE_ROOT
+    WORKFLOW_COMMANDS = "amp/commands/commands/workflows/%s/**/*.rb"
+    # Where the indexes are stored, unless told otherwise
+    CACHE_DIR         = "~/.amp/cache"
+    # The name of the index for each workflow: one per copy of amp, so
+    # installs don't trample each other's
+    INDEX_FILE        = "command_index-%s.%s"
+    
+    @indexes = {}
+    @loaded  = {}
+    
+    class << self
+      # The workflow last passed to {prepare}
+      attr_reader :workflow
+      # Where the indexes are stored
+      attr_writer :cache_dir
+      
+      def cache_dir
+        @cache_dir || File.expand_path(CACHE_DIR)
+      end
+      
+      ##
+      # Gets a workflow's commands ready to be looked up. If there's a fresh
+      # index, nothing is loaded; otherwise, every command for the workflow
+      # is loaded, and the index is regenerated while we're at it.
+      #
+      # @param [Symbol] flow the workflow in use
+      def prepare(flow)
+        @workflow = flow.to_sym
+        generate(flow) unless index_for(flow)
+      end
+      
+      ##
+      # Every command name and synonym usable from the given workflow,
+      # according to the index.
+      #
+      # @param [Symbol] flow the workflow in use
+      # @return [Array<Symbol>] the names of the commands
+      def names_for_workflow(flow)
+        entries_for(flow).map {|entry| [entry[:name]] + entry[:synonyms] }.flatten
+      end
+      
+      ##
+      # Loads the file defining the given command (or synonym), if it's in
+      # the index and hasn't been loaded yet.
+      #
+      # @param [String, Symbol] name the command's name or one of its synonyms
+      # @param [Symbol] flow the workflow in use
+      # @return [Boolean] was a file loaded?
+      def require_command(name, flow=workflow)
+        return false unless flow
+        name  = name.to_sym
+        entry = entries_for(flow).find do |e|
+          e[:name] == name || e[:synonyms].include?(name)
+        end
+        return false unless entry && !@loaded[entry[:file]]
+        load_command_file entry[:file]
+        true
+      end
+      
+      ##
+      # Loads every command for the given workflow. Used by anything that
+      # has to list all the commands, such as `amp help`.
+      #
+      # @param [Symbol] flow the workflow in use
+      def require_all(flow)
+        command_files(flow).each {|file| load_command_file file }
+      end
+      
+      ##
+      # Loads the commands shared by every workflow. Some of them declare
+      # that they can run without a repository, which the dispatcher needs
+      # to know before it knows the workflow.
+      def require_global
+        global_command_files.each {|file| load_command_file file }
+      end
+      
+      ##
+      # Loads every command for the workflow, noting which file defines which
+      # command, and saves the result as the workflow's index. If some
+      # commands were loaded other than through us before we got here, we
+      # can't tell where they came from, so we load the rest but don't save
+      # anything.
+      #
+      # @param [Symbol] flow the workflow to index
+      # @return [Hash, nil] the new index, or nil if one couldn't be made
+      def generate(flow)
+        flow = flow.to_sym
+        complete = (Amp::Command.all_commands.keys - @loaded.values.flatten).empty?
+        entries  = []
+        
+        command_files(flow).each do |file|
+          load_command_file(file).each do |name|
+            entries << entry_for(Amp::Command.all_commands[name], file)
+          end
+        end
+        return nil unless complete
+        
+        index = {:fingerprint => fingerprint(flow), :commands => entries}
+        @indexes[flow] = index
+        save index, index_file(flow)
+        index
+      end
+      
+      private
+      
+      ##
+      # Requires a command file, and remembers which commands it defined.
+      #
+      # @param [String] file the file, relative to CODE_ROOT
+      # @return [Array<Symbol>] the names of the commands it defined
+      def load_command_file(file)
+        return @loaded[file] if @loaded[file]
+        before = Amp::Command.all_commands.keys
+        require file
+        @loaded[file] = Amp::Command.all_commands.keys - before
+      end
+      
+      ##
+      # Where the workflow's index is kept.
+      def index_file(flow)
+        name = INDEX_FILE % [Digest::SHA1.hexdigest(Amp::CODE_ROOT)[0, 12], flow]
+        File.join(cache_dir, name)
+      end
+      
+      ##
+      # Writes an index out. It goes to a temporary file first, so another
+      # amp reading the index never sees half of it.
+      def save(index, path)
+        FileUtils.mkdir_p File.dirname(path)
+        temp = "#{path}.#{Process.pid}"
+        File.open(temp, "wb") {|f| f.write Marshal.dump(index) }
+        File.rename temp, path
+      rescue SystemCallError, ArgumentError
+        # no writable cache (or no home) - we'll just regenerate next time
+        File.unlink temp if temp && File.exist?(temp)
+      end
+      
+      ##
+      # The command files visible to a workflow, relative to CODE_ROOT (so
+      # they match what `require_dir` requires).
+      def command_files(flow)
+        global_command_files + files_matching(WORKFLOW_COMMANDS % flow)
+      end
+      
+      def global_command_files
+        files_matching GLOBAL_COMMANDS
+      end
+      
+      def files_matching(glob)
+        Dir[File.join(Amp::CODE_ROOT, glob)].sort.map {|f| f[Amp::CODE_ROOT.size+1..-1] }
+      end
+      
+      ##
+      # Enough stat data about the workflow's command files to notice when
+      # any of them changes.
+      def fingerprint(flow)
+        command_files(flow).map do |file|
+          stat = File.stat File.expand_path(file, Amp::CODE_ROOT)
+          [file, stat.size, stat.mtime.to_i]
+        end
+      end
+      
+      ##
+      # The summary of a single command, as stored in the index.
+      def entry_for(command, file)
+        {:name      => command.name.to_sym,
+         :file      => file,
+         :synonyms  => command.synonyms.map {|s| s.to_sym },
+         :workflows => command.workflows.dup,
+         :desc      => command.desc,
+         :options   => command.options.map {|o| [o[:name], o[:desc], o[:options][:short]] } }
+      end
+      
+      ##
+      # The commands in the workflow's index, or none if the index is stale.
+      def entries_for(flow)
+        index = index_for(flow)
+        index ? index[:commands] : []
+      end
+      
+      ##
+      # Reads the workflow's index, if there is one and it's still fresh.
+      def index_for(flow)
+        flow = flow.to_sym
+        return @indexes[flow] if @indexes[flow]
+        
+        index = begin
+          File.open(index_file(flow), "rb") {|f| Marshal.load f.read }
+        rescue StandardError # missing, or written by an incompatible ruby
+          nil
+        end
+        return nil unless index.is_a?(Hash) && index[:fingerprint] == fingerprint(flow)
+        @indexes[flow] = index
+      end
+    end
+  end
+end
@@ -18,6 +18,8 @@ command :help do |c|
   
   c.on_run do |options, args|
     output = ""
+    # help needs to know about every command, not just the indexed ones
+    Amp::CommandIndex.require_all options[:global_config]["amp"]["workflow", Symbol, :hg]
     
     cmd_name = args.empty? ? "__default__" : args.first
     Amp::Help::HelpUI.print_entry(cmd_name, options)
@@ -53,86 +53,31 @@ HELP
   c.on_run do |opts, args|
     repo      = opts[:repository]
     rev       = opts[:rev]
-    changeset = repo[rev]
+    changeset = rev ? repo[rev] : repo[nil].parents.first # the working dir's parent
     dest      = args.shift
+    type      = opts[:type] || 'files'
     
     matcher   = Amp::Match.create(:includer => opts[:include],
                                   :excluder => opts[:exclude]) { true }
     
+    need { '../../../../../../ext/amp/bz2/bz2' } if type == 'tbz2'
+    
+    # Find each file's node here, since the manifest is shared - the
+    # workers then only touch their own filelogs.
+    files = changeset.all_files.select {|file| matcher.call file }.sort.map do |file|
+      [file, changeset.file_node(file), changeset.flags(file)]
+    end
     
     Amp::UI::tell "created destination \"#{dest}\", now writing files"
     
-    make_tar_file = lambda do |tar_dest|
-      File.open(tar_dest, 'w') do |tarfile|
-        Archive::Tar::Minitar::Writer.open(tarfile) do |tar|
-          changeset.walk(matcher).each do |file|
-            Amp::UI::tell '.' # use dots to keep track
-            data = changeset.get_file(file).data
-            tar.add_file_simple(File.join(FileHelpers.split_extension(dest).first,file), :size => data.size, :mode => 0644) { |f| f.write data }
-          end
-        end
-      end
-    end
+    archive_opts = {:prefix   => opts[:prefix],
+                    :mtime    => changeset.easy_date.to_i,
+                    :progress => lambda {|name| Amp::UI::tell '.' }} # use dots to keep track
     
-    case opts[:type]
-    when 'files' # a directory full of files
-      FileUtils.mkdir_p dest
-      Dir.chdir dest
-            
-      changeset.walk(matcher).each do |file|
-        Amp::UI::tell '.' # use dots to keep track
-        FileUtils.mkdir_p File.dirname(file) # make all the leading dirs
-        File.open(file, 'w') {|f| f.write changeset.get_file(file).data } # now write the data
-      end
-      
-    when 'tar' # tar archive, uncompressed
-      make_tar_file[dest]
-    when 'tbz2' # tar archive, compressed using bzip2
-      # http://www.nabble.com/how-to-stream-or-write-data-into-a-tar.gz-file-as-if-the-data-were--from-files--td19498643.html
-      need { '../../../../../../ext/amp/bz2/bz2' }
-      
-      tar_name = FileHelpers.split_extension(dest).first + '.tar'
-      
-      make_tar_file[tar_name]
-      
-      File.open(tar_name) do |in_tar|
-        BZ2::Writer.open(dest) do |f|
-          in_tar.amp_each_chunk { |chunk| Amp::UI::tell 'c'; f.write chunk }
-        end
-      end
-      
-      File.unlink(tar_name)
-    when 'tgz' # tar archive, compressed using gzip
-      # http://www.nabble.com/how-to-stream-or-write-data-into-a-tar.gz-file-as-if-the-data-were--from-files--td19498643.html
-      require 'zlib'
-      tar_name = FileHelpers.split_extension(dest).first + '.tar'
-      
-      make_tar_file[tar_name]
-      
-      File.open(tar_name) do |in_tar|
-        Zlib::GzipWriter.open(dest) do |f|
-          in_tar.amp_each_chunk { |chunk| Amp::UI::tell 'c'; f.write chunk }
-        end
-      end
-      
-      File.unlink(tar_name)
-    when 'uzip' # zip archive, uncompressed
-      raise "Not Yet Implemented"
-    when 'zip' # zip archive, compressed using deflate
-      
-      # Open up the destination
-      Zip::ZipFile.open dest, Zip::ZipFile::CREATE do |z|
-        # For each file in the revision that matches what we want
-        changeset.walk(matcher).each do |f|
-          Amp::UI::tell '.' # use dots to keep track
-          # create a file-spot for the file in the changeset
-          # and write the data to it
-          z.get_output_stream(f) {|q| q << changeset.get_file(f).data }
-        end
-        z.commit
+    Amp::Support::Archiver.open(type, dest, archive_opts) do |archive|
+      archive.write(files) do |file, node, flags|
+        [file, repo.file_log(file).read(node), flags.include?('x') ? 0755 : 0644]
       end
-    else
-      raise "Unknown compression type: #{opts[:type]}"
     end
     
     Amp::UI::say " revision exported!"
@@ -57,6 +57,7 @@ HELP
     url[:revs] = url[:revs].map {|r| remote.lookup r } if url[:revs] && url[:revs].any?
     common, incoming, remote_heads = *repo.common_nodes(remote, :heads => url[:revs],
                                                                 :force => opts[:force])
+    sampled = repo.sampling_discovery? remote
     
   
     if incoming.empty?
@@ -72,7 +73,9 @@ HELP
       # create a bundle (uncompressed if the other repo is not local)
     
       url[:revs] = remote_heads if url[:revs].nil? && remote.capable?('changegroupsubset')
-      cg = if url[:revs].nil? || !url[:revs].any?
+      cg = if sampled
+             remote.get_bundle common, url[:revs] || [], 'incoming'
+           elsif url[:revs].nil? || !url[:revs].any?
              remote.changegroup incoming, 'incoming'
            else
              remote.changegroup_subset incoming, url[:revs], 'incoming'
@@ -88,6 +91,9 @@ HELP
       end
     end
     opts.merge! :template_type => :log
+    # sampling leaves us with the new heads rather than the new roots, but
+    # the bundle's got just what we're missing
+    incoming = remote.changelog.find_missing(common.dup, (url[:revs] || remote_heads).dup) if sampled
     remote.changelog.nodes_between(incoming, url[:revs])[:between].each do |n|
       puts remote[n].to_templated_s(opts)
     end
@@ -18,7 +18,7 @@ command :log do |c|
   c.opt :verbose, "Verbose output", {:short => "-v"}
   c.opt :limit, "Limit how many revisions to show", {:short => "-l", :type => :integer}
   c.opt :template, "Which template to use while printing", {:short => "-t", :type => :string, :default => "default"}
-  c.opt :no_output, "Doesn't print output (useful for benchmarking)"
+  c.opt :no_output, "Renders the log but doesn't print it (useful for benchmarking)"
   
   c.on_run do |options, args|
     repo = options[:repository]
@@ -26,11 +26,49 @@ command :log do |c|
     limit = repo.size if limit.nil?
     
     start = repo.size - 1
-    stop  = start - limit + 1
+    stop  = [start - limit + 1, 0].max
     
-    options.merge! :template_type => :log
-    start.downto stop do |x|
-      puts repo[x].to_templated_s(options) unless options[:no_output]
+    render_opts = options.merge :template_type => :log, :output => ""
+    render_opts.delete :no_output
+    
+    # The log is rendered by a worker thread, a window of revisions at a
+    # time: their changelog data is read in one go, then each one is rendered
+    # onto the end of a buffer, which is handed over whenever it fills up.
+    # Only a few buffers can be waiting at once, so if whatever we're writing
+    # to is slow (or gone - `amp log | head`), the worker stops with it.
+    window = 64
+    log = Amp::Support::QueuedReader.new(4) do |sink|
+      buffer = render_opts[:output]
+      start.step(stop, -window) do |top|
+        bottom = [top - window + 1, stop].max
+        repo.changelog.prefetch_chunks bottom, top if repo.respond_to? :changelog
+        top.downto bottom do |x|
+          before = buffer.size
+          repo[x].to_templated_s render_opts
+          # same as puts would do
+          buffer << "\n" if buffer.size == before || !buffer.end_with?("\n")
+          if buffer.size >= 16.kb
+            sink << buffer
+            buffer = render_opts[:output] = ""
+          end
+        end
+      end
+      sink << buffer
+    end
+    
+    begin
+      # pass each buffer along as soon as it's ready, so a pager has
+      # something to show right away
+      until log.eof?
+        chunk = log.readpartial 64.kb
+        $stdout.write chunk unless options[:no_output]
+      end
+      log.close
+    rescue Errno::EPIPE
+      log.abort # nobody's listening anymore
+    rescue Exception
+      log.abort
+      raise
     end
   end
 end
@@ -23,9 +23,26 @@ command :serve do |c|
   c.opt :storage, "Store the users in [TYPE] manner. Can be 'memory'", :short => "-s", :type => :string,
                                                                                :default => 'memory'
   c.opt :users,   "File from which to read the users (YAML format)",           :short => '-u', :type => :string
+  c.opt :cmdserver, "Serve amp commands (for bin/ampc) over a unix socket instead of HTTP", :short => '-C'
+  c.opt :socket,  "The unix socket for --cmdserver or --watch (default: .hg/cmdserver.sock or .hg/watch.sock)",
+                  :type => :string
+  c.opt :watch,   "Watch the working directory with inotify, so status only looks at changed files", :short => '-W'
   
   c.on_run do |opts, args|
     repo = opts[:repository]
+    
+    if opts[:watch]
+      socket = opts[:socket] || Amp::Servers::WatchServer.default_socket_for(repo)
+      Amp::Servers::WatchServer.new(repo.root, socket).run!
+      next
+    end
+    
+    if opts[:cmdserver]
+      socket = opts[:socket] || Amp::Servers::CommandServer.default_socket_for(repo)
+      Amp::Servers::CommandServer.new(socket).run!
+      next
+    end
+    
     http_path = opts[:path]
     auth = opts[:basic] ? :basic : :digest
     
@@ -16,8 +16,9 @@ command :verify do |c|
   c.workflow :hg
   
   c.desc "Verifies the mercurial repository, checking for integrity errors"
+  c.opt :jobs, "Number of processes to check file logs with", :short => "-j", :type => :integer, :default => 1
   c.on_run do |opts, args|
-    results = opts[:repository].verify
+    results = opts[:repository].verify :jobs => opts[:jobs]
     
     Amp::UI.tell "#{results.files} file#{results.files == 1 ? '' : 's' }, "
     Amp::UI.tell "#{results.changesets} changeset#{results.changesets == 1 ? '' : 's' }, "
@@ -81,6 +81,8 @@ module Amp
       begin
         cmd_opts[:repository] = Repositories.pick(local_config, global_opts[:repository])
       rescue
+        # commands declare whether they need a repo when they're loaded
+        CommandIndex.require_global
         unless Command::NO_REPO_ALLOWED[cmd.to_sym] || Command::MAYBE_REPO_ALLOWED[cmd.to_sym]
           raise
         end
@@ -92,9 +94,8 @@ module Amp
       
       workflow = local_config["amp"]["workflow", Symbol, :hg]
       
-      if File.exists?(File.expand_path(File.join(File.dirname(__FILE__), "commands/workflows/#{workflow}/")))
-        require_dir { "amp/commands/commands/workflows/#{workflow}/**/*.rb" }
-      end
+      # only loads the commands if there's no up-to-date index of them
+      CommandIndex.prepare workflow
       
       user_amprc = File.expand_path("~/.amprc")
       File.exist?(user_amprc) && load(user_amprc)  
@@ -171,10 +172,13 @@ module Amp
     # @return [Amp::Command] the command object that was found, or nil if none was found.
     def self.pick_command(cmd, config)  
       my_flow = config["amp"]["workflow", Symbol, :hg]
-      if c = Amp::Command.all_for_workflow(my_flow).keys.map {|k| k.to_s}.abbrev[cmd]
+      # commands from ampfiles are loaded; built-in ones might only be indexed
+      names = Amp::Command.all_for_workflow(my_flow).keys | CommandIndex.names_for_workflow(my_flow)
+      names = names.map {|k| k.to_s}
+      if c = names.abbrev[cmd]
         Amp::Command.command_for_workflow(c, my_flow)
       else
-        prefix_list = Amp::Command.all_for_workflow(my_flow).keys.map {|k| k.to_s}.select {|k| k.start_with? cmd.to_s }
+        prefix_list = names.select {|k| k.start_with? cmd.to_s }
         
         if prefix_list.size > 1
           puts "Ambiguous command: #{cmd}. Could mean: #{prefix_list.join(", ")}"
@@ -116,3 +116,222 @@ class String
 end
 
 
+
+module Amp
+  module Support
+    ##
+    # Reserves space on disk for the first +length+ bytes of an open file.
+    # Only the C extension knows how; this is a hint, so here it's a no-op.
+    #
+    # @param [IO] io the file, opened for writing
+    # @param [Integer] length how many bytes will be written
+    # @return [Boolean] whether the space was reserved - never, here
+    def self.preallocate(io, length)
+      false
+    end
+    
+    ##
+    # inotify is only reachable from the C extension, so without it there's
+    # nothing to watch the working directory with.
+    module Inotify
+      ##
+      # @return [nil] no inotify instance - ever, here
+      def self.init
+        nil
+      end
+    end
+    
+    ##
+    # A set of strings that can answer "is any member a prefix of this
+    # string?" without trying each member in turn. Members are bucketed by
+    # length, so a check costs one hash lookup per distinct length.
+    class PrefixSet
+      def initialize
+        @by_length = {}
+      end
+      
+      ##
+      # Adds a string to the set.
+      #
+      # @param [String] str the string to add
+      # @return [PrefixSet] self
+      def <<(str)
+        (@by_length[str.size] ||= {})[str] = true
+        self
+      end
+      
+      ##
+      # Is some member of the set a prefix of +str+?
+      #
+      # @param [String] str the string to check
+      # @return [Boolean] whether a member of the set starts +str+
+      def prefix_of?(str)
+        @by_length.any? do |length, members|
+          length <= str.size && members[str[0, length]]
+        end
+      end
+      
+      ##
+      # Is the set empty?
+      def empty?
+        @by_length.empty?
+      end
+    end
+    
+    ##
+    # The encodings that turn the path of a tracked file into the path of its
+    # revlog in the store.
+    module StoreEncoding
+      extend self
+      
+      # can't name a file one of these on windows, apparently
+      WINDOWS_RESERVED_FILENAMES = %w(con prn aux nul com1
+      com2 com3 com4 com5 com6 com7 com8 com8 lpt1 lpt2
+      lpt3 lpt4 lpt5 lpt6 lpt7 lpt8 lpt9)
+      
+      MAX_PATH_LEN_IN_HGSTORE = 120
+      DIR_PREFIX_LEN = 8
+      MAX_SHORTENED_DIRS_LEN = 8 * (DIR_PREFIX_LEN + 1) - 4
+      
+      ##
+      # Reversible encoding of the filename
+      #
+      # @param [String] s a file's path you wish to encode
+      # @param [Boolean] underscore should we insert underscores when
+      #   downcasing letters? (e.g. if true, "A" => "_a")
+      # @return [String] an encoded file path
+      def encode(s, underscore=true)
+        cmap = character_map underscore
+        s.unpack("C*").map {|c| cmap[c] }.join
+      end
+      
+      ##
+      # Decodes an encoding performed by #encode. Anything that isn't a valid
+      # encoding is left as it is.
+      #
+      # @param [String] s an encoded file path
+      # @return [String] the decoded file path
+      def decode(s)
+        dmap = decoding_map
+        i = 0
+        result = []
+        while i < s.size
+          l = (1..3).find {|l| dmap[s[i, l]] }
+          result << (l ? dmap[s[i, l]] : s[i, 1])
+          i += l || 1
+        end
+        result.join
+      end
+      
+      ##
+      # Escapes the parts of a path that windows can't cope with: reserved
+      # names, and trailing periods and spaces.
+      #
+      # @param [String] path the path to encode
+      # @return [String] the encoded path
+      def auxiliary_encode(path)
+        res = []
+        path.split('/').each do |n|
+          if n.any?
+            base = n.split('.')[0]
+            if !(base.nil?) && base.any? && WINDOWS_RESERVED_FILENAMES.include?(base)
+              ec = "~%02x" % n[2,1].ord
+              n = n[0..1] + ec + n[3..-1]
+            end
+            if ['.',' '].include? n[-1,1]
+              n = n[0..-2] + ("~%02x" % n[-1,1].ord)
+            end
+          end
+          res << n
+        end
+        res.join("/")
+      end
+      
+      ##
+      # uber encoding that's straight up crazy.
+      # Max length of 120 means we have a non-reversible encoding,
+      # but since the FilenameCache only cares about name lookups, one-way
+      # is really all that matters!
+      #
+      # @param [String] path the path to encode
+      # @return [String] an encoded path, with a maximum length of 120.
+      def hybrid_encode(path)
+        return path unless path =~ /data\//
+        ndpath = path["data/".size..-1]
+        res = "data/" + auxiliary_encode(encode(ndpath))
+        if res.size > MAX_PATH_LEN_IN_HGSTORE
+          digest = path.sha1.hexdigest
+          aep = auxiliary_encode(encode(ndpath, false))
+          ext = extension_of aep
+          parts = aep.split('/')
+          basename = File.basename aep
+          sdirs = []
+          parts[0..-2].each do |p|
+            d = p[0..(DIR_PREFIX_LEN-1)]
+            
+            d = d[0..-2] + "_" if d.any? && " .".include?(d[-1,1])
+            
+            t = sdirs.join("/") + "/" + d
+            break if t.size > MAX_SHORTENED_DIRS_LEN
+            
+            sdirs << d
+          end
+          dirs = sdirs.join("/")
+          dirs += "/" if dirs.size > 0
+          
+          res = "dh/" + dirs + digest + ext
+          space_left = MAX_PATH_LEN_IN_HGSTORE - res.size
+          if space_left > 0
+            filler = basename[0..(space_left-1)]
+            res = "dh/" + dirs + filler + digest + ext
+          end
+        end
+        res
+      end
+      
+      private
+      
+      ##
+      # Maps each byte to what it's encoded as.
+      #
+      # @param [Boolean] underscore Should underscores be inserted in front of
+      #   capital letters before we downcase them? (e.g. if true, "A" => "_a")
+      def character_map(underscore)
+        @character_maps ||= {}
+        @character_maps[underscore] ||= begin
+          e = '_'
+          win_reserved = "\\:*?\"<>|".unpack("C*")
+          cmap = {}; 0.upto(126) {|x| cmap[x] = x.chr}
+          ((0..31).to_a + (126..255).to_a + win_reserved).each do |x|
+            cmap[x] = "~%02x" % x
+          end
+          ((("A".ord)..("Z".ord)).to_a + [e.ord]).each do |x|
+            cmap[x] = e + x.chr.downcase if underscore
+            cmap[x] = x.chr.downcase     unless underscore
+          end
+          cmap
+        end
+      end
+      
+      ##
+      # Maps each encoded sequence back to the byte it came from.
+      def decoding_map
+        @decoding_map ||= character_map(true).inject({}) do |dmap, (byte, encoded)|
+          dmap[encoded] = byte.chr
+          dmap
+        end
+      end
+      
+      ##
+      # The extension of the last component of a path, including its period.
+      # Leading periods don't start an extension (".hgtags" has none).
+      def extension_of(path)
+        return "" if path[-1,1] == "/"
+        basename = path.split("/").last || ""
+        dot = basename.rindex(".")
+        return "" unless dot && basename[0, dot].delete(".").any?
+        basename[dot..-1]
+      end
+    end
+  end
+end
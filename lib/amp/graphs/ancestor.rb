@@ -27,8 +27,8 @@ module Amp
     # common ancestor (usually the case when doing a branch merge in a rapid
     # development environment), then this is a huge amount of wasted processing.
     # Generators aren't a familiar construct for most ruby developers, and they
-    # work via continuations, which are also typically avoided like the plague.
-    # Check out 'lib/support/generator.rb' to see how it works.
+    # work via fibers - or on 1.8, continuations, which are typically avoided
+    # like the plague. Check out 'lib/support/generator.rb' to see how it works.
     #
     #    A   B
     #    |   |
@@ -0,0 +1,184 @@
+#######################################################################
+#                  Licensing Information                              #
+#                                                                     #
+#  The following code is a derivative work of the code from the       #
+#  Mercurial project, which is licensed GPLv2. This code therefore    #
+#  is also licensed under the terms of the GNU Public License,        #
+#  verison 2.                                                         #
+#                                                                     #
+#  For information on the license of this code when distributed       #
+#  with and used in conjunction with the other modules in the         #
+#  Amp project, please see the root-level LICENSE file.               #
+#                                                                     #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                        #
+#                                                                     #
+#######################################################################
+
+module Amp
+  module Graphs
+    module Mercurial
+
+      ##
+      # = Discovery
+      # Works out which of our changesets a remote repository also has, by
+      # asking it about samples of our history with the +known+ command.
+      # Every "yes" means the remote has that changeset's ancestors too, and
+      # every "no" means it has none of its descendants either, so each round
+      # trip settles far more than the nodes it asks about. The samples
+      # favor the edges of what's still undecided, at exponentially growing
+      # distances, so even a long run of new history is bracketed in a
+      # handful of rounds - instead of one round per branch segment, as
+      # the old +branches+/+between+ walk needs.
+      #
+      # @example
+      #   common, heads = Discovery.new(repo.changelog, remote).run
+      class Discovery
+        include Amp::Mercurial::RevlogSupport::Node
+
+        # How many nodes are asked about in each round trip
+        SAMPLE_SIZE = 200
+
+        # How many round trips discovery took
+        attr_reader :round_trips
+
+        ##
+        # @param [ChangeLog] changelog our changelog
+        # @param [Repository] remote the repository to compare against. Must
+        #   answer +heads+ and +known+.
+        def initialize(changelog, remote)
+          @changelog, @remote = changelog, remote
+          @round_trips = 0
+          @common, @missing = {}, {}
+        end
+
+        ##
+        # Finds the heads of the history we share with the remote.
+        #
+        # @return [[Array<String>, Array<String>]] the heads of the common
+        #   history ([NULL_ID] if there's none), and the remote's heads
+        def run
+          undecided = Hash.with_keys((0...@changelog.size).to_a)
+          sample    = heads_of(undecided)
+          sample    = sample.sort_by { rand }.first(SAMPLE_SIZE) if sample.size > SAMPLE_SIZE
+
+          # the first round gets the remote's heads as well
+          remote_heads, known = @remote.batch [[:heads], [:known, nodes_for(sample)]]
+          @round_trips += 1
+          return [[NULL_ID], remote_heads] if remote_heads == [NULL_ID] # it's empty
+          remote_heads.each do |node|
+            rev = @changelog.node_map[node]
+            mark_common rev if rev && rev != NULL_REV
+          end
+
+          loop do
+            sample.zip(known).each do |rev, yes|
+              yes ? mark_common(rev) : mark_missing(rev)
+            end
+            undecided.delete_if {|rev, _| @common[rev] || @missing[rev] }
+            break if undecided.empty?
+
+            sample = take_sample undecided
+            known  = @remote.known nodes_for(sample)
+            @round_trips += 1
+          end
+
+          [common_heads, remote_heads]
+        end
+
+        private
+
+        ##
+        # Picks the nodes to ask about next: the heads and roots of what's
+        # undecided, and the nodes 1, 2, 4, 8... steps from them, topped up
+        # (or cut down) to SAMPLE_SIZE at random.
+        def take_sample(undecided)
+          sample = {}
+          [[heads_of(undecided), :parents_of], [roots_of(undecided), :children_of]].each do |edge, step|
+            edge.each {|rev| sample[rev] = true }
+            seen, frontier, distance, pick = Hash.with_keys(edge), edge, 1, 1
+            until frontier.empty?
+              frontier = frontier.map {|rev| send(step, rev) }.flatten.select do |rev|
+                undecided[rev] && !seen[rev] && (seen[rev] = true)
+              end
+              frontier.each {|rev| sample[rev] = true } if distance == pick
+              pick *= 2 if distance == pick
+              distance += 1
+            end
+          end
+
+          sample = sample.keys
+          if sample.size > SAMPLE_SIZE
+            sample.sort_by { rand }.first(SAMPLE_SIZE)
+          else
+            rest = undecided.keys - sample
+            sample + rest.sort_by { rand }.first(SAMPLE_SIZE - sample.size)
+          end
+        end
+
+        ##
+        # The remote has +rev+, so it has all of its ancestors.
+        def mark_common(rev)
+          to_visit = [rev]
+          while rev = to_visit.pop
+            next if rev == NULL_REV || @common[rev]
+            @common[rev] = true
+            to_visit.concat parents_of(rev)
+          end
+        end
+
+        ##
+        # The remote lacks +rev+, so it lacks all of its descendants.
+        def mark_missing(rev)
+          to_visit = [rev]
+          while rev = to_visit.pop
+            next if @missing[rev]
+            @missing[rev] = true
+            to_visit.concat children_of(rev)
+          end
+        end
+
+        ##
+        # The revisions in +revs+ with no children in +revs+.
+        def heads_of(revs)
+          parents = {}
+          revs.each_key {|rev| parents_of(rev).each {|p| parents[p] = true } }
+          revs.keys.reject {|rev| parents[rev] }.sort
+        end
+
+        ##
+        # The revisions in +revs+ with no parents in +revs+.
+        def roots_of(revs)
+          revs.keys.reject {|rev| parents_of(rev).any? {|p| revs[p] } }.sort
+        end
+
+        ##
+        # The heads of what we know we share, as nodes.
+        def common_heads
+          return [NULL_ID] if @common.empty?
+          heads_of(@common).map {|rev| @changelog.node_id_for_index rev }
+        end
+
+        def parents_of(rev)
+          @changelog.parent_indices_for_index(rev).reject {|p| p == NULL_REV }
+        end
+
+        ##
+        # Children aren't stored, so they're worked out for every revision
+        # the first time they're needed.
+        def children_of(rev)
+          unless @children
+            @children = Array.new(@changelog.size) { [] }
+            @changelog.size.times do |r|
+              parents_of(r).each {|p| @children[p] << r }
+            end
+          end
+          @children[rev]
+        end
+
+        def nodes_for(revs)
+          revs.map {|rev| @changelog.node_id_for_index rev }
+        end
+      end
+    end
+  end
+end
@@ -195,6 +195,19 @@ module Amp
         0
       end
       
+      ##
+      # Called by status with the files whose contents it had to check, and
+      # found clean. A staging area that can remember that (say, by their
+      # stat data) can call them clean next time without the check.
+      #
+      # Defaults to doing nothing.
+      #
+      # @api-optional
+      # @param [Array<String>] files the files found to be clean
+      # @param [AbstractChangeset] changeset the changeset they were checked against
+      def remember_clean(files, changeset)
+      end
+      
     end
   end
 end
\ No newline at end of file
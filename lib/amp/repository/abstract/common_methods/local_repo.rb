@@ -275,6 +275,7 @@ EOF
         begin
           lock_working do
             staging_area.normal *fixup  
+            staging_area.remember_clean fixup, node1
             fixup.each do |file|
               modified.delete file
             end
@@ -109,6 +109,20 @@ module Amp
         results
       end
       
+      ##
+      # Helper method that picks where to start looking for files matched by
+      # patterns. If the matcher knows its includes can only match under
+      # certain directories, there's no point walking the rest of the tree.
+      #
+      # @param [Amp::Match] match the matcher object
+      # @return [Array<String>] absolute paths of the directories to search
+      def walk_roots(match)
+        roots = match.respond_to?(:roots) ? match.roots : nil
+        return [repo.root] unless roots
+        
+        roots.map {|dir| File.join(repo.root, dir) }.select {|dir| File.directory? dir }
+      end
+      
       ##
       # Walk recursively through the directory tree, finding all
       # files matched by the regexp in match.
@@ -137,7 +151,7 @@ module Amp
         
         # Step 1: find all explicit files
         results, found_directories = examine_named_files files, match
-        work = [repo.root] + found_directories
+        work = walk_roots(match) + found_directories
         
         # Run the patterns
         results = find_with_patterns(results, work, match)
@@ -0,0 +1,114 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+require 'thread'
+
+module Amp
+  module Git
+
+    ##
+    # = CatFile
+    # A `git cat-file --batch` running alongside us, for the objects and
+    # names the ObjectStore can't handle on its own (objects borrowed from
+    # an alternate, or revisions like HEAD@{2} and HEAD:some/file). One
+    # process is started the first time it's needed, and every request after
+    # that goes down the same pipe - so asking for 5,000 files costs one
+    # fork, not 5,000.
+    class CatFile
+
+      ##
+      # @param [String] git_dir the path to the .git directory
+      def initialize(git_dir)
+        @git_dir = git_dir
+        @lock    = Mutex.new
+        @process = nil
+      end
+
+      ##
+      # Reads an object.
+      #
+      # @param [String] name anything git understands: a SHA1, a ref,
+      #   HEAD~3, HEAD:path/to/file, and so on
+      # @return [Array<Symbol, String, String>, nil] the object's type,
+      #   contents and hex SHA1, or nil if git can't find it
+      def read(name)
+        name = name.to_s
+        return nil if name.empty? || name.include?("\n")
+        @lock.synchronize do
+          begin
+            request name
+          rescue Errno::EPIPE, IOError
+            # git went away (or never started). Try a fresh one, once.
+            stop
+            request name rescue nil
+          end
+        end
+      end
+
+      ##
+      # Stops the git process. It'll be started again if it's needed.
+      def close
+        @lock.synchronize { stop }
+      end
+
+      private
+
+      ##
+      # The running git, started without a shell so nothing in the path to
+      # the repository can be taken for shell syntax.
+      def process
+        @process ||= begin
+          argv = ["git", "--git-dir=#{@git_dir}", "cat-file", "--batch"]
+          io = if ruby_19?
+                 # the environment has to be given, or popen takes argv for
+                 # it - we've taught Array#to_hash
+                 IO.popen({}, argv, "r+", :err => "/dev/null")
+               else
+                 # 1.8's popen only takes a command line
+                 IO.popen("-", "r+") || begin
+                   $stderr.reopen "/dev/null"
+                   exec(*argv)
+                 end
+               end
+          io.binmode
+          io
+        end
+      end
+
+      ##
+      # Asks for one object. git answers with "<sha> <type> <size>", then
+      # the contents and a newline - or "<name> missing".
+      def request(name)
+        io = process
+        io.write name + "\n"
+        io.flush
+        header = io.gets
+        raise IOError.new("git cat-file exited") if header.nil?
+
+        sha, type, size = header.split(" ")
+        return nil if size.nil? # missing, or ambiguous
+        data = io.read size.to_i
+        io.read 1
+        [type.to_sym, data, sha]
+      end
+
+      def stop
+        @process.close if @process && !@process.closed?
+      rescue Errno::EPIPE, IOError
+      ensure
+        @process = nil
+      end
+    end
+  end
+end
@@ -131,71 +131,52 @@ module Amp
       end
       
       ##
+      # Renders the changeset with a template.
       #
+      # @param [Hash] opts the options. :template picks the template, and if
+      #   :output is given, the changeset is rendered onto the end of it.
+      # @return [String] the rendered changeset (or :output, if given)
       def to_templated_s(opts={})
-        username    = user
-        files       = altered_files
-        type        = opts[:template_type] || 'log'
+        type = opts[:template_type] || 'log'
         
-        added   = opts[:added]   || []
-        removed = opts[:removed] || []
-        updated = opts[:updated] || []
-        config  = opts
+        locals = {:username => user,
+                  :files    => altered_files,
+                  :type     => type,
         
-        return "" if opts[:no_output]
+                  :added    => opts[:added]   || [],
+                  :removed  => opts[:removed] || [],
+                  :updated  => opts[:updated] || [],
+                  :config   => opts
+                 }
         
-        config = opts
+        return "" if opts[:no_output]
         
         template = opts[:template]
         template = "default-#{type}" if template.nil? || template.to_s == "default"
         
         template = Support::Template['git', template]
-        template.render({}, binding)
+        template.render_into(opts[:output] || "", locals, self)
       end
       
       private
       
-      # yeah, i know, you could combine these all into one for a clean sweep.
-      # but it's clearer this way
+      ##
+      # Reads the commit out of the object store.
       def parse!
         return if @parsed
         
-        # the parents
-        log_data = `git log -1 #{short_name}^ 2> /dev/null`
-        
-        # DETERMINING PARENTS
-        dad   = log_data[/^commit (.+)$/, 1]
-        dad   = dad ? dad[0..6] : nil
-        mom   = nil
-        
-        if log_data =~ /^Merge: (.+)\.\.\. (.+)\.\.\.$/ # Merge: 1c002dd... 35cfb2b...
-          dad = $1 # just have them both use the short name, nbd
-          mom = $2
-        end
+        commit = repo.object_store.commit short_name
+        raise Amp::Git::ObjectStore::MissingObjectError.new("unknown revision #{short_name}") unless commit
         
-        @parents = [dad, mom].compact.map {|r| Changeset.new repo, r }
+        @parents       = commit.parents.map {|sha| Changeset.new repo, sha[0..6] }
+        @date          = commit.time
+        @user          = commit.author
+        @description   = commit.description
+        @altered_files = repo.object_store.changed_files commit.sha
         
-        # the actual changeset
-        log_data = `git log -1 #{short_name}  2> /dev/null`
-        
-        # DETERMINING DATE
-        @date = Time.parse log_data[/^Date:\s+(.+)$/, 1]
-        
-        # DETERMINING USER
-        @user = log_data[/^Author:\s+(.+)$/, 1]
-        
-        # DETERMINING DESCRIPTION
-        @description = log_data.split("\n")[4..-1].map {|l| l.strip }.join "\n"
-        
-        # ALTERED FILES
-        @altered_files = `git log -1 #{short_name} --pretty=oneline --name-only  2> /dev/null`.split("\n")[1..-1]
-        
-        # ALL FILES
         # @all_files is also sorted. Hooray!
-        @all_files = `git ls-tree -r #{short_name}`.split("\n").map do |line|
-          # 100644 blob cdbeb2a42b714a4db49293c87fec4e180d07d44f    .autotest
-          line[/^\d+ \w+ \w+\s+(.+)$/, 1]
-        end
+        @all_files = []
+        repo.object_store.each_file(commit.tree) {|path, entry| @all_files << path }
         
         @parsed = true
       end
@@ -256,7 +237,7 @@ module Amp
       # 
       # @return [String] the user who made the changeset
       def branch
-        @branch ||= `git branch  2> /dev/null`[/\*\s(.+)$/, 1]
+        @branch ||= @repo.object_store.current_branch
       end
 
       ##
@@ -283,7 +264,7 @@ module Amp
       #
       # @return [Array<String>] the files tracked at the given revision
       def all_files
-        @all_files ||= `git ls-files  2> /dev/null`.split("\n")
+        @all_files ||= @repo.staging_area.index.paths
       end
       
       # Is this changeset a working changeset?
@@ -325,23 +306,7 @@ module Amp
       def parse!
         return if @parsed
         
-        log_data = `git log -1 HEAD  2> /dev/null`
-        
-        unless log_data.empty?
-          # DETERMINING PARENTS
-          commit = log_data[/^commit (.+)$/, 1]
-          dad    = commit ? commit[0..6] : nil
-          mom    = nil
-          
-          if log_data =~ /^Merge: (.+)\.\.\. (.+)\.\.\.$/ # Merge: 1c002dd... 35cfb2b...
-            dad = $1 # just have them both use the short name, nbd
-            mom = $2
-          end
-          
-          @parents = [dad, mom].compact.map {|p| Changeset.new @repo, p }
-        else
-          @parents = []
-        end
+        @parents = @repo.parents.compact.map {|p| Changeset.new @repo, p }
         @parsed = true
       end
       
@@ -0,0 +1,177 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+module Amp
+  module Git
+
+    ##
+    # = Index
+    # Git's index (.git/index): every file staged for the next commit, with
+    # its SHA1 and the stat data it had when it was staged. Comparing that
+    # stat data against the working directory is how we can tell which files
+    # might have changed without reading them - the same job the dirstate
+    # does for Mercurial.
+    #
+    # Versions 2, 3 and 4 are supported. Version 3 adds extended flags, and
+    # version 4 compresses each path against the one before it.
+    class Index
+      class CorruptIndexError < StandardError; end
+
+      ##
+      # One staged file. Times are in seconds, and sha is binary.
+      class Entry < Struct.new(:path, :ctime, :mtime, :dev, :ino, :mode, :uid, :gid, :size, :sha, :stage, :flags)
+        # Is the entry marked assume-unchanged?
+        def assume_valid?
+          flags & 0x8000 != 0
+        end
+
+        def executable?
+          mode & 0100 != 0
+        end
+
+        def symlink?
+          mode & 0170000 == 0120000
+        end
+      end
+
+      SIGNATURE = "DIRC"
+      # ctime, mtime (seconds and nanoseconds each), dev, ino, mode, uid, gid,
+      # size, SHA1, flags
+      ENTRY_FORMAT = "N10a20n"
+      ENTRY_HEADER_SIZE = 62
+
+      attr_reader :version, :mtime
+
+      ##
+      # Reads the index at the given path. A missing index is an empty one.
+      #
+      # @param [String] path the path to .git/index
+      def initialize(path)
+        @path      = path
+        @entries   = {}
+        @conflicts = {}
+        @version   = 2
+        @mtime     = 0
+        read if File.exist? path
+      end
+
+      ##
+      # The entry for a path. For a path with conflicts, this is whichever
+      # stage came last.
+      #
+      # @param [String] path the file's path, relative to the root
+      # @return [Entry, nil] the entry, or nil if the path isn't staged
+      def [](path)
+        @entries[path]
+      end
+
+      ##
+      # Is the path in the index?
+      def include?(path)
+        @entries.has_key? path
+      end
+
+      ##
+      # Is the path in the middle of a merge conflict?
+      def conflicted?(path)
+        @conflicts.has_key? path
+      end
+
+      ##
+      # Every path in the index, sorted.
+      #
+      # @return [Array<String>] the paths
+      def paths
+        @entries.keys.sort
+      end
+
+      def each(&block)
+        @entries.each_value(&block)
+      end
+
+      def size
+        @entries.size
+      end
+
+      ##
+      # Could the file have changed since it was staged, without its stat data
+      # showing it? If the file was modified in the same second the index was
+      # written, its mtime won't have moved, so we can't trust it.
+      #
+      # @param [Entry] entry the entry to check
+      # @return [Boolean] do we need to look at the file's contents?
+      def racy?(entry)
+        entry.mtime >= @mtime
+      end
+
+      private
+
+      def read
+        data = File.open(@path, "rb") {|f| f.read }
+        @mtime = File.mtime(@path).to_i
+
+        signature, @version, count = data.unpack("a4NN")
+        raise CorruptIndexError.new("#{@path} isn't an index") unless signature == SIGNATURE
+        unless (2..4).include? @version
+          raise CorruptIndexError.new("#{@path} is index version #{@version}, which we can't read")
+        end
+
+        pos  = 12
+        path = ""
+        count.times do
+          start = pos
+          ctime, _ctime_ns, mtime, _mtime_ns, dev, ino, mode, uid, gid, size, sha, flags =
+            data[pos, ENTRY_HEADER_SIZE].unpack(ENTRY_FORMAT)
+          pos += ENTRY_HEADER_SIZE
+          # version 3+ entries with the extended bit set have 2 more bytes of flags
+          pos += 2 if @version >= 3 && flags & 0x4000 != 0
+
+          if @version == 4
+            # the path is the last one, minus some bytes off the end, plus
+            # the new bit
+            strip, pos = read_offset(data, pos)
+            null = data.index("\0", pos)
+            path = path[0, path.size - strip] + data[pos...null]
+            pos  = null + 1
+          else
+            null = data.index("\0", pos)
+            path = data[pos...null]
+            # entries are padded with 1-8 NULs out to a multiple of 8 bytes
+            pos  = start + ((null - start + 8) & ~7)
+          end
+
+          stage = (flags >> 12) & 3
+          entry = Entry.new(path, ctime, mtime, dev, ino, mode, uid, gid, size, sha, stage, flags)
+          @conflicts[path] = true if stage > 0
+          @entries[path] = entry
+        end
+      end
+
+      ##
+      # Reads one of the variable-length integers version 4 uses for how much
+      # of the last path to drop.
+      def read_offset(data, pos)
+        byte  = data.getbyte(pos)
+        value = byte & 0x7f
+        pos  += 1
+        while byte & 0x80 != 0
+          byte  = data.getbyte(pos)
+          value = ((value + 1) << 7) | (byte & 0x7f)
+          pos  += 1
+        end
+        [value, pos]
+      end
+    end
+  end
+end
@@ -0,0 +1,457 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+require 'zlib'
+
+module Amp
+  module Git
+
+    ##
+    # = ObjectStore
+    # Reads commits, trees and blobs straight out of a repository's .git
+    # directory - loose objects and packs both - so we don't have to run
+    # `git` (and fork) every time we want to look at one.
+    #
+    # Object names are the usual: full or abbreviated SHA1s, HEAD, branch
+    # and tag names, with any number of ^, ^N and ~N on the end. Names we
+    # can't parse (HEAD@{1}, HEAD:README), names in a repository that
+    # borrows objects from another, and any object that isn't in this
+    # repository's own .git are handed to a CatFile.
+    class ObjectStore
+      class MissingObjectError < StandardError; end
+      class CorruptObjectError < StandardError; end
+
+      ##
+      # A commit, parsed.
+      class Commit < Struct.new(:sha, :tree, :parents, :author, :time, :committer, :message)
+        ##
+        # The message, the way `git log` shows it (minus the indentation).
+        def description
+          message.chomp.split("\n").map {|line| line.strip }.join("\n")
+        end
+      end
+
+      ##
+      # One entry in a tree: a file, a subdirectory, or a submodule.
+      class TreeEntry < Struct.new(:mode, :name, :sha)
+        def tree?
+          mode == "40000"
+        end
+      end
+
+      # How many bytes' worth of delta bases to keep around
+      DELTA_BASE_CACHE_SIZE = 16.mb
+
+      attr_reader :git_dir, :delta_base_cache
+
+      ##
+      # @param [String] git_dir the path to the .git directory
+      def initialize(git_dir)
+        @git_dir = git_dir
+        @objects_dir = File.join(git_dir, "objects")
+        @delta_base_cache = DeltaBaseCache.new DELTA_BASE_CACHE_SIZE
+      end
+
+      ##
+      # Reads an object.
+      #
+      # @param [String] sha the object's hex SHA1
+      # @return [Array<Symbol, String>, nil] the object's type (:commit, :tree,
+      #   :blob or :tag) and contents, or nil if we don't have it
+      def read(sha)
+        binary = [sha].pack("H*")
+        packs.each do |pack|
+          object = pack.read binary
+          return object if object
+        end
+        object = read_loose(sha) || cat_file.read(sha)
+        object && object[0, 2]
+      end
+
+      ##
+      # Do we have the given object?
+      #
+      # @param [String] sha the object's hex SHA1
+      def include?(sha)
+        binary = [sha].pack("H*")
+        packs.any? {|pack| pack.include? binary } || File.exist?(loose_path(sha))
+      end
+
+      ##
+      # Figures out which object a name refers to.
+      #
+      # @param [String] name a SHA1 (possibly abbreviated), a ref, or either of
+      #   those followed by ^, ^N or ~N
+      # @return [String, nil] the object's hex SHA1, or nil if the name doesn't
+      #   refer to anything (or is ambiguous)
+      def resolve(name)
+        name = name.to_s
+        if name =~ /\A(.+?)((?:[\^~]\d*)+)\z/
+          base, suffix = $1, $2
+          sha = resolve base
+          suffix.scan(/([\^~])(\d*)/) do |op, count|
+            break if sha.nil?
+            if op == "^"
+              nth = count.empty? ? 1 : count.to_i
+              next if nth == 0
+              commit = commit(sha)
+              sha = commit && commit.parents[nth - 1]
+            else
+              (count.empty? ? 1 : count.to_i).times do
+                commit = commit(sha)
+                sha = commit && commit.parents.first
+                break unless sha
+              end
+            end
+          end
+          return sha
+        end
+
+        return name.downcase if name =~ /\A[0-9a-fA-F]{40}\z/ && include?(name)
+        ref = resolve_ref(name)
+        return ref if ref
+        sha = find_abbreviated(name) if name =~ /\A[0-9a-fA-F]{4,39}\z/
+        return sha if sha
+        # if we understood the name, it's just not there - no need for git
+        return nil unless name =~ /@\{|:/ || alternates?
+        object = cat_file.read(name)
+        object && object[2]
+      end
+
+      ##
+      # Looks up a commit, peeling tags if need be.
+      #
+      # @param [String] name any name {#resolve} understands
+      # @return [Commit, nil] the commit, or nil if there isn't one by that name
+      def commit(name)
+        sha = resolve name
+        return nil unless sha
+        type, data = read sha
+        while type == :tag
+          sha = data[/\Aobject ([0-9a-f]{40})$/, 1]
+          type, data = read sha
+        end
+        type == :commit ? parse_commit(sha, data) : nil
+      end
+
+      ##
+      # The entries of a tree.
+      #
+      # @param [String] sha the tree's hex SHA1
+      # @return [Array<TreeEntry>] the entries, in git's order
+      def tree(sha)
+        type, data = read sha
+        raise MissingObjectError.new(sha) unless type == :tree
+        entries = []
+        pos = 0
+        while pos < data.size
+          space = data.index(" ", pos)
+          null  = data.index("\0", space)
+          entries << TreeEntry.new(data[pos...space], data[space + 1...null],
+                                   data[null + 1, 20].unpack("H*").first)
+          pos = null + 21
+        end
+        entries
+      end
+
+      ##
+      # Walks every file (and submodule) in a tree and its subtrees, in the
+      # order `git ls-tree -r` lists them.
+      #
+      # @param [String] sha the tree's hex SHA1
+      # @yield [path, entry] each file's path and tree entry
+      def each_file(sha, prefix = "", &block)
+        tree(sha).each do |entry|
+          path = prefix + entry.name
+          if entry.tree?
+            each_file entry.sha, path + "/", &block
+          else
+            yield path, entry
+          end
+        end
+      end
+
+      ##
+      # Every file in a commit.
+      #
+      # @param [String] name the commit
+      # @return [Array<String>] the paths of the commit's files
+      def files_at(name)
+        commit = commit(name)
+        return [] unless commit
+        files = []
+        each_file(commit.tree) {|path, entry| files << path }
+        files
+      end
+
+      ##
+      # The files a commit changed, added or deleted, compared to its first
+      # parent. Like `git log`, we don't list anything for merges.
+      #
+      # @param [String] name the commit
+      # @return [Array<String>] the changed paths, sorted
+      def changed_files(name)
+        commit = commit(name)
+        return [] if commit.nil? || commit.parents.size > 1
+        parent = commit.parents.first && commit(commit.parents.first)
+        diff_trees(parent && parent.tree, commit.tree).sort
+      end
+
+      ##
+      # Reads a file as of a commit.
+      #
+      # @param [String] name the commit
+      # @param [String] path the path of the file
+      # @return [String, nil] the file's contents, or nil if it isn't there
+      def blob_at(name, path)
+        commit = commit(name)
+        return nil unless commit
+        sha = commit.tree
+        parts = path.split("/")
+        parts.each_with_index do |part, i|
+          entry = tree(sha).find {|e| e.name == part }
+          return nil unless entry && (entry.tree? || i == parts.size - 1)
+          sha = entry.sha
+        end
+        type, data = read sha
+        type == :blob ? data : nil
+      end
+
+      ##
+      # The commits reachable from +name+, newest first by commit time - the
+      # order `git log` uses.
+      #
+      # @param [String] name where to start
+      # @return [Array<String>] the hex SHA1s of the commits
+      def rev_list(name = "HEAD")
+        start = commit(name)
+        return [] unless start
+        seen    = {start.sha => true}
+        pending = [start]
+        result  = []
+        until pending.empty?
+          # the pending list is short (one per branch being walked), so
+          # finding the newest is cheap
+          newest = pending.max {|a, b| a.time <=> b.time }
+          pending.delete newest
+          result << newest.sha
+          newest.parents.each do |parent|
+            next if seen[parent]
+            seen[parent] = true
+            parent = commit(parent)
+            pending << parent if parent # not there in a shallow clone
+          end
+        end
+        result
+      end
+
+      ##
+      # The branch HEAD points to.
+      #
+      # @return [String, nil] the branch name, or nil if HEAD is detached
+      def current_branch
+        head = File.read(File.join(@git_dir, "HEAD")) rescue ""
+        head[/\Aref: refs\/heads\/(.+)$/, 1]
+      end
+
+      ##
+      # Closes any open packs, and forgets them - so new packs will be found
+      # next time. Stops the CatFile too, if we started one.
+      def close
+        @packs.each {|pack| pack.close } if @packs
+        @packs = nil
+        @cat_file.close if @cat_file
+      end
+
+      private
+
+      def cat_file
+        @cat_file ||= CatFile.new @git_dir
+      end
+
+      ##
+      # Does this repository borrow objects from another one? Then a name
+      # we can't find here might still be found over there.
+      def alternates?
+        File.exist? File.join(@objects_dir, "info", "alternates")
+      end
+
+      def packs
+        @packs ||= Dir[File.join(@objects_dir, "pack", "*.idx")].sort.map do |idx|
+          PackFile.new idx, self
+        end
+      end
+
+      def loose_path(sha)
+        File.join(@objects_dir, sha[0, 2], sha[2..-1])
+      end
+
+      ##
+      # Reads a loose object: the zlib-compressed header ("blob 123\0") and
+      # contents.
+      def read_loose(sha)
+        path = loose_path sha
+        return nil unless File.exist? path
+        raw  = Zlib::Inflate.inflate(File.open(path, "rb") {|f| f.read })
+        null = raw.index("\0")
+        type, size = raw[0, null].split(" ")
+        data = raw[null + 1..-1]
+        raise CorruptObjectError.new("#{sha} should be #{size} bytes") unless data.size == size.to_i
+        [type.to_sym, data]
+      end
+
+      def parse_commit(sha, data)
+        header, message = data.split("\n\n", 2)
+        commit = Commit.new(sha, nil, [], nil, nil, nil, message || "")
+        header.split("\n").each do |line|
+          key, value = line.split(" ", 2)
+          case key
+          when "tree"      then commit.tree = value
+          when "parent"    then commit.parents << value
+          when "committer" then commit.committer = value[/\A(.*) \d+ [-+]\d{4}\z/, 1]
+          when "author"
+            commit.author = value[/\A(.*) \d+ [-+]\d{4}\z/, 1]
+            commit.time   = Time.at(value[/ (\d+) [-+]\d{4}\z/, 1].to_i)
+          end
+        end
+        commit
+      end
+
+      ##
+      # Finds a ref, the way git does: as given, then under refs/, refs/tags/,
+      # refs/heads/ and refs/remotes/. Symbolic refs (like HEAD) are followed.
+      def resolve_ref(name)
+        candidates = [name, "refs/#{name}", "refs/tags/#{name}", "refs/heads/#{name}",
+                      "refs/remotes/#{name}", "refs/remotes/#{name}/HEAD"]
+        candidates.each do |ref|
+          sha = read_ref ref
+          return sha if sha
+        end
+        nil
+      end
+
+      def read_ref(ref, depth = 0)
+        return nil if depth > 5 || ref.include?("..")
+        path = File.join(@git_dir, ref)
+        if File.file? path
+          value = File.read(path).strip
+          return read_ref(value[5..-1], depth + 1) if value[0, 5] == "ref: "
+          return value if value =~ /\A[0-9a-f]{40}\z/
+        end
+        packed_refs[ref]
+      end
+
+      def packed_refs
+        @packed_refs ||= begin
+          refs = {}
+          path = File.join(@git_dir, "packed-refs")
+          if File.exist? path
+            File.read(path).split("\n").each do |line|
+              sha, ref = line.split(" ", 2)
+              refs[ref] = sha if sha =~ /\A[0-9a-f]{40}\z/
+            end
+          end
+          refs
+        end
+      end
+
+      def find_abbreviated(prefix)
+        prefix = prefix.downcase
+        matches = packs.map {|pack| pack.shas_with_prefix prefix }.flatten
+        dir = File.join(@objects_dir, prefix[0, 2])
+        if File.directory? dir
+          rest = prefix[2..-1]
+          Dir.entries(dir).each do |file|
+            matches << prefix[0, 2] + file if file[0, rest.size] == rest && file.size == 38
+          end
+        end
+        matches.uniq!
+        matches.size == 1 ? matches.first : nil
+      end
+
+      ##
+      # Lists the paths that differ between two trees, descending into any
+      # subtrees that differ.
+      def diff_trees(old_sha, new_sha, prefix = "")
+        old_entries = old_sha ? tree(old_sha) : []
+        new_entries = new_sha ? tree(new_sha) : []
+        old_by_name = {}
+        old_entries.each {|e| old_by_name[e.name] = e }
+        changed = []
+        new_entries.each do |entry|
+          old = old_by_name.delete entry.name
+          next if old && old.sha == entry.sha && old.mode == entry.mode
+          changed.concat entry_paths(old, entry, prefix)
+        end
+        old_by_name.each_value {|old| changed.concat entry_paths(old, nil, prefix) }
+        changed
+      end
+
+      def entry_paths(old, new, prefix)
+        path = prefix + (new || old).name
+        old_tree = old && old.tree? ? old.sha : nil
+        new_tree = new && new.tree? ? new.sha : nil
+        paths = []
+        paths << path if (old && !old.tree?) || (new && !new.tree?)
+        paths.concat diff_trees(old_tree, new_tree, path + "/") if old_tree || new_tree
+        paths
+      end
+
+      ##
+      # = DeltaBaseCache
+      # Keeps the objects that deltas were made against, since the same base
+      # tends to get used over and over again. When it's full, the ones used
+      # least recently are thrown out.
+      class DeltaBaseCache
+        ##
+        # @param [Integer] capacity how many bytes of objects to keep
+        def initialize(capacity)
+          @capacity = capacity
+          @entries  = {}
+          @bytes    = 0
+          @clock    = 0
+        end
+
+        def [](key)
+          entry = @entries[key]
+          return nil unless entry
+          entry[1] = (@clock += 1)
+          entry[0]
+        end
+
+        def []=(key, object)
+          return if object[1].size > @capacity
+          old = @entries[key]
+          @bytes -= old[0][1].size if old
+          @entries[key] = [object, (@clock += 1)]
+          @bytes += object[1].size
+          evict if @bytes > @capacity
+        end
+
+        private
+
+        ##
+        # Throws out the least recently used objects until we're down to
+        # three quarters full, so we aren't doing this on every insert.
+        def evict
+          @entries.sort_by {|key, entry| entry[1] }.each do |key, entry|
+            break if @bytes <= @capacity * 3 / 4
+            @entries.delete key
+            @bytes -= entry[0][1].size
+          end
+        end
+      end
+    end
+  end
+end
@@ -0,0 +1,326 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+require 'zlib'
+
+module Amp
+  module Git
+
+    ##
+    # = PackFile
+    # Reads objects out of one of git's packs: a .pack file full of
+    # compressed objects (many of them stored as deltas against others), and
+    # the .idx file that says where in the pack each object is.
+    #
+    # The index is read into memory once, and objects are found with its
+    # fanout table and a binary search, the same way git does it. Objects
+    # are read out of the pack as they're needed.
+    class PackFile
+      # The object types, as numbered in the pack
+      TYPES = [nil, :commit, :tree, :blob, :tag, nil, :ofs_delta, :ref_delta]
+      # The magic number at the start of a version 2+ index
+      IDX_SIGNATURE = [0xff744f63].pack("N") # "\377tOc"
+      # How much to read at a time while inflating an object
+      READ_SIZE = 8192
+
+      attr_reader :path
+
+      ##
+      # @param [String] idx_path the path to the pack's .idx file
+      # @param [ObjectStore] store the object store the pack belongs to. It
+      #   finds the bases of REF_DELTAs, which needn't be in this pack, and
+      #   caches the bases of deltas.
+      def initialize(idx_path, store)
+        @path  = idx_path.sub(/\.idx$/, ".pack")
+        @store = store
+        load_index idx_path
+      end
+
+      ##
+      # How many objects are in the pack?
+      def size
+        @fanout[255]
+      end
+
+      ##
+      # Finds where an object is stored in the pack.
+      #
+      # @param [String] sha the object's binary SHA1
+      # @return [Integer, nil] the object's offset in the pack, or nil if it
+      #   isn't in this pack
+      def offset_for(sha)
+        first = sha.getbyte(0)
+        low   = first == 0 ? 0 : @fanout[first - 1]
+        high  = @fanout[first] - 1
+        while low <= high
+          mid = (low + high) / 2
+          case sha_at(mid) <=> sha
+          when -1 then low  = mid + 1
+          when  1 then high = mid - 1
+          else return offset_at(mid)
+          end
+        end
+        nil
+      end
+
+      ##
+      # Does the pack have the given object?
+      #
+      # @param [String] sha the object's binary SHA1
+      # @return [Boolean] is it in this pack?
+      def include?(sha)
+        !offset_for(sha).nil?
+      end
+
+      ##
+      # Finds every object whose hex SHA1 starts with the given prefix.
+      #
+      # @param [String] prefix the start of a hex SHA1 (at least two digits)
+      # @return [Array<String>] the hex SHA1s of the matching objects
+      def shas_with_prefix(prefix)
+        prefix = prefix.downcase
+        first  = prefix[0, 2].to_i(16)
+        low    = first == 0 ? 0 : @fanout[first - 1]
+        (low...@fanout[first]).map {|i| sha_at(i).unpack("H*").first }.
+                               select {|hex| hex[0, prefix.size] == prefix }
+      end
+
+      ##
+      # Reads an object out of the pack, undoing any deltas.
+      #
+      # @param [String] sha the object's binary SHA1
+      # @return [Array<Symbol, String>, nil] the object's type and contents,
+      #   or nil if it isn't in this pack
+      def read(sha)
+        offset = offset_for sha
+        offset && read_at(offset)
+      end
+
+      ##
+      # Reads the object at the given offset in the pack. Delta chains are
+      # followed down until we hit a plain object (or a base we've already
+      # got cached), and then the deltas are applied on the way back up.
+      #
+      # @param [Integer] offset where the object starts
+      # @return [Array<Symbol, String>] the object's type and contents
+      def read_at(offset)
+        chain = []
+        base  = nil
+        loop do
+          if cached = @store.delta_base_cache[[@path, offset]]
+            base = cached
+            break
+          end
+          type, data, base_ref = read_entry offset
+          if type == :ofs_delta || type == :ref_delta
+            chain << [offset, data]
+            if type == :ofs_delta
+              offset = base_ref
+            else
+              base = @store.read(base_ref.unpack("H*").first)
+              raise ObjectStore::MissingObjectError.new(base_ref.unpack("H*").first) unless base
+              break
+            end
+          else
+            base = [type, data]
+            break
+          end
+        end
+
+        type, data = base
+        chain.reverse_each do |delta_offset, delta|
+          @store.delta_base_cache[[@path, offset]] = [type, data]
+          offset, data = delta_offset, PackFile.apply_delta(data, delta)
+        end
+        [type, data]
+      end
+
+      ##
+      # Closes the pack.
+      def close
+        @pack.close if @pack && !@pack.closed?
+        @pack = nil
+      end
+
+      ##
+      # Builds an object out of its base and a delta against it. A delta is
+      # the sizes of the base and the result, then a list of instructions:
+      # either copy a piece of the base, or insert some new data.
+      #
+      # @param [String] base the object the delta was made against
+      # @param [String] delta the delta
+      # @return [String] the new object
+      def self.apply_delta(base, delta)
+        base_size, pos   = read_size(delta, 0)
+        result_size, pos = read_size(delta, pos)
+        if base_size != base.size
+          raise ObjectStore::CorruptObjectError.new("delta base is #{base.size} bytes, expected #{base_size}")
+        end
+
+        result = ""
+        while pos < delta.size
+          op = delta.getbyte(pos)
+          pos += 1
+          if op & 0x80 != 0
+            # copy: the low 4 bits say which bytes of the offset follow, the
+            # next 3 which bytes of the length
+            copy_offset = copy_length = 0
+            4.times do |i|
+              next if op & (1 << i) == 0
+              copy_offset |= delta.getbyte(pos) << (8 * i)
+              pos += 1
+            end
+            3.times do |i|
+              next if op & (0x10 << i) == 0
+              copy_length |= delta.getbyte(pos) << (8 * i)
+              pos += 1
+            end
+            copy_length = 0x10000 if copy_length == 0
+            result << base[copy_offset, copy_length]
+          elsif op != 0
+            # insert the next +op+ bytes of the delta
+            result << delta[pos, op]
+            pos += op
+          else
+            raise ObjectStore::CorruptObjectError.new("bad delta opcode")
+          end
+        end
+
+        if result.size != result_size
+          raise ObjectStore::CorruptObjectError.new("delta made #{result.size} bytes, expected #{result_size}")
+        end
+        result
+      end
+
+      ##
+      # Reads one of the little-endian, 7-bits-a-byte sizes at the start of
+      # a delta.
+      #
+      # @return [Array<Integer>] the size, and where the next thing starts
+      def self.read_size(data, pos)
+        size = shift = 0
+        begin
+          byte = data.getbyte(pos)
+          size |= (byte & 0x7f) << shift
+          shift += 7
+          pos += 1
+        end while byte & 0x80 != 0
+        [size, pos]
+      end
+
+      private
+
+      ##
+      # Reads the .idx file. Version 1 is a fanout table, then an offset and
+      # SHA1 per object. Version 2 has a header, the fanout table, then all
+      # the SHA1s, all the CRCs, all the offsets, and then 8-byte offsets for
+      # any objects past the 2GB mark.
+      def load_index(idx_path)
+        @index = File.open(idx_path, "rb") {|f| f.read }
+        if @index[0, 4] == IDX_SIGNATURE
+          version = @index[4, 4].unpack("N").first
+          raise ObjectStore::CorruptObjectError.new("unknown pack index version #{version}") unless version == 2
+          @fanout       = @index[8, 1024].unpack("N256")
+          @sha_base     = 8 + 1024
+          @offset_base  = @sha_base + size * 24 # past the SHA1s and CRCs
+          @large_base   = @offset_base + size * 4
+          @version      = 2
+        else
+          @fanout  = @index[0, 1024].unpack("N256")
+          @version = 1
+        end
+      end
+
+      def sha_at(i)
+        @version == 2 ? @index[@sha_base + i * 20, 20] : @index[1024 + i * 24 + 4, 20]
+      end
+
+      def offset_at(i)
+        return @index[1024 + i * 24, 4].unpack("N").first if @version == 1
+
+        offset = @index[@offset_base + i * 4, 4].unpack("N").first
+        return offset if offset & 0x80000000 == 0
+        high, low = @index[@large_base + (offset & 0x7fffffff) * 8, 8].unpack("NN")
+        (high << 32) | low
+      end
+
+      def pack
+        @pack ||= File.open(@path, "rb")
+      end
+
+      ##
+      # Reads the entry at +offset+ without resolving deltas.
+      #
+      # @return [Array] the type, the inflated data, and for deltas, where to
+      #   find the base: its offset for an OFS_DELTA, its SHA1 for a REF_DELTA.
+      def read_entry(offset)
+        pack.seek offset
+        header = pack.read(32)
+
+        # the type and size: 3 bits of type and 4 of size, then 7 bits of
+        # size per byte for as long as the high bit is set
+        byte = header.getbyte(0)
+        type = TYPES[(byte >> 4) & 7]
+        size = byte & 0x0f
+        shift, pos = 4, 1
+        while byte & 0x80 != 0
+          byte = header.getbyte(pos)
+          size |= (byte & 0x7f) << shift
+          shift += 7
+          pos += 1
+        end
+
+        base_ref = nil
+        case type
+        when :ofs_delta
+          # the distance back to the base, big-endian, with a +1 folded into
+          # each continuation byte
+          byte = header.getbyte(pos)
+          distance = byte & 0x7f
+          pos += 1
+          while byte & 0x80 != 0
+            byte = header.getbyte(pos)
+            distance = ((distance + 1) << 7) | (byte & 0x7f)
+            pos += 1
+          end
+          base_ref = offset - distance
+        when :ref_delta
+          base_ref = header[pos, 20]
+          pos += 20
+        when nil
+          raise ObjectStore::CorruptObjectError.new("bad object type at #{@path}:#{offset}")
+        end
+
+        [type, inflate(offset + pos, size), base_ref]
+      end
+
+      ##
+      # Inflates the compressed data starting at +offset+. We don't know how
+      # long it is, so we keep feeding the inflater until it's done.
+      def inflate(offset, size)
+        pack.seek offset
+        inflater = Zlib::Inflate.new
+        data = ""
+        until inflater.finished?
+          chunk = pack.read([size + 64, READ_SIZE].min)
+          raise ObjectStore::CorruptObjectError.new("truncated pack #{@path}") if chunk.nil?
+          data << inflater.inflate(chunk)
+        end
+        data
+      ensure
+        inflater.close if inflater
+      end
+    end
+  end
+end
@@ -39,7 +39,7 @@ module Amp
         # @api
         # @return [String] relative to root
         def vcs_dir
-          '.hg'
+          '.git'
         end
 
         ##
@@ -124,39 +124,41 @@ module Amp
         alias_method :unstage, :exclude
 
         ##
-        # Returns a Symbol.
+        # Returns a Symbol: :normal, :added, :removed, :merged (for files in
+        # the middle of a conflict), or :untracked. Modified files are
+        # :normal - {#file_precise_status} sorts them out.
         # 
         # If you call localrepo#status from this method... well...
         # I DARE YOU!
         def file_status(filename)
-          parse!
-          inverted = @status.inject({}) do |h, (k, v)|
-            v.each {|v_| h[v_] = k }
-            h
-          end
-          
-          # lame hack, i know
-          case val = inverted[filename]
-          when :modified
-            :normal
+          if index.include? filename
+            return :merged if index.conflicted? filename
+            head_files[filename] ? :normal : :added
           else
-            val
+            head_files[filename] ? :removed : :untracked
           end
         end
         
-        # modified, lookup, or clean
-        # in this case, since we're shelling out,
-        # only modified or clean
+        ##
+        # Compares a file's stat data with what the index has for it, the way
+        # git does: a different size or mode means it's modified, and any other
+        # difference (or a racy timestamp) means we have to hash the contents
+        # to find out. A file that's had changes staged is modified outright.
+        #
+        # @param [String] filename the file to look up
+        # @param [File::Stat] st the file's current stat data
+        # @return [Symbol] :modified or :clean
         def file_precise_status(filename, st)
-          parse!
-          inverted = @status.inject({}) do |h, (k, v)|
-            v.each {|v_| h[v_] = k }
-            h
-          end
+          entry = index[filename]
+          return :modified if entry.sha != head_files[filename]
+          return :clean    if entry.assume_valid?
           
-          # bleh this code sucks
-          if inverted[filename] == :modified
+          if entry.size != (st.size & 0xffffffff) || entry.symlink? != st.symlink? ||
+             entry.executable? != (st.mode & 0100 != 0)
             :modified
+          elsif entry.mtime != st.mtime.to_i || entry.ctime != st.ctime.to_i ||
+                entry.ino != (st.ino & 0xffffffff) || index.racy?(entry)
+            blob_sha(filename, st) == entry.sha ? :clean : :modified
           else
             :clean
           end
@@ -173,39 +175,89 @@ module Amp
         # @return [Fixnum] the number of bytes difference between the file and
         #  its last tracked state.
         def calculate_delta(file, st)
-          0
+          entry = index[file]
+          entry && st ? (entry.size - st.size).abs : 0
         end
         
-        def parse!
-          return if @parsed
-          
-          @status = {}
-          data    = `git status 2> /dev/null`.split("\n")
-          data.inject @status do |h, line|
-            case line
-            when /^#\s+(\w+):\s(.+)$/
-              h[$1.to_sym] = $2.strip
-            when /^#\s+new file:\s(.+)$/
-              h[:added] = $1.strip
-            when /^#\s+([^ ]+)$/
-              h[:untracked] = $1.strip
-            else
-              h
-            end
-          end
-          
-          @parsed = true
-        end
-
         ##
         # Returns all files tracked by the repository *for the working directory* - not
-        # to be confused with the most recent changeset.
+        # to be confused with the most recent changeset. Files that have been
+        # removed (but not committed) are included, so status can report them.
         #
         # @api
         # @return [Array<String>] all files tracked by the repository at this moment in
         #   time, including just-added files (for example) that haven't been committed yet.
         def all_files
-          Amp::Git::WorkingDirectoryChangeset.new(@repo).all_files
+          (index.paths + head_files.keys).uniq
+        end
+        
+        ##
+        # Is the directory ignored by a .gitignore?
+        #
+        # @api-optional
+        # @param [String] directory the directory to check against ignoring rules
+        # @return [Boolean] are we ignoring this directory?
+        def ignoring_directory?(directory)
+          return true  if @ignore_all
+          return false if @ignore_all == false
+          ignore.ignored? directory, true
+        end
+        
+        ##
+        # Is the file ignored by a .gitignore? Files that are already tracked
+        # never are.
+        #
+        # @api-optional
+        # @param [String] file the file to check against ignoring rules
+        # @return [Boolean] are we ignoring this file?
+        def ignoring_file?(file)
+          return true  if @ignore_all
+          return false if @ignore_all == false
+          return false if index.include? file
+          ignore.ignored? file
+        end
+        
+        ##
+        # The index, read straight from .git/index. It's read again whenever
+        # git changes it.
+        #
+        # @return [Amp::Git::Index] the index
+        def index
+          path  = File.join(repo.root, ".git", "index")
+          mtime = File.exist?(path) ? File.mtime(path) : nil
+          if @index.nil? || mtime != @index_mtime
+            @index, @index_mtime, @head_files = Amp::Git::Index.new(path), mtime, nil
+          end
+          @index
+        end
+        
+        private
+        
+        ##
+        # The files in HEAD, mapped to their binary SHA1s. Staged files whose
+        # SHA1 doesn't match are modified.
+        def head_files
+          @head_files ||= begin
+            files = {}
+            head  = repo.object_store.commit "HEAD"
+            if head
+              repo.object_store.each_file(head.tree) {|path, entry| files[path] = [entry.sha].pack("H*") }
+            end
+            files
+          end
+        end
+        
+        ##
+        # The binary SHA1 git would give the file if it were staged now. For
+        # a symlink, that's the SHA1 of where it points.
+        def blob_sha(filename, st)
+          path = File.join(repo.root, filename)
+          data = st.symlink? ? File.readlink(path) : File.open(path, "rb") {|f| f.read }
+          Digest::SHA1.digest("blob #{data.bytesize}\0" + data)
+        end
+        
+        def ignore
+          @ignore ||= Amp::Git::Ignore.new repo.root
         end
       end
     end
@@ -52,7 +52,7 @@ module Amp
       # 
       # @return [String] the data at the current revision
       def data
-        @data ||= `git show #{revision}:#{path} 2> /dev/null`
+        @data ||= repo.object_store.blob_at(revision, path) || ""
       end
       
       ##
@@ -60,6 +60,16 @@ module Amp
           "master"
         end
         
+        ##
+        # Joins the path from this repo's metadata directory (.git) to the
+        # file provided.
+        #
+        # @param file the file we need the path for
+        # @return [String] the path to the file inside .git
+        def join(file)
+          File.join(@root, ".git", file)
+        end
+        
         def commit(opts={})
           add_all_files
           string = "git commit #{opts[:user] ? "--author #{opts[:user].inspect}" : "" }" +
@@ -67,9 +77,27 @@ module Amp
                    " #{opts[:message] ? "-m #{opts[:message].inspect}" : "" } 2> /dev/null"
           string.strip!
           
+          @revisions = nil
+          object_store.close # the commit may have packed things
           system string
         end
         
+        ##
+        # Reads objects straight out of .git, so we don't have to run git
+        # to look at a commit, tree or file.
+        #
+        # @return [Amp::Git::ObjectStore] the repository's object store
+        def object_store
+          @object_store ||= Amp::Git::ObjectStore.new File.join(@root, ".git")
+        end
+        
+        ##
+        # The hex SHA1s of every commit reachable from HEAD, newest first
+        # (the same order as `git log`).
+        def revisions
+          @revisions ||= object_store.rev_list("HEAD")
+        end
+        
         def add_all_files
           staging_area.add status[:modified]
         end
@@ -87,14 +115,12 @@ module Amp
           when 'tip', :tip
             Amp::Git::Changeset.new self, parents[0]
           when Integer
-            revs = `git log --pretty=oneline 2> /dev/null`.split("\n")
-            short_name = revs[revs.size - 1 - rev].split(' ').first
-            Amp::Git::Changeset.new self, short_name
+            Amp::Git::Changeset.new self, revisions[revisions.size - 1 - rev]
           end
         end
         
         def size
-          `git log --pretty=oneline 2> /dev/null`.split("\n").size
+          revisions.size
         end
         
         ##
@@ -171,17 +197,14 @@ module Amp
         end
         
         def parents
-          first = `git log -1 HEAD 2> /dev/null`
-          dad   = first[/^commit (.+)$/, 1]
-          dad   = dad ? dad[0..6] : nil
-          mom   = nil
-          
-          if first =~ /Merge: (.+)\.\.\. (.+)\.\.\.$/ # Merge: 1c002dd... 35cfb2b...
-            dad = $1 # just have them both use the short name, nbd
-            mom = $2
-          end
+          head = object_store.commit "HEAD"
+          return [nil, nil] unless head
           
-          [dad, mom]
+          # the working directory's parent is HEAD itself (plus whatever's
+          # being merged in), not HEAD's parents
+          merging = File.exist? File.join(object_store.git_dir, "MERGE_HEAD")
+          mom = merging && object_store.resolve("MERGE_HEAD")
+          [head.sha[0..6], mom && mom[0..6]]
         end
         
       end
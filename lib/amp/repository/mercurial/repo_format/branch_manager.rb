@@ -49,8 +49,8 @@ module Amp
           opts = DEFAULT_PARAMS.merge(opts)
           branch = opts[:branch] || default_branch_name
           
-          all_heads = quickly_load_branch_heads(opts[:start])[branch]
-          all_heads.reverse!
+          heads = quickly_load_branch_heads
+          all_heads = heads.has_key?(branch) ? heads[branch].reverse : []
 
           if !opts[:closed]
             # if a branch is closed, then the head changeset's extra field has "extra" => 1
@@ -80,20 +80,52 @@ module Amp
           end
         end
         
+        ##
+        # Brings the branch cache up to date with the changelog, on disk and in
+        # memory. Only the revisions added since the cache was last written get
+        # looked at, so calling this after a commit or a pull is cheap.
+        #
+        # @return [Hash<String => Array<String>>] a mapping of branch names to a list
+        #   of heads of the branch with the same name
+        def update_branch_cache!
+          quickly_load_branch_heads
+        end
+        
+        ##
+        # Forgets the in-memory branch cache, so it's re-read on next use.
+        def invalidate_branch_cache!
+          @cached_heads = @cached_tip_id = @cached_tip_num = nil
+        end
+        
       private
         
+        ##
+        # Reads the branch cache from disk, unless it's been read already.
+        def load_branch_cache
+          return if @cached_heads
+          read_results = read_branch_cache
+          @cached_heads, @cached_tip_id, @cached_tip_num =
+              read_results[:heads], read_results[:tip_id], read_results[:tip_num]
+        end
+        
         ##
         # Returns whether the cache is valid or not. Will return false if
         # there is no cache, as well.
         #
-        # @return [Hash<String => Array<String>>] a mapping of branch names to a list
-        #   of heads of the branch with the same name
+        # @return [Boolean] does the cache cover every revision?
         def cache_valid?
-          unless @cached_heads
-            read_results = read_branch_cache
-            @cached_heads, @cached_tip_id = read_results[:heads], read_results[:tip_id]
-          end
-          return self["tip"].node_id == @cached_tip_id
+          load_branch_cache
+          !!@cached_heads && @cached_tip_num == changelog.size - 1 &&
+                             @cached_tip_id  == changelog.tip
+        end
+        
+        ##
+        # Can the cache be brought up to date by looking at just the revisions
+        # after its tip? Not if there's no cache, or if its tip has since been
+        # stripped away.
+        def cache_extendable?
+          !!@cached_heads && @cached_tip_num >= 0 && @cached_tip_num < changelog.size &&
+              changelog.node_id_for_index(@cached_tip_num) == @cached_tip_id
         end
         
         ##
@@ -110,48 +142,53 @@ module Amp
         def cache(mapping)
           write_branch_heads!(mapping)
           @cached_heads = mapping
-          @cached_tip_id = self["tip"].node_id
+          @cached_tip_id = changelog.tip
+          @cached_tip_num = changelog.size - 1
           return mapping
         end
         
         ##
-        # Loads all the branch heads, and is where caching logic goes.
+        # Loads all the branch heads, and is where caching logic goes. A stale
+        # cache is extended from its tip when possible, and rebuilt otherwise.
         #
         # @return [Hash<String => Array<String>>] a mapping of branch names to a list
         #   of heads of the branch with the same name
-        def quickly_load_branch_heads(start = 0)
-          if cache_valid?
-            return cached_heads
+        def quickly_load_branch_heads
+          return cached_heads if cache_valid?
+          
+          if cache_extendable?
+            heads = scan_for_branch_heads(@cached_tip_num + 1, changelog.size - 1, cached_heads)
           else
-            return cache(scan_for_branch_heads(start, self.size - 1))
+            heads = scan_for_branch_heads(0, changelog.size - 1)
           end
+          cache heads
         end
         
         ##
-        # Does a full scan of each repository node to find the heads of each branch.
+        # Scans the given range of revisions, updating the heads of each branch.
+        # Parents and branch names come straight from the changelog, so no
+        # Changeset objects are made.
         #
         # @param [Fixnum] from (0) the beginning node from which to search.
         # @param [Fixnum] to (self.size - 1) the last node to look at in the search
+        # @param [Hash<String => Array<String>>] result the heads as of revision
+        #   +from+ - 1
         # @return [Hash<String => Array<String>>] a mapping of branch names to a list
         #   of heads of the branch with the same name
-        def scan_for_branch_heads(from = 0, to = self.size - 1)
-          puts "scanning"
-          result = ArrayHash.new
-          from.upto(to) do |idx|
-            changeset = self[idx]
-            branch = changeset.branch
-            
-            # This node might be a head of its branch
-            result[branch] << changeset.node_id
+        def scan_for_branch_heads(from = 0, to = self.size - 1, result = ArrayHash.new)
+          changelog.each_field(:branch, from..to) do |idx, branch|
+            heads = result[branch]
             
             # The node's parents are definitely not heads. Remove them.
-            changeset.parents.each do |parent|
-              result[branch].delete parent.node_id
+            changelog.parent_indices_for_index(idx).each do |parent|
+              heads.delete changelog.node_id_for_index(parent) unless parent == NULL_REV
             end
+            
+            # This node might be a head of its branch
+            heads << changelog.node_id_for_index(idx)
           end
           result
         end
-        memoize_method :scan_for_branch_heads
         
         ##
         # Reads all the branch heads, as well as the cached tip node and revision number.
@@ -195,11 +232,14 @@ module Amp
         #   form.
         def write_branch_heads!(mapping)
           @hg_opener.open("branchheads.cache","w") do |out|
-            out.puts "#{self["tip"].node_id.hexlify} #{self.size - 1}"
+            out.puts "#{changelog.tip.hexlify} #{changelog.size - 1}"
             mapping.each do |branch, list|
               list.each { |node| out.puts "#{node.hexlify} #{branch}" }
             end
           end
+        rescue SystemCallError
+          # can't write the cache (read-only repository?) - we'll just have
+          # to scan again next time
         end
         
       end
@@ -65,13 +65,17 @@ module Amp
       end
       
       ##
+      # Renders the changeset with a template.
       #
+      # @param [Hash] opts the options. :template picks the template, and if
+      #   :output is given, the changeset is rendered onto the end of it.
+      # @return [String] the rendered changeset (or :output, if given)
       def to_templated_s(opts={})
         # Extract local variables for the template. Should prolly do this
         # in a nicer way.... bah
         log = @repo.changelog
         parents = useful_parents log, revision
-        changes = log.read node
+        changes = raw_changeset
         
         locals = {:change_node => node,
                   :revision    => self.revision,
@@ -97,7 +101,7 @@ module Amp
         
         type = opts[:template_type] || 'log'
         if opts[:"template-raw"]
-          template = Support::RawERbTemplate.new(opts[:"template-raw"])
+          template = Support::RawERbTemplate.for(opts[:"template-raw"])
         elsif opts[:template].is_a?(Support::Template)
           template = opts[:template]
         else
@@ -105,7 +109,7 @@ module Amp
           template = "default-#{type}" if template.nil? || template.to_s == "default"
           template = Support::Template['mercurial', template]
         end
-        template.render(locals, binding)
+        template.render_into(opts[:output] || "", locals, self)
       end
       
       def useful_parents(log, revision)
@@ -175,7 +179,7 @@ module Amp
         xp2 = p2 == NULL_ID ? "" : p2.hexlify
         
         Hook.run_hook :pre_commit
-        journal = Amp::Mercurial::Journal.new(:opener => repo.store_opener)
+        journal = Amp::Mercurial::Journal.new(:opener => repo.store_opener, :buffered => true)
   
         fresh    = {} # new = reserved haha i don't know why someone wrote "haha"
         changed  = []
@@ -251,6 +255,7 @@ module Amp
         # and it deserves to stay (if an error is thrown and journal isn't nil,
         # the rescue will destroy it)
         journal = nil
+        repo.update_branch_cache!
         
         # Run any hooks
         Hook.run_hook :post_commit, :added => added, :modified => updated, :removed => removed, 
@@ -395,8 +400,9 @@ module Amp
       # Gets the raw changeset data for this revision. This includes
       # the user who committed it, the description of the commit, and so on.
       # Returns this: [manifest, user, [time, timezone], files, desc, extra]
+      # The entry decodes its fields as they're used, so we hang on to it.
       def raw_changeset
-        @repo.changelog.read(@node_id)
+        @raw_changeset ||= @repo.changelog.read(@node_id)
       end
       
       ##
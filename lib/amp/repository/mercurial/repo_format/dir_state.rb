@@ -182,6 +182,14 @@ module Amp
           @ignore_matches.call file
         end
         
+        ##
+        # The files the ignore rules are read from, relative to the root.
+        #
+        # @return [Array<String>] the ignore files
+        def ignore_files
+          @ignore
+        end
+        
         ##
         # Gets the current branch.
         #
@@ -557,8 +565,8 @@ module Amp
         # @return [Boolean] are we ignoring the dir?
         def ignoring_directory?(dir)
           return false if dir == '.'  # base cases
-          return true  if ignore dir  # base cases
-          !!directories_to(dir).any? {|d| ignore d }
+          @ignore_matches ||= parse_ignore @root, @ignore
+          @ignore_matches.ignoring_directory? dir
         end
         alias_method :ignoring_dir?, :ignoring_directory?
         
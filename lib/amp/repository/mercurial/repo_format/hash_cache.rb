@@ -0,0 +1,142 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+require 'fileutils'
+
+module Amp
+  module Repositories
+    module Mercurial
+
+      ##
+      # = HashCache
+      # Remembers which working files we've read and found to match a
+      # filelog revision, along with their stat data at the time. If a
+      # file's size, mtime and inode haven't moved since, its contents
+      # haven't either, and status can call it clean without reading it -
+      # which saves a lot of reading after something touches every file
+      # in the tree.
+      #
+      # It's kept in .hg/cache/hashcache, apart from the dirstate, so the
+      # dirstate's format (and its idea of which files need looking up)
+      # stays just the way Mercurial has it.
+      class HashCache
+        # node ID, size (high and low words), mtime (seconds and nanoseconds),
+        # inode (high and low words), path length
+        FORMAT = "a20N7"
+        RECORD_SIZE = 48
+
+        ##
+        # @param [String] path where the cache is kept
+        # @param [Integer] granularity how many seconds the filesystem's
+        #   timestamps might be off by. Files modified more recently than
+        #   that when we save aren't remembered, since they could change
+        #   again without their mtime moving.
+        def initialize(path, granularity = 1)
+          @path        = path
+          @granularity = granularity
+          @entries     = nil
+          @dirty       = false
+        end
+
+        ##
+        # The stat data we key files on.
+        #
+        # @param [File::Stat] st the file's stat data
+        # @return [Array<Integer>] size, mtime (seconds and nanoseconds), inode
+        def self.key_for(st)
+          time = st.mtime
+          nsec = time.respond_to?(:nsec) ? time.nsec : time.usec * 1000
+          [st.size, time.to_i, nsec, st.ino]
+        end
+
+        ##
+        # Which filelog revision a file matched, if it hasn't changed since.
+        # A file that has changed is forgotten.
+        #
+        # @param [String] path the file's path, relative to the root
+        # @param [File::Stat] st the file's current stat data
+        # @return [String, nil] the binary node ID, or nil if we don't know
+        def [](path, st)
+          path = binary path
+          node, key = entries[path]
+          return nil unless node
+          return node if key == HashCache.key_for(st)
+
+          entries.delete path
+          @dirty = true
+          nil
+        end
+
+        ##
+        # Remembers that a file matched a filelog revision.
+        #
+        # @param [String] path the file's path, relative to the root
+        # @param [File::Stat] st the file's stat data when it was read
+        # @param [String] node the binary node ID it matched
+        def []=(path, st, node)
+          entries[binary(path)] = [node, HashCache.key_for(st)]
+          @dirty = true
+        end
+
+        ##
+        # Saves the cache, if anything's changed.
+        def write
+          return unless @dirty
+          limit = Time.now.to_i - @granularity
+
+          data = ""
+          entries.each do |path, (node, key)|
+            size, mtime, nsec, ino = key
+            next if mtime > limit # racy - see #initialize
+            data << [node, size >> 32, size & 0xffffffff, mtime, nsec,
+                     ino >> 32, ino & 0xffffffff, path.bytesize].pack(FORMAT) << path
+          end
+
+          FileUtils.mkdir_p File.dirname(@path)
+          File.open("#{@path}.tmp", "wb") {|f| f.write data }
+          File.rename "#{@path}.tmp", @path
+          @dirty = false
+        end
+
+        private
+
+        ##
+        # Paths are kept as raw bytes, the way they're read back in, so a
+        # path with non-ASCII characters finds its entry either way.
+        def binary(path)
+          path = path.dup
+          path.force_encoding "BINARY" if path.respond_to? :force_encoding
+          path
+        end
+
+        def entries
+          @entries ||= begin
+            entries = {}
+            data = File.exist?(@path) ? File.open(@path, "rb") {|f| f.read } : ""
+            pos = 0
+            while pos + RECORD_SIZE <= data.size
+              node, size_hi, size_lo, mtime, nsec, ino_hi, ino_lo, length =
+                data[pos, RECORD_SIZE].unpack(FORMAT)
+              path = data[pos + RECORD_SIZE, length]
+              break unless path && path.size == length # truncated
+              entries[path] = [node, [(size_hi << 32) | size_lo, mtime, nsec, (ino_hi << 32) | ino_lo]]
+              pos += RECORD_SIZE + length
+            end
+            entries
+          end
+        end
+      end
+    end
+  end
+end
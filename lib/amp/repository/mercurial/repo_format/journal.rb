@@ -26,8 +26,20 @@ module Amp
     ##
     # Provides a journal interface so when a large number of transactions
     # are occurring, and any one could fail, we can rollback the changes.
+    #
+    # A journal opened with :buffered => true keeps new entries in memory
+    # until {#flush} is called. Anything that appends to a journaled file
+    # *must* flush the journal before writing, so the truncation point is
+    # always on disk before the data it protects. Buffered journals also
+    # remember every file they've seen and fsync them all in one pass at
+    # {#close}, before the journal file itself goes away.
+    #
+    # If the opener wants to know about the journal (it responds to
+    # #journal=), it's told when the journal opens, so it can hold off on
+    # its own bookkeeping until {#on_close} or {#on_abort}.
     class Journal
-      DEFAULT_OPTS = {:reporter => StandardErrorReporter, :after_close => nil, :createmode => nil}
+      DEFAULT_OPTS = {:reporter => StandardErrorReporter, :after_close => nil,
+                      :createmode => nil, :buffered => false}
       
       attr_accessor :reporter, :journal, :after_close, :opener
       
@@ -61,16 +73,22 @@ module Amp
       #   of the journal file we'll be using
       # @param [Proc] after_close A proc to call (with no args) after we
       #   close (finish) the transaction.
+      # @param [Boolean] buffered whether to hold entries in memory until
+      #   {#flush}, and to defer fsyncing the journaled files until {#close}
       def initialize(opts = {}, &after_close)   
         opts = DEFAULT_OPTS.merge(opts)
         opts[:journal] ||= ".journal#{rand(10000)}"
         @count = 1
         @entries = []
         @map = {}
+        @pending = []
+        @buffered = opts[:buffered]
+        @close_hooks, @abort_hooks = [], []
         @journal_file = opts[:journal]
         self.reporter = opts[:reporter]
         self.after_close = after_close
         self.opener = opts[:opener]
+        self.opener.journal = self if self.opener.respond_to?(:journal=)
         
         @file = Kernel::open(@journal_file, "w")
         
@@ -84,7 +102,9 @@ module Amp
       # on the transactions.
       def delete
         if @journal_file
+          @pending = []
           abort if @entries.any?
+          run_hooks @abort_hooks
           @file.close
           FileUtils.safe_unlink @journal_file
         end
@@ -108,8 +128,7 @@ module Amp
         @map[h[:file]] = @entries.size - 1
         
         # tell the journal how to truncate this revision
-        @file.write "#{h[:file]}\0#{h[:offset]}\n"
-        @file.flush
+        write_line "#{h[:file]}\0#{h[:offset]}\n"
       end
       
       ##
@@ -142,14 +161,45 @@ module Amp
         raise IndexError.new("journal lookup failed #{file}") unless @map[file]
         index = @map[file]
         @entries[index] = {:file => file, :offset => offset, :data => data}
-        @file.write("#{file}\0#{offset}\n")
-        @file.flush
+        write_line "#{file}\0#{offset}\n"
       end
       
       ##
       # Alias for {replace}
       alias :update :replace
       
+      ##
+      # Is this journal holding entries in memory between flushes?
+      def buffered?
+        @buffered
+      end
+      
+      ##
+      # Writes any buffered entries to the journal file in a single write.
+      # Must be called before appending to any file that has been journaled
+      # since the last flush. Does nothing for unbuffered journals, since
+      # they write each entry as it comes in.
+      def flush
+        return if @pending.empty?
+        @file.write @pending.join
+        @file.flush
+        @pending = []
+      end
+      
+      ##
+      # Registers a block to run when the journal closes successfully, before
+      # the journaled files are synced. Writes batched up for the length of
+      # the transaction get done here.
+      def on_close(&block)
+        @close_hooks << block
+      end
+      
+      ##
+      # Registers a block to run if the journal is thrown away instead.
+      def on_abort(&block)
+        @abort_hooks << block
+      end
+      
       ##
       # No godly idea what this is for
       def nest
@@ -170,6 +220,9 @@ module Amp
         UI::status "closing journal"
         @count -= 1
         return if @count != 0
+        flush
+        run_hooks @close_hooks
+        sync_entries if @buffered
         @file.close
         @entries = []
         if @after_close
@@ -201,6 +254,43 @@ module Amp
         @reporter.report "rollback completed\n"
       end
       
+      ##
+      # Writes a line to the journal file, or holds onto it until the next
+      # {#flush} if we're buffered.
+      #
+      # @param [String] line the journal line to record
+      def write_line(line)
+        if @buffered
+          @pending << line
+        else
+          @file.write line
+          @file.flush
+        end
+      end
+      private :write_line
+      
+      ##
+      # Makes every journaled file durable, one fsync per file, so that the
+      # journal can be safely removed. A file that has vanished (say, it was
+      # stripped) has nothing left to sync.
+      def sync_entries
+        @entries.each do |entry|
+          begin
+            File.open(self.opener.join(entry[:file]), "r") {|fp| fp.fsync }
+          rescue Errno::ENOENT
+          end
+        end
+      end
+      private :sync_entries
+      
+      ##
+      # Runs (and forgets) a list of hooks, so they only ever run once.
+      def run_hooks(hooks)
+        hooks.each {|hook| hook.call }
+        @close_hooks, @abort_hooks = [], []
+      end
+      private :run_hooks
+      
       ##
       # If we crashed during an abort, the journal file is gonna be sitting aorund
       # somewhere. So, we should rollback any changes it left lying around.
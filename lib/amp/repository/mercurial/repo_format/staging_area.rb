@@ -371,6 +371,10 @@ module Amp
         # Supplements the built-in #status method so that its output will be more
         # accurate.
         #
+        # A file that's only been touched since we last read it (according to
+        # the HashCache) is clean. Entries the dirstate has marked for lookup
+        # (with no size) are always looked up.
+        #
         # @param [String] file the filename to look up
         # @param [File::Stats] st the current results of File.lstat(file)
         # @return [Symbol] a symbol representing the current file's status
@@ -379,12 +383,167 @@ module Amp
           if (size >= 0 && (size != st.size || ((mode ^ st.mode) & 0100 and @check_exec))) || size == -2 || dirstate.copy_map[file]
             return :modified
           elsif time != st.mtime.to_i # DOH - we have to remember that times are stored as fixnums
+            return :clean if size >= 0 && known_clean?(file, st)
+            lookup_stats[file] = st
             return :lookup
           else
             return :clean
           end
         end
         
+        ##
+        # Remembers the looked-up files that turned out to be clean, in the
+        # HashCache, so next time a stat will do. Files that changed while
+        # we were reading them are left out.
+        #
+        # @param [Array<String>] files the files found to be clean
+        # @param [Changeset] changeset the changeset they match
+        def remember_clean(files, changeset)
+          files.each do |file|
+            before = lookup_stats.delete file
+            next unless before
+            st = File.lstat(repo.working_join(file)) rescue nil
+            next unless st && HashCache.key_for(st) == HashCache.key_for(before)
+            hash_cache[file, st] = changeset.file_node(file)
+          end
+          hash_cache.write
+        end
+        
+        ##
+        # Like CommonStagingAreaMethods#status, but if a WatchServer is
+        # watching the working directory, the only files looked at are the
+        # ones it's seen change since last time, and the ones that weren't
+        # clean then. Listing clean or ignored files, or looking at only part
+        # of the tree, still walks the whole thing.
+        #
+        # @see CommonStagingAreaMethods#status
+        def status(ignored, clean, unknown, match = Match.new { true })
+          @watch_token = nil
+          @watching = !ignored && !clean && whole_tree?(match)
+          result = super
+          
+          # what isn't clean now has to be looked at next time, even if it
+          # doesn't change. Without the unknown files, we don't know that.
+          if @watch_token && unknown
+            notes = [:modified, :added, :removed, :deleted, :unknown, :lookup].map {|key| result[key] }
+            begin
+              WatchState.new(@watch_token, @watch_tag, notes.flatten).write watch_state_path
+            rescue SystemCallError
+            end
+          end
+          result
+        ensure
+          @watching = false
+        end
+        
+        ##
+        # Walks the working directory - or, on behalf of #status, just the
+        # files the WatchServer says might have changed.
+        #
+        # @see CommonStagingAreaMethods#walk
+        def walk(unknown, ignored, match = Amp::Match.new { true })
+          (@watching && watched_walk(unknown, match)) || super
+        end
+        
+        private
+        
+        ##
+        # Does +match+ take in the whole tree? Only if it's got no explicit
+        # files and no patterns.
+        def whole_tree?(match)
+          match.files.empty? && !match.include && !match.exclude
+        end
+        
+        ##
+        # The files #status has to look at, according to the WatchServer:
+        # the ones it's seen change since last time, the ones that weren't
+        # clean last time, and the ones the dirstate doesn't think are
+        # clean. Sets @watch_token if a server answered, even if we have to
+        # walk the tree anyway.
+        #
+        # @return [Hash<String => [NilClass, File::Stat]>, nil] the files, as
+        #   #walk returns them, or nil if the tree has to be walked
+        def watched_walk(unknown, match)
+          socket = Amp::Servers::WatchServer.default_socket_for repo
+          unless File.socket? socket
+            Amp::Servers::WatchServer.spawn repo if repo.config["watch", "auto", Boolean, false]
+            return nil
+          end
+          
+          @watch_tag = watch_tag
+          state = WatchState.load watch_state_path
+          state = nil if state && state.tag != @watch_tag
+          @watch_token, changed = Amp::Servers::WatchServer.query(socket, state ? state.token : "")
+          return nil unless changed && state
+          
+          candidates = {}
+          state.files.each {|file| candidates[file] = true }
+          changed.each do |path|
+            if path[-1, 1] == "/" # a directory went away, and everything in it
+              all_files.each {|file| candidates[file] = true if file.start_with? path }
+            else
+              candidates[path] = true
+            end
+          end
+          dirstate.files.each do |file, entry|
+            candidates[file] = true unless entry.normal? && entry.size >= 0 && entry.mtime >= 0
+          end
+          dirstate.copy_map.each_key {|file| candidates[file] = true }
+          
+          results = {}
+          candidates.each_key do |file|
+            next unless match.call file
+            tracked = tracking? file
+            st = File.lstat(File.join(repo.root, file)) rescue nil
+            if st && (st.file? || st.symlink?)
+              # the walk would never have gone into an ignored directory
+              next unless tracked || (unknown && !dirstate.ignoring_directory?(File.dirname(file)))
+              results[file] = st
+            elsif tracked
+              results[file] = nil
+            end
+          end
+          results
+        end
+        
+        ##
+        # What a WatchState has to have been saved against to be any use:
+        # the same parents, and the same ignore files.
+        def watch_tag
+          ignores = (dirstate.ignore_files || []).map do |file|
+            st = File.stat(File.join(repo.root, file)) rescue nil
+            st && [st.ino, st.size, st.mtime.to_f]
+          end
+          [dirstate.parents, ignores].inspect.sha1.hexdigest
+        end
+        
+        def watch_state_path
+          File.join(repo.root, ".hg", "cache", "watchstate")
+        end
+        
+        ##
+        # Do we know the file matches the working directory's parent, without
+        # reading it? Not in the middle of a merge, we don't.
+        def known_clean?(file, st)
+          return false if dirstate.parents[1] != Amp::Mercurial::RevlogSupport::Node::NULL_ID
+          node = hash_cache[file, st]
+          return false unless node
+          
+          parent = dirstate.parents[0]
+          @parent = nil if @parent && @parent.node != parent
+          @parent ||= repo[parent]
+          node == @parent.file_node(file)
+        end
+        
+        def lookup_stats
+          @lookup_stats ||= {}
+        end
+        
+        def hash_cache
+          @hash_cache ||= HashCache.new(File.join(repo.root, ".hg", "cache", "hashcache"),
+                                        (repo.config['dirstate']['granularity'] || 1).to_i)
+        end
+        
       end
     end
   end
@@ -65,19 +65,18 @@ module Amp
           end
           
           ##
-          # Iterates over every file tracked in the store and yield it.
+          # Iterates over every file tracked in the store and yield it. The
+          # data files come first and the changelog last, so anything copying
+          # the store in this order never has changesets without their data.
           # 
           # @yield [file] every file in the store
-          # @yieldparam [String] file the filepath to an entry in the store
+          # @yieldparam [(String, String, Fixnum)] file the entry's name, its
+          #   path in the store, and its size
+          # @return [Array<(String, String, Fixnum)>] every entry
           def walk
-            datafiles do |x|
-              yield x
-            end
-            
-            meta = do_walk '', false
-            meta.reverse.each do |x|
-              yield x
-            end
+            entries = datafiles.to_a + do_walk('', false).reverse
+            entries.each {|x| yield x } if block_given?
+            entries
           end
           
           ##
@@ -96,15 +95,15 @@ module Amp
           # @return [(String, String, Fixnum)] Each entry is returned in the form
           #   [filepath, filepath, filesize]
           def do_walk(relpath, recurse=false)
-            path = join relpath
-            stripped_len = path.size + File::SEPARATOR.size - 1
+            path = relpath.empty? ? @path : @path_joiner.call(@path, relpath)
+            stripped_len = @path.size + File::SEPARATOR.size
             list = []
             if File.directory?(path)
               to_visit = [path]
               while to_visit.any?
                 p = to_visit.shift
                 Dir.stat_list(p, true) do |file, kind, stat|
-                  fp = join(file)
+                  fp = @path_joiner.call(p, file)
                   if kind =~ /file/ && ['.d','.i'].include?(file[-2..-1])
                     n = fp[stripped_len..-1]
                     list << [n, n, stat.size]
@@ -170,10 +169,11 @@ module Amp
           # 
           # @see BasicStore
           def datafiles
-            do_walk('data', true) do |a, b, size|
-              a = decode_filename(a) || nil
-              yield [a, b, size] if block_given?
+            result = do_walk('data', true).map do |a, b, size|
+              [Stores.decode_filename(a), b, size]
             end
+            result.each {|x| yield x } if block_given?
+            result
           end
           
           ##
@@ -225,6 +225,10 @@ module Amp
           # the real Opener object (that responds to #open and returns a file
           # pointer). then just treat it like any other opener. It will handle
           # the behind-the-scenes work itself.
+          #
+          # While a journal is open, names of new files are held in memory and
+          # appended to the cache in one write when the journal closes. Without
+          # a journal, each one is appended as it's seen.
           class FilenameCacheOpener < Amp::Opener
             
             ##
@@ -236,6 +240,8 @@ module Amp
             def initialize(opener)
               @opener = opener
               @entries = nil
+              @pending = []
+              @journal = nil
             end
             
             def path; @opener.path; end
@@ -250,6 +256,64 @@ module Amp
               end
             end
             
+            ##
+            # Every file in the cache, including ones that haven't been written
+            # out yet. Loads the cache if need be.
+            # 
+            # @return [Array<String>] the names of the files, unencoded
+            def filenames
+              load_filename_cache if @entries.nil?
+              @entries.keys
+            end
+            
+            ##
+            # Called by a journal using this opener when it starts. New entries
+            # wait for the journal to close, and are dropped if it aborts -
+            # along with the files they name.
+            # 
+            # @param [Amp::Mercurial::Journal] journal the journal that's starting
+            def journal=(journal)
+              @journal = journal
+              journal.on_close { flush_filename_cache }
+              journal.on_abort { discard_pending_filenames }
+            end
+            
+            ##
+            # Adds a file to the cache, unless it's already there.
+            # 
+            # @param [String] path the path of the file, unencoded
+            def add_filename(path)
+              load_filename_cache if @entries.nil?
+              return if @entries[path]
+              
+              @entries[path] = true
+              if @journal && @journal.running?
+                @pending << path
+              else
+                @opener.open('fncache', 'ab') {|f| f.write path + "\n" }
+              end
+            end
+            
+            ##
+            # Appends every held-back entry to the cache in a single write.
+            def flush_filename_cache
+              @journal = nil
+              return if @pending.empty?
+              @opener.open('fncache', 'ab') do |f|
+                f.write @pending.map {|p| p + "\n" }.join
+              end
+              @pending = []
+            end
+            
+            ##
+            # Forgets the held-back entries, since the files they name have
+            # been rolled back.
+            def discard_pending_filenames
+              @journal = nil
+              @pending.each {|p| @entries.delete p }
+              @pending = []
+            end
+            
             ##
             # Opens a file while being sure to write the filename if we haven't
             # seen it before. Just like the normal Opener's open() method.
@@ -259,13 +323,7 @@ module Amp
             # @param block the block to pass to it (optional)
             def open(path, mode='r', &block)
               
-              if mode !~ /r/ && path =~ /data\//
-                load_filename_cache if @entries.nil?
-                if @entries[path].nil?
-                  @opener.open('fncache','ab') {|f| f.puts path }
-                  @entries[path] = true
-                end
-              end
+              add_filename path if mode !~ /r/ && path =~ /data\//
               
               begin
                 @opener.open(Stores.hybrid_encode(path), mode, &block)
@@ -316,7 +374,19 @@ module Amp
           # Here's how we walk through the files now. Oh, look, we don't need
           # to do annoying directory traversal anymore! But we do have to
           # maintain a consistent fnstore file. I think I can live with that.
-          def datafiles
+          # 
+          # Pass +stat+ as false when the sizes aren't needed: the names come
+          # straight out of the (already loaded) cache, nothing is stat'd, and
+          # each size is nil. Files that have gone missing aren't noticed.
+          # 
+          # @param [Boolean] stat look up each file's size?
+          def datafiles(stat=true)
+            unless stat
+              result = @opener.filenames.sort.map {|f| [f, Stores.hybrid_encode(f), nil] }
+              result.each {|entry| yield entry } if block_given?
+              return result
+            end
+            
             rewrite = false
             existing = []
             pjoin = @path_joiner
@@ -360,27 +430,16 @@ module Amp
         #############################################
         ############ Encoding formats ###############
         #############################################
+        # The encodings themselves live in Amp::Support::StoreEncoding, which
+        # is implemented in C when the extension is built.
         
-        ##
-        # Gets the basic character map that maps disallowed letters to
-        # allowable substitutes.
-        #
-        # @param [Boolean] underscore Should underscores be inserted in front of
-        #   capital letters before we downcase them? (e.g. if true, "A" => "_a")
-        def illegal_character_map(underscore=true)
-          e = '_'
-          win_reserved = "\\:*?\"<>|".split("").map {|x| x.ord}
-          cmap = {}; 0.upto(126) {|x| cmap[x.chr] = x.chr}
-          ((0..31).to_a + (126..255).to_a + win_reserved).each do |x|
-            cmap[x.chr] = "~%02x" % x
-          end
-          ((("A".ord)..("Z".ord)).to_a + [e.ord]).each do |x|
-            cmap[x.chr] = e + x.chr.downcase if underscore
-            cmap[x.chr] = x.chr.downcase     unless underscore
-          end
-          cmap
+        # How many hybrid-encoded paths to remember. Every filelog open
+        # encodes its path, so this is shared by the store and its opener.
+        # Set it to 0 to turn the cache off.
+        @encoded_path_cache_size = 4096
+        class << self
+          attr_accessor :encoded_path_cache_size
         end
-        memoize_method :illegal_character_map, true
         
         ##
         # Reversible encoding of the filename
@@ -390,8 +449,7 @@ module Amp
         #   downcasing letters? (e.g. if true, "A" => "_a")
         # @return [String] an encoded file path
         def encode_filename(s, underscore=true)
-          cmap = illegal_character_map underscore
-          s.split("").map {|c| cmap[c]}.join
+          Support::StoreEncoding.encode s, underscore
         end
         
         ##
@@ -400,49 +458,13 @@ module Amp
         # @param [String] s an encoded file path
         # @param [String] the decoded file path
         def decode_filename(s)
-          cmap = illegal_character_map true
-          dmap = {}
-          cmap.each do |k, v|
-            dmap[v] = k
-          end
-          
-          i = 0
-          result = []
-          while i < s.size
-            1.upto(3) do |l|
-              if dmap[s[i..(i+l-1)]]
-                result << dmap[s[i..(i+l-1)]]
-                i += l
-                break
-              end
-            end
-          end
-          result.join
+          Support::StoreEncoding.decode s
         end
         
-        # can't name a file one of these on windows, apparently
-        WINDOWS_RESERVED_FILENAMES = %w(con prn aux nul com1
-        com2 com3 com4 com5 com6 com7 com8 com8 lpt1 lpt2
-        lpt3 lpt4 lpt5 lpt6 lpt7 lpt8 lpt9)
-        
         ##
-        # Copypasta
+        # Escapes windows' reserved filenames, and trailing spaces and periods.
         def auxilliary_encode(path)
-          res = []
-          path.split('/').each do |n|
-            if n.any?
-              base = n.split('.')[0]
-              if !(base.nil?) && base.any? && WINDOWS_RESERVED_FILENAMES.include?(base)
-                ec = "~%02x" % n[2,1].ord
-                n = n[0..1] + ec + n[3..-1]
-              end
-              if ['.',' '].include? n[-1,1]
-                n = n[0..-2] + ("~%02x" % n[-1,1].ord)
-              end
-            end
-            res << n
-          end
-          res.join("/")
+          Support::StoreEncoding.auxiliary_encode path
         end
         
         ##
@@ -451,51 +473,30 @@ module Amp
           encode_filename s, false
         end
         
-        MAX_PATH_LEN_IN_HGSTORE = 120
-        DIR_PREFIX_LEN = 8
-        MAX_SHORTENED_DIRS_LEN = 8 * (DIR_PREFIX_LEN + 1) - 4
-        
         ##
         # uber encoding that's straight up crazy.
         # Max length of 120 means we have a non-reversible encoding,
         # but since the FilenameCache only cares about name lookups, one-way
         # is really all that matters!
         # 
+        # Results are remembered, up to encoded_path_cache_size of them; when
+        # the cache fills up, it's emptied and starts over.
+        # 
         # @param [String] path the path to encode
         # @return [String] an encoded path, with a maximum length of 120.
         def hybrid_encode(path)
-          return path unless path =~ /data\//
-          ndpath = path["data/".size..-1]
-          res = "data/" + auxilliary_encode(encode_filename(ndpath))
-          if res.size > MAX_PATH_LEN_IN_HGSTORE
-            digest = path.sha1.hexdigest
-            aep = auxilliary_encode(lower_encode(ndpath))
-            root, ext = FileHelpers.split_extension aep
-            parts = aep.split('/')
-            basename = File.basename aep
-            sdirs = []
-            parts[0..-2].each do |p|
-              d = p[0..(DIR_PREFIX_LEN-1)]
-              
-              d = d[0..-2] + "_" if " .".include?(d[-1,1])
-              
-              t = sdirs.join("/") + "/" + d
-              break if t.size > MAX_SHORTENED_DIRS_LEN
-      
-              sdirs << d
-            end
-            dirs = sdirs.join("/")
-            dirs += "/" if dirs.size > 0
-            
-            res = "dh/" + dirs + digest + ext
-            space_left = MAX_PATH_LEN_IN_HGSTORE - res.size
-            if space_left > 0
-              filler = basename[0..(space_left-1)]
-              res = "dh/" + dirs + filler + digest + ext
-            end
-          end
-          return res
-              
+          size = Stores.encoded_path_cache_size
+          return Support::StoreEncoding.hybrid_encode(path) unless size && size > 0
+          
+          @encoded_paths ||= {}
+          encoded = @encoded_paths[path]
+          return encoded if encoded
+          
+          encoded = Support::StoreEncoding.hybrid_encode(path)
+          @encoded_paths.clear if @encoded_paths.size >= size
+          # paths outside of data/ come back as-is, so there's nothing to save
+          @encoded_paths[path] = encoded.freeze unless encoded.equal? path
+          encoded
         end
       end
     end
@@ -26,6 +26,9 @@ module Amp
         include Amp::Mercurial::RevlogSupport::Node
         
         TAG_FORBIDDEN_LETTERS = ":\r\n"
+        # Where the global tags are cached, relative to .hg/
+        TAGS_CACHE_FILE = "cache/tags"
+        
         ##
         # Returns a list of all the tags as a hash, mapping each tag to the tip-most
         # changeset it applies to.
@@ -100,14 +103,10 @@ module Amp
           
           global_tags, tag_types = {}, {}
           
-          f = nil
-          # For each current .hgtags file in our history (including multi-heads), read in
-          # the tags
-          hg_tags_nodes.each do |rev, node, file_node|
-            # get the file
-            f = (f && f.file(file_node.file_node)) || self.versioned_file(".hgtags", :file_id => file_node.file_node)
-            # read the tags, as global, because they're versioned.
-            read_tags(f.data.split("\n"), f, "global", global_tags, tag_types)
+          # The versioned tags, from every head's .hgtags
+          global_tags_from_heads.each do |tag, nh|
+            global_tags[tag] = nh
+            tag_types[tag] = "global"
           end
           
           # Now do locally stored tags, that aren't committed/versioned
@@ -217,23 +216,101 @@ module Amp
         end
         
         ##
-        # Goes through all the heads in the repository, getting the state of the .hgtags
-        # file at each head. We then return a list, with each entry mapping revision index
-        # and node ID to the .hgtags file at that head. If two different heads have the same
-        # .hgtags file, only 1 is returned with it.
+        # Reads and merges the .hgtags file at every head. The result is cached
+        # in .hg/cache/tags along with the .hgtags file node at each head, so:
+        # 
+        # - while the tip stays put, nothing but the cache is read;
+        # - after new commits, only new heads have their manifests read, and
+        #   if no head's .hgtags changed, no .hgtags revision is read either.
         #
-        # @return [(Fixnum, String, VersionedFile)] each head with a different .hgtags file
-        #   at that point. That way we have the most recent copy of .hgtags, even if the file
-        #   differs on different heads.
-        def hg_tags_nodes
-          return_list = {}
-          self.heads.reverse.each do |node|
-            changeset = self[node]
-            rev = changeset.revision
-            file_node = changeset.get_file(".hgtags") rescue next
-            return_list[file_node] = [rev, node, file_node]
+        # @return [Hash<String => [String, Array<String>]>] each tag mapped to
+        #   its node and the nodes it used to point at
+        def global_tags_from_heads
+          cache = read_tags_cache
+          tip_rev, tip = changelog.size - 1, changelog.tip
+          return cache[:tags] if cache && cache[:tip_rev] == tip_rev && cache[:tip] == tip
+          
+          head_file_nodes = hg_tags_nodes(cache ? cache[:file_nodes] : {})
+          file_nodes = head_file_nodes.map {|node, file_node| file_node }.compact.uniq
+          
+          if cache && cache[:file_nodes].values_at(*cache[:heads]).compact.uniq == file_nodes
+            global_tags = cache[:tags]
+          else
+            global_tags, tag_types = {}, {}
+            f = nil
+            # For each current .hgtags file in our history (including multi-heads), read in
+            # the tags
+            file_nodes.each do |file_node|
+              # get the file
+              f = (f && f.file(file_node)) || self.versioned_file(".hgtags", :file_id => file_node)
+              # read the tags, as global, because they're versioned.
+              read_tags(f.data.split("\n"), f, "global", global_tags, tag_types)
+            end
+          end
+          
+          write_tags_cache tip_rev, tip, head_file_nodes, global_tags
+          global_tags
+        end
+        
+        ##
+        # Finds the node of the .hgtags file at each head, oldest head first.
+        #
+        # @param [Hash<String => String>] known file nodes already known for some
+        #   heads (nil meaning the head has no .hgtags)
+        # @return [Array<[String, String]>] each head's node ID, paired with
+        #   the node ID of its .hgtags file, or nil if it has none
+        def hg_tags_nodes(known = {})
+          self.heads.reverse.map do |node|
+            next [node, known[node]] if known.has_key? node
+            file_node = self[node].get_file(".hgtags").file_node rescue nil
+            [node, file_node]
+          end
+        end
+        
+        ##
+        # Reads the tags cache. The first line holds the tip's revision number
+        # and node; each line after that, up to a blank line, holds a head and
+        # its .hgtags file node (if it has one). The rest of the file is the
+        # merged tags, in .hgtags format, with a tag's earlier nodes listed
+        # before its current one.
+        #
+        # @return [Hash, nil] the cache, with keys :tip_rev, :tip, :heads,
+        #   :file_nodes and :tags, or nil if there isn't a readable one
+        def read_tags_cache
+          lines = @hg_opener.read(TAGS_CACHE_FILE).split("\n")
+          tip_rev, tip = lines.shift.split(" ", 2)
+          
+          heads, file_nodes = [], {}
+          while (line = lines.shift) && line.any?
+            head, file_node = line.split(" ", 2)
+            heads << head.unhexlify
+            file_nodes[heads.last] = file_node && file_node.unhexlify
+          end
+          
+          {:tip_rev => tip_rev.to_i, :tip => tip.unhexlify, :heads => heads,
+           :file_nodes => file_nodes, :tags => parse_tag_heads(lines, TAGS_CACHE_FILE)}
+        rescue SystemCallError, NoMethodError
+          nil
+        end
+        
+        ##
+        # Writes the tags cache.
+        #
+        # @see read_tags_cache
+        def write_tags_cache(tip_rev, tip, head_file_nodes, global_tags)
+          @hg_opener.open(TAGS_CACHE_FILE, "w") do |out|
+            out.write "#{tip_rev} #{tip.hexlify}\n"
+            head_file_nodes.each do |head, file_node|
+              out.write "#{head.hexlify}#{file_node && " " + file_node.hexlify}\n"
+            end
+            out.write "\n"
+            global_tags.each do |tag, (node, old_nodes)|
+              old_nodes.each {|old| out.write "#{old.hexlify} #{tag}\n" }
+              out.write "#{node.hexlify} #{tag}\n"
+            end
           end
-          return return_list.values
+        rescue SystemCallError
+          # read-only repository - we'll just have to read .hgtags next time
         end
         
         ##
@@ -342,7 +419,7 @@ module Amp
             b_node, b_heads = global_tags[tag]
             # should we use the already-figured-out tag heads instead?
             if b_node != a_node && b_heads.include?(a_node) && 
-              (!a_heads.include?(bn) || b_heads.size > a_heads.size)
+              (!a_heads.include?(b_node) || b_heads.size > a_heads.size)
               a_node = b_node
             end
             # Union the two head lists into a_heads
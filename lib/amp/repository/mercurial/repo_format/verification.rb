@@ -34,10 +34,12 @@ module Amp
         ##
         # Runs a verification sweep on the repository.
         #
+        # @param [Hash] opts options for the verification
+        # @option opts [Integer] :jobs (1) how many processes to check file logs with
         # @return [VerificationResult] the results of the verification, which
         #   includes error messages, warning counts, and so on.
-        def verify
-          result = Verifier.new(self).verify
+        def verify(opts = {})
+          result = Verifier.new(self, opts).verify
         end
         
         ##
@@ -54,11 +56,17 @@ module Amp
           # Creates a new Verifier. The Verifier can verify a Mercurial repository.
           # 
           # @param [Repository] repo the repository this verifier will examine
-          def initialize(repo)
+          # @param [Hash] opts options for the verification
+          # @option opts [Integer] :jobs (1) how many processes to check file logs
+          #   with. File logs are independent of one another, so with more than
+          #   one job they're split between forked workers.
+          def initialize(repo, opts = {})
             @repository = repo
             @result = VerificationResult.new(0, 0, 0, 0, 0)
+            @jobs   = [opts[:jobs].to_i, 1].max
             
             @bad_revisions = {}
+            @messages = nil
             @changelog = repo.changelog
             @manifest  = repo.manifest
           end
@@ -81,12 +89,24 @@ module Amp
             # revision index in the changelog (and the one the user always sees)
             file_node_ids = Hash.new {|h, k| h[k] = {}}
             
-            verify_changelog(manifest_linkrevs, file_linkrevs)
-            verify_manifest(manifest_linkrevs,  file_node_ids)
-            verify_crosscheck(manifest_linkrevs, file_linkrevs, file_node_ids)
+            timed_phase("changelog", "revisions") do
+              verify_changelog(manifest_linkrevs, file_linkrevs)
+              @changelog.size
+            end
+            timed_phase("manifests", "revisions") do
+              verify_manifest(manifest_linkrevs,  file_node_ids)
+              @manifest.size
+            end
+            timed_phase("crosscheck", "files") do
+              verify_crosscheck(manifest_linkrevs, file_linkrevs, file_node_ids)
+              file_node_ids.size
+            end
             UI.status("checking files")
-            store_files = verify_store
-            verify_files(file_linkrevs, file_node_ids, store_files)
+            timed_phase("files", "revisions") do
+              store_files = verify_store
+              verify_files(file_linkrevs, file_node_ids, store_files)
+              @result.revisions
+            end
             @result
           end
           
@@ -227,26 +247,129 @@ module Amp
           def verify_files(file_linkrevs, file_node_ids, store_files)
             files = (file_node_ids.keys + file_linkrevs.keys).uniq.sort
             @result.files = files.size
-            files.each do |file|
-              link_rev = file_linkrevs[file].first
-              
-              begin
-                file_log = @repository.file_log file 
-              rescue Exception => err
-                error(link_rev, "broken revlog! (#{err})", file)
-                next
+            
+            if @jobs > 1 && files.size > 1 && Process.respond_to?(:fork)
+              verify_files_in_workers(files, file_linkrevs, file_node_ids, store_files)
+            else
+              files.each do |file|
+                verify_file(file, file_linkrevs, file_node_ids, store_files)
               end
-              
-              file_log.files.each do |ff|
-                unless store_files.delete(ff)
-                  error(link_rev, "missing revlog!", ff)
+            end
+          end
+          
+          ##
+          # Verifies one file: that its revlogs are all in the store, and that
+          # its file log checks out.
+          #
+          # @param [String] file the name of the file to verify
+          # @see verify_files
+          def verify_file(file, file_linkrevs, file_node_ids, store_files)
+            link_rev = file_linkrevs[file].first
+            
+            begin
+              file_log = @repository.file_log file 
+            rescue Exception => err
+              error(link_rev, "broken revlog! (#{err})", file)
+              return
+            end
+            
+            file_log.files.each do |ff|
+              unless store_files.delete(ff)
+                error(link_rev, "missing revlog!", ff)
+              end
+            end
+            
+            verify_filelog(file, file_log, file_linkrevs, file_node_ids)
+          end
+          
+          ##
+          # Verifies the files using @jobs forked workers. Each worker inherits
+          # everything learned from the changelog and manifest, checks its share
+          # of the files, and sends back a partial result after each file - its
+          # messages, counts and bad revisions - which get merged in here as
+          # they arrive. Nothing is held back, so memory use doesn't grow with
+          # the number of files, though messages from different workers may
+          # come out interleaved.
+          #
+          # @see verify_files
+          def verify_files_in_workers(files, file_linkrevs, file_node_ids, store_files)
+            workers = {}
+            partition_files(files, file_node_ids).each do |share|
+              reader, writer = IO.pipe
+              pid = fork do
+                reader.close
+                run_worker(share, writer, file_linkrevs, file_node_ids, store_files)
+              end
+              writer.close
+              workers[reader] = pid
+            end
+            
+            until workers.empty?
+              ready, _, _ = IO.select(workers.keys)
+              ready.each do |reader|
+                begin
+                  merge_partial_result Marshal.load(reader)
+                rescue EOFError
+                  reader.close
+                  Process.waitpid workers.delete(reader)
+                  error(nil, "verification worker failed") unless $?.success?
                 end
               end
-              
-              verify_filelog(file, file_log, file_linkrevs, file_node_ids)
+            end
+          ensure
+            (workers || {}).each do |reader, pid|
+              Process.kill("TERM", pid) rescue nil
+              reader.close unless reader.closed?
             end
           end
           
+          ##
+          # The body of a worker process: verifies each file in its share,
+          # reporting back after each one, and exits without running any
+          # of the parent's exit hooks.
+          def run_worker(share, writer, file_linkrevs, file_node_ids, store_files)
+            share.each do |file|
+              @result = VerificationResult.new(0, 0, 0, 0, 0)
+              @bad_revisions, @messages = {}, []
+              verify_file(file, file_linkrevs, file_node_ids, store_files)
+              Marshal.dump([@messages, @result.errors, @result.warnings,
+                            @result.revisions, @bad_revisions.keys], writer)
+            end
+            writer.close
+            exit! 0
+          rescue Exception => err
+            Marshal.dump([["worker: #{err.class}: #{err}"], 1, 0, 0, []], writer) rescue nil
+            exit! 1
+          end
+          
+          ##
+          # Folds a worker's report on one file into our results.
+          def merge_partial_result(partial)
+            messages, errors, warnings, revisions, bad_revisions = partial
+            messages.each {|message| UI.say message }
+            @result.errors    += errors
+            @result.warnings  += warnings
+            @result.revisions += revisions
+            bad_revisions.each {|rev| @bad_revisions[rev] = true }
+          end
+          
+          ##
+          # Splits the files into @jobs shares of roughly equal work, going by
+          # how many revisions the manifests say each file has: the biggest
+          # file goes to the least-loaded share, and so on.
+          #
+          # @return [Array<Array<String>>] the files for each worker
+          def partition_files(files, file_node_ids)
+            shares = Array.new([@jobs, files.size].min) { [0, []] }
+            weighed = files.map {|file| [(file_node_ids[file] || {}).size + 1, file] }
+            weighed.sort {|a, b| b[0] <=> a[0] }.each do |weight, file|
+              share = shares.min {|a, b| a[0] <=> b[0] }
+              share[0] += weight
+              share[1] << file
+            end
+            shares.map {|weight, share| share }
+          end
+          
           ##
           # Verifies a single file log. This is a complicated process - we need to cross-
           # check a lot of data, which is why this has been extracted into its own method.
@@ -319,6 +442,21 @@ module Amp
           
           private
           
+          ##
+          # Runs one phase of the verification, and reports how long it took and
+          # how quickly it got through its work.
+          #
+          # @param [String] name the name of the phase
+          # @param [String] unit what the phase counts
+          # @yieldreturn [Integer] how many +unit+s the phase checked
+          def timed_phase(name, unit)
+            start = Time.now
+            count = yield
+            elapsed = Time.now - start
+            rate = elapsed > 0 ? count / elapsed : count
+            UI.status("#{name}: #{count} #{unit} in #{"%.2f" % elapsed}s (#{"%.1f" % rate}/s)")
+          end
+          
           ##
           # Checks a revlog for inconsistencies with the main format, such as
           # having trailing bytes or incorrect formats
@@ -419,7 +557,7 @@ module Amp
             end
             new_message = "#{revision}: #{message}"
             new_message = "#{filename}@#{new_message}" if filename
-            UI.say new_message
+            report new_message
             @result.errors += 1
           end
           
@@ -428,9 +566,18 @@ module Amp
           #
           # @param [String, #to_s] message the user's warning
           def warn(message)
-            UI.say "warning: #{message}"
+            report "warning: #{message}"
             @result.warnings += 1
           end
+          
+          ##
+          # Prints a message for the user - or, in a worker process, saves it to
+          # be sent back to the parent, which does the printing.
+          #
+          # @param [String] message the message to show
+          def report(message)
+            @messages ? @messages << message : UI.say(message)
+          end
         end
         
         ##
@@ -0,0 +1,69 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+require 'fileutils'
+
+module Amp
+  module Repositories
+    module Mercurial
+
+      ##
+      # = WatchState
+      # What a status that used the WatchServer needs to remember for the
+      # next one: the server's clock token from before the walk, a tag for
+      # the dirstate it was measured against, and the files that weren't
+      # clean. Next time, only those files and whatever the server saw
+      # change since the token need looking at - as long as the tag still
+      # matches.
+      #
+      # It's kept in .hg/cache/watchstate, as the token, the tag and the
+      # files, separated by NUL bytes.
+      class WatchState
+        attr_reader :token, :tag, :files
+
+        ##
+        # Reads the state saved at +path+.
+        #
+        # @param [String] path where the state is kept
+        # @return [WatchState, nil] the state, or nil if there isn't any
+        def self.load(path)
+          return nil unless File.exist? path
+          token, tag, *files = File.open(path, "rb") {|f| f.read }.split("\0")
+          token && tag ? new(token, tag, files) : nil
+        end
+
+        ##
+        # @param [String] token the WatchServer's token
+        # @param [String] tag identifies the dirstate the files were checked
+        #   against
+        # @param [Array<String>] files the files that weren't clean
+        def initialize(token, tag, files)
+          @token = token
+          @tag   = tag
+          @files = files
+        end
+
+        ##
+        # Saves the state.
+        #
+        # @param [String] path where to keep it
+        def write(path)
+          FileUtils.mkdir_p File.dirname(path)
+          File.open("#{path}.tmp", "wb") {|f| f.write(([@token, @tag] + @files).join("\0")) }
+          File.rename "#{path}.tmp", path
+        end
+      end
+    end
+  end
+end
@@ -43,6 +43,14 @@ module Amp
         DEFAULT_HEADERS = {"User-agent" => "Amp-#{Amp::VERSION}",
                            "Accept" => "Application/Mercurial-0.1"}
         
+        # Commands that can be sent to the server as part of a batch
+        BATCHABLE_COMMANDS = [:heads, :branches, :between, :lookup, :known]
+        # How many pairs go in each +between+ request
+        BETWEEN_BATCH_SIZE = 8
+        # Batches are sent in the query string, which servers limit in length,
+        # so bigger batches are split up
+        MAX_BATCH_QUERY_SIZE = 4.kb
+        
         ##
         # The URL we connect to for this repository
         attr_reader :url
@@ -92,7 +100,7 @@ module Amp
               end
             end
           rescue
-            @capabilities = []
+            @capabilities = {}
           end
           @capabilities
         end
@@ -111,11 +119,7 @@ module Amp
         # @return [String] the full node ID of the requested node on the remote server
         def lookup(key)
           require_capability("lookup", "Look up Remote Revision")
-          data = do_read("lookup", :key => key)[:body]
-          code, data = data.chomp.split(" ", 2)
-          
-          return data.unhexlify if code.to_i > 0
-          raise RepoError.new("Unknown Revision #{data}")
+          parse_lookup do_read("lookup", :key => key)[:body]
         end
         
         ##
@@ -124,8 +128,17 @@ module Amp
         # @return [Array<String>] the full, binary node_ids of all the heads on
         #   the remote server.
         def heads
-          data = do_read("heads")[:body]
-          data.chomp.split(" ").map {|h| h.unhexlify }
+          parse_heads do_read("heads")[:body]
+        end
+        
+        ##
+        # Asks which of the given nodes the server has.
+        #
+        # @param [Array<String>] nodes the binary node IDs to ask about
+        # @return [Array<Boolean>] whether the server has each node, in order
+        def known(nodes)
+          require_capability("known", "discover common changesets")
+          parse_known do_read("known", wire_args_for(:known, [nodes]))[:body]
         end
         
         ##
@@ -138,12 +151,8 @@ module Amp
         #   information for the branch.
         # @return [Array<Array<String>>] An array of arrays of strings. Each array
         #   has 4 components: [head, root, parent1, parent2].
-        def branches(nodes)
-          n = nodes.map {|n| n.hexlify }.join(" ")
-          data = do_read("branches", :nodes => n)[:body]
-          data.split("\n").map do |b|
-            b.split(" ").map {|b| b.unhexlify}
-          end
+        def branches(*nodes)
+          parse_branches do_read("branches", wire_args_for(:branches, nodes))[:body]
         end
         
         ##
@@ -187,6 +196,27 @@ module Amp
           s
         end
         
+        ##
+        # Asks the server to bundle up every node that's an ancestor of +heads+
+        # but not of +common+, uncompressed. This is for pulls that found the
+        # common nodes with {Graphs::Mercurial::Discovery}.
+        #
+        # @param [Array<String>] common the heads of what we share with the server
+        # @param [Array<String>] heads the heads we want to pull
+        # @param [NilClass] source (UNUSED)
+        # @return [StringIO] the uncompressed changegroup as a stream.
+        def get_bundle(common, heads, source)
+          require_capability 'getbundle', 'pull the missing changesets'
+          common_list = common.map {|n| n.hexlify }.join ' '
+          head_list   = heads.map {|n| n.hexlify }.join ' '
+          response    = do_read("getbundle", :common => common_list, :heads => head_list)
+          
+          s = StringIO.new "", Support.binary_mode("w+")
+          s.write Zlib::Inflate.inflate(response[:body])
+          s.rewind
+          s
+        end
+        
         ##
         # Sends a bundled up changegroup to the server, who will add it to its repository.
         # Uses the bundle format.
@@ -233,8 +263,28 @@ module Amp
           resp_code.to_i
         end
         
+        ##
+        # Asks the server for a raw copy of its store, for an uncompressed
+        # clone. The body is read by a background thread as it arrives, so we
+        # can be writing out one file while the next is still on the wire.
+        #
+        # @yield [stream] the response body
+        # @yieldparam [Amp::Support::QueuedReader] stream the body, as an IO-alike
+        # @return whatever the block returns
         def stream_out
-          do_cmd 'stream_out'
+          do_cmd 'stream_out' do |response|
+            stream = Amp::Support::QueuedReader.new do |sink|
+              response.read_body {|chunk| sink << chunk }
+            end
+            begin
+              result = yield stream
+            rescue Exception
+              stream.abort
+              raise
+            end
+            stream.close
+            result
+          end
         end
         
         ##
@@ -244,25 +294,63 @@ module Amp
         #   of strings. The first node is the head, the second node is the root of the pair.
         # @return [Array<Array<String>>] for each pair, we return 1 array, which contains
         #   the node IDs of every node between the pair.
-        # add lstrip to split_newlines to fix but not cure bug
         def between(pairs)
-          batch = 8
-          ret   = []
-          
-          (0..(pairs.size)).step(batch) do |i|
-            n = pairs[i..(i+batch-1)].map {|p| p.map {|k| k.hexlify }.join("-") }.join(" ")
-            resp = do_read("between", :pairs => n)
-            
-            raise RepoError.new("unexpected code: #{code}") unless resp[:code] == 200
-            
-            ret += resp[:body].lstrip.split_newlines.map {|l| (l && l.split(" ").map{|i| i.unhexlify }) || []}
+          calls = []
+          (0...pairs.size).step(BETWEEN_BATCH_SIZE) do |i|
+            calls << [:between, pairs[i, BETWEEN_BATCH_SIZE]]
           end
+          ret = batch(calls).inject([]) {|all, lists| all + lists }
           ret = [[]] if ret.empty?
           
           Amp::UI.debug "between returns: #{ret.inspect}"
           ret
         end
         
+        ##
+        # Runs several read-only commands in one round trip, if the server
+        # supports the batch command. Otherwise they're sent one at a time.
+        #
+        # @see Repository#batch
+        # @param [Array<Array>] calls each command to run, as the name of the
+        #   method followed by its arguments
+        # @return [Array] the results of each command, in order
+        def batch(calls)
+          return [] if calls.empty?
+          return super unless calls.all? {|command, *args| BATCHABLE_COMMANDS.include? command.to_sym }
+          
+          unless capable?("batch")
+            return calls.map do |command, *args|
+              resp = do_read(command.to_s, wire_args_for(command.to_sym, args))
+              raise RepoError.new("unexpected code: #{resp[:code]}") unless resp[:code] == 200
+              send "parse_#{command}", resp[:body]
+            end
+          end
+          
+          encoded = calls.map do |command, *args|
+            "#{command} #{Amp::Mercurial::Batch.encode_args wire_args_for(command.to_sym, args)}"
+          end
+          
+          bodies = []
+          batch_groups(encoded).each do |group|
+            resp = do_read("batch", :cmds => group.join(";"))
+            raise RepoError.new("unexpected code: #{resp[:code]}") unless resp[:code] == 200
+            bodies += resp[:body].split(";", -1).map {|body| Amp::Mercurial::Batch.unescape body }
+          end
+          
+          calls.zip(bodies).map {|(command, *args), body| send "parse_#{command}", body }
+        end
+
+        
+        ##
+        # Hangs up on the server. The next command will reconnect.
+        def close
+          @connection.finish if @connection && @connection.started?
+        rescue IOError
+          # already closed on their end
+        ensure
+          @connection = nil
+        end
+        
         private
         
         ##
@@ -273,8 +361,12 @@ module Amp
         # @param [String] command the command to send to the server, such as "heads"
         # @param [Hash] args the arguments you need to provide - for lookup, it
         #   might be the revision indicies.
-        # @return [String] the response data from the server.
-        def do_cmd(command, args={})
+        # @yield [response] if a block is given, a successful response is passed
+        #   to it before its body has been read, so the body can be streamed
+        # @yieldparam [Net::HTTPResponse] response the server's response
+        # @return [String] the response data from the server, or if a block was
+        #   given, what the block returned.
+        def do_cmd(command, args={}, &block)
           require 'net/http'
           
           # Be safe for recursive calls
@@ -289,20 +381,17 @@ module Amp
           query.merge! work_args
           
           # break it up, make a query
-          host = @url.host
           path = @url.path
-          # Was having trouble with this... should be safe now
-          path += "?" + URI.escape(query.map {|k,v| "#{k}=#{v}"}.join("&"), /[^-_!~*'()a-zA-Z\d;\/?:@&=+$,\[\]]/n)
+          # Each key and value is escaped on its own, so separators inside them
+          # (a batch's semicolons and equals signs, say) can't split the query
+          path += "?" + query.map {|k,v| [k, v].map {|s| URI.escape(s.to_s, /[^-_.!~*'()a-zA-Z\d]/n) }.join("=") }.join("&")
           
           # silly scoping
-          response = nil
-          # Create an HTTP object so we can send our request. static methods aren't flexible
-          # enough for us
-          sess = Net::HTTP.new host, @url.port
-          # Use SSL if necessary
-          sess.use_ssl = true if secure
-          # Let's send our request!
-          sess.start do |http|
+          response = result = nil
+          streaming = retried = false
+          # Let's send our request! The connection stays open for the next one.
+          begin
+            http = connection
             # if we have data, it's a POST
             if data
               req = Net::HTTP::Post.new(path)
@@ -323,7 +412,21 @@ module Amp
             # Then overwrite them (and add new ones) from our arguments
             headers.each {|k, v| req[k] = v}
             # And send the request!
-            response = http.request(req)
+            response = http.request(req) do |resp|
+              # the body can only be streamed while the connection's open
+              if block && resp.is_a?(Net::HTTPSuccess)
+                streaming = true
+                result = block.call(resp)
+              end
+            end
+          rescue EOFError, Errno::ECONNRESET, Errno::ECONNABORTED, Errno::EPIPE
+            # The server may have dropped our connection while it sat idle. We
+            # can't tell that apart from a real failure, so reconnect and try
+            # once more - unless repeating the request isn't safe.
+            close
+            raise if retried || data || streaming
+            retried = true
+            retry
           end
           # Case on response - we'll be using the kind_of? style of switch statement
           # here
@@ -336,7 +439,7 @@ module Amp
             @url.password = @password # Keep the old username/password combination.
             
             # and try that again.
-            do_cmd(command, args)
+            do_cmd(command, args, &block)
           when Net::HTTPUnauthorized
             if @auth_mode == :digest
               # no other handlers!
@@ -345,7 +448,7 @@ module Amp
               # failed to authenticate via basic, so escalate to digest mode
               @auth_mode = :digest
               @auth_digest = response
-              do_cmd command, args
+              do_cmd command, args, &block
             else
               # They want a username and password. A few routes:
               # First, check the URL for the username:password@host format
@@ -362,13 +465,96 @@ module Amp
               end
               
               # Recursively call the command
-              do_cmd command, args
+              do_cmd command, args, &block
             end
           else
-            response
+            if block && !response.is_a?(Net::HTTPSuccess)
+              raise RepoError.new("#{command} failed: HTTP #{response.code}")
+            end
+            block ? result : response
+          end
+        end
+        
+        ##
+        # The connection to the server. It's kept open between commands, since
+        # discovery alone can send hundreds of small requests, and there's no
+        # sense paying for a TCP (and maybe SSL) handshake on each. A new one
+        # is made if the server hangs up, or if we're redirected elsewhere.
+        #
+        # @return [Net::HTTP] an open HTTP session
+        def connection
+          key = [@url.host, @url.port, !!secure]
+          unless @connection && @connection.started? && @connection_key == key
+            close
+            sess = Net::HTTP.new @url.host, @url.port
+            # Use SSL if necessary
+            sess.use_ssl = true if secure
+            @connection, @connection_key = sess.start, key
+          end
+          @connection
+        end
+        
+        ##
+        # The query arguments the server needs for a command.
+        #
+        # @param [Symbol] command the command being sent
+        # @param [Array] args the arguments passed to the command's method
+        # @return [Hash] the query arguments
+        def wire_args_for(command, args)
+          case command
+          when :heads    then {}
+          when :lookup   then {:key => args.first}
+          when :branches then {:nodes => args.flatten.map {|n| n.hexlify }.join(" ")}
+          when :known    then {:nodes => args.first.map {|n| n.hexlify }.join(" ")}
+          when :between
+            {:pairs => args.first.map {|p| p.map {|k| k.hexlify }.join("-") }.join(" ")}
+          end
+        end
+        
+        ##
+        # Splits encoded batch commands into groups small enough to send in
+        # one query string each.
+        def batch_groups(encoded)
+          groups, size = [[]], 0
+          encoded.each do |cmd|
+            if size + cmd.size > MAX_BATCH_QUERY_SIZE && groups.last.any?
+              groups << []
+              size = 0
+            end
+            groups.last << cmd
+            size += cmd.size + 1
+          end
+          groups
+        end
+        
+        ##
+        # The parse_* methods turn the body of a command's response into what
+        # the command's method returns, whether it came alone or in a batch.
+        def parse_heads(body)
+          body.chomp.split(" ").map {|h| h.unhexlify }
+        end
+        
+        def parse_lookup(body)
+          code, data = body.chomp.split(" ", 2)
+          return data.unhexlify if code.to_i > 0
+          raise RepoError.new("Unknown Revision #{data}")
+        end
+        
+        def parse_branches(body)
+          body.split("\n").map do |b|
+            b.split(" ").map {|b| b.unhexlify}
           end
         end
         
+        def parse_known(body)
+          body.strip.split(//).map {|c| c == "1" }
+        end
+        
+        # add lstrip to split_newlines to fix but not cure bug
+        def parse_between(body)
+          body.lstrip.split_newlines.map {|l| (l && l.split(" ").map{|i| i.unhexlify }) || []}
+        end
+        
         ##
         # This is a helper for do_cmd - it splits up the response object into
         # two relevant parts: the response body, and the response code.
@@ -510,6 +510,16 @@ module Amp
           end
         end
         
+        ##
+        # Which of the given nodes do we have? Servers answer this for
+        # {Graphs::Mercurial::Discovery}.
+        #
+        # @param [Array<String>] nodes the node IDs to look for
+        # @return [Array<Boolean>] whether we have each node, in order
+        def known(nodes)
+          nodes.map {|node| changelog.node_map.include? node }
+        end
+        
         ##
         # Finds the nodes between two nodes - this algorithm is ported from the
         # python for mercurial (localrepo.py:1247, for 1.2.1 source). Since this
@@ -568,7 +578,9 @@ module Amp
               opts[:heads] = remote_heads
             end
             opts[:heads] ||= []
-            cg = if opts[:heads].empty?
+            cg = if sampling_discovery? remote
+                   remote.get_bundle common, opts[:heads], :pull
+                 elsif opts[:heads].empty?
                    remote.changegroup fetch, :pull
                  else
                    # check for capabilities
@@ -618,7 +630,8 @@ module Amp
           cnr        = nil # scoping
           heads      = nil # scoping
           
-          Amp::Mercurial::Journal.start(join('journal'), :opener => @store.opener) do |journal|
+          Amp::Mercurial::Journal.start(join('journal'), :opener   => @store.opener,
+                                                         :buffered => true) do |journal|
             UI::status 'adding changeset'
             
             # pull of the changeset group
@@ -682,7 +695,7 @@ module Amp
           if changesets > 0
             # forcefully update the on-disk branch cache
             UI::debug 'updating the branch cache'
-            branch_tags
+            update_branch_cache!
             run_hook :post_changegroup, :node => changelog.node_id_for_index(cor+1).hexlify, :source => type, :url => url
             
             ((cor+1)..(cnr+1)).to_a.each do |i|
@@ -708,6 +721,28 @@ module Amp
           changegroup_subset(base_nodes, heads, source)
         end
         
+        ##
+        # A changegroup of every node that's an ancestor of +new_heads+ but not
+        # of +common+ - what a client that's found the common nodes by
+        # sampling is missing.
+        #
+        # @param [Array<String>] common the heads of what the client has
+        # @param [Array<String>] new_heads the heads the client wants. All of
+        #   our heads, if empty.
+        # @param [Symbol] source how the changegroup's being sent
+        # @return [StringIO] the changegroup
+        def get_bundle(common, new_heads, source)
+          common    = [NULL_ID] if common.empty?
+          new_heads = heads if new_heads.empty?
+          missing   = changelog.find_missing common.dup, new_heads.dup
+          
+          missing_map = Hash.with_keys missing
+          roots = missing.reject do |node|
+            changelog.parents_for_node(node).any? {|p| missing_map[p] }
+          end
+          changegroup_subset roots, new_heads.dup, source
+        end
+        
         ##
         # Prints information about the changegroup we are going to receive.
         #
@@ -1306,6 +1341,10 @@ module Amp
         # @param [(Array<String>, Array<String>, Array<String>)] the common nodes, missing nodes, and
         #   remote heads
         def common_nodes(remote, opts={:heads => nil, :force => nil, :base => nil})
+          if sampling_discovery?(remote) && changelog.tip != NULL_ID
+            return sampled_common_nodes(remote, opts)
+          end
+          
           # variable prep!
           node_map = changelog.node_map
           search   = []
@@ -1397,8 +1436,11 @@ module Amp
               
               UI::debug "request #{count}: #{r.map{|i| short i }}"
               
-              (0 .. (r.size-1)).step(10) do |p|
-                remote.branches(r[p..(p+9)]).each do |b|
+              # ask about them 10 at a time, but all in the same round trip
+              calls = []
+              (0 .. (r.size-1)).step(10) {|p| calls << [:branches, r[p..(p+9)]] }
+              remote.batch(calls).each do |branches|
+                branches.each do |b|
                   UI::debug "received #{short b[0]}:#{short b[1]}"
                   unknown << b
                 end
@@ -1443,6 +1485,58 @@ module Amp
           [opts[:base].keys, fetch.keys, opts[:heads]]
         end
         
+        ##
+        # Can we find the common nodes with +remote+ by sampling? It has to
+        # answer +known+, and be able to bundle up what we're missing given
+        # just the common heads.
+        #
+        # @param [Repository] remote the repository we're comparing with
+        # @return [Boolean] should {#common_nodes} use
+        #   {Graphs::Mercurial::Discovery}?
+        def sampling_discovery?(remote)
+          !!(remote.capable?("known") && remote.capable?("getbundle"))
+        end
+        
+        ##
+        # {#common_nodes}, by sampling. The fetch list comes back as the
+        # unknown heads, rather than the roots of what's missing - pull them
+        # with +get_bundle+, which only needs the common heads.
+        #
+        # @see #common_nodes
+        def sampled_common_nodes(remote, opts)
+          node_map = changelog.node_map
+          opts[:base] ||= {}
+          
+          UI::status 'searching for changes'
+          discovery = Amp::Graphs::Mercurial::Discovery.new changelog, remote
+          common, remote_heads = discovery.run
+          common.each {|node| opts[:base][node] = true }
+          
+          heads   = opts[:heads] || remote_heads
+          unknown = heads.reject {|head| node_map.include? head }
+          
+          if common == [NULL_ID] && unknown.any?
+            if opts[:force]
+              UI::warn 'repository is unrelated'
+            else
+              raise RepoError.new('repository is unrelated')
+            end
+          end
+          
+          fetch = if unknown.empty?
+                    []
+                  elsif common == [NULL_ID]
+                    [NULL_ID]
+                  else
+                    unknown
+                  end
+          
+          UI::debug "found new heads #{unknown.map {|h| short h }.join ' '}"
+          UI::debug "#{discovery.round_trips} total queries"
+          
+          [opts[:base].keys, fetch, unknown]
+        end
+        
         ##
         # Returns the number of revisions the repository is tracking.
         # 
@@ -1598,10 +1692,12 @@ module Amp
         ##
         # The branches available in this repository.
         # 
-        # @param [Array<String>] nodes the list of nodes. this can be optionally left empty
+        # @param [Array<String>] nodes the list of nodes. this can be optionally left empty,
+        #   and may be given as one array
         # @return [Array<String>] the branches, active and inactive!
         def branches(*nodes)
           branches = []
+          nodes = nodes.flatten
           nodes = [changelog.tip] if nodes.empty?
           # for each node, find its first parent (adam and eve, basically)
           # -- that's our branch!
@@ -1736,15 +1832,20 @@ module Amp
           # if revlog format changes, client will have to check version
           # and format flags on "stream" capability, and use
           # uncompressed only if compatible.
-          if opts[:stream] && opts[:revs].any? && remote.capable?('stream')
+          if opts[:stream] && opts[:revs].empty? && remote.capable?('stream')
             stream_in remote
           else
             pull remote, :revs => opts[:revs]
           end
         end
         
+        # How much of a file stream_in copies at a time
+        STREAM_CHUNK_SIZE = 64.kb
+        
         ##
-        # Stream in the data from +remote+.
+        # Stream in the data from +remote+. Each file is copied a chunk at a
+        # time, straight from the wire to its revlog, so memory use doesn't
+        # depend on how big the files are.
         # 
         # @param [Amp::Repository] remote repository to pull from
         # @return [Integer] the number of heads in the repository minus 1
@@ -1752,8 +1853,8 @@ module Amp
           remote.stream_out do |f|
             l = f.gets # this should be the server code
             
-            unless Integer(l)
-              raise ResponseError.new("Unexpected response from server: #{l}")
+            unless l && l.strip =~ /^\d+$/
+              raise RepoError.new("Unexpected response from server: #{l}")
             end
             
             case l.to_i
@@ -1769,30 +1870,60 @@ module Amp
             total_files, total_bytes = *l.split(' ').map {|i| i.to_i }[0..1]
             UI::status "#{total_files} file#{total_files == 1 ? '' : 's' } to transfer, #{total_bytes.to_human} of data"
             
-            start = Time.now
+            start = last_report = Time.now
+            received = 0
             total_files.times do |i|
               l = f.gets
               name, size = *l.split("\0")[0..1]
               size = size.to_i
               UI::debug "adding #{name} (#{size.to_human})"
               
-              @store.opener.open do |store_file|
-                chunk = f.read size # will return nil if at EOF
-                store_file.write chunk if chunk
+              @store.opener.open(name, "w") do |store_file|
+                Amp::Support.preallocate store_file, size
+                left = size
+                while left > 0 && (chunk = f.read([left, STREAM_CHUNK_SIZE].min))
+                  store_file.write chunk
+                  left     -= chunk.size
+                  received += chunk.size
+                  
+                  if Time.now - last_report >= 1
+                    last_report = Time.now
+                    rate = received / (last_report - start)
+                    UI::status "#{received.to_human} of #{total_bytes.to_human} (#{rate.to_i.to_human}/sec)"
+                  end
+                end
+                raise RepoError.new("unexpected end of stream in #{name}") if left > 0
               end
             end
             
             elapsed = Time.now - start
             elapsed = 0.001 if elapsed <= 0
             
-            UI::status("transferred #{total_bytes.to_human} in #{elapsed}" +
-                       "second#{elapsed == 1.0 ? '' : 's' } (#{total_bytes.to_f / elapsed}/sec)")
+            UI::status("transferred #{total_bytes.to_human} in #{"%.1f" % elapsed} " +
+                       "second#{elapsed == 1.0 ? '' : 's' } (#{(total_bytes / elapsed).to_i.to_human}/sec)")
             
             invalidate!
             heads.size - 1
           end
         end
         
+        ##
+        # The files a streaming clone of this repository has to send, and how
+        # much of each. The store is only locked while the list is taken:
+        # revlogs are append-only, so copying the first +size+ bytes of each
+        # file afterward still gives a consistent repository, even if someone
+        # commits in the meantime. If someone else has the store locked, we
+        # don't wait for them - the client can try again.
+        #
+        # @raise [LockError] if the store is locked
+        # @return [Array<(String, String, Integer)>] for each file, its name,
+        #   its path relative to the store, and its size
+        def stream_out_entries
+          lock_store(false) do
+            store.walk.select {|name, path, size| size && size > 0 }
+          end
+        end
+        
         ##
         # Invalidate the repository: delete things and reset others.
         def invalidate!
@@ -81,6 +81,20 @@ module Amp
         # No-op, to be implemented by remote repo classes.
         def get_capabilities; end
         
+        ##
+        # Runs several read-only commands, returning each one's result. Remote
+        # repositories that can will send them all to the server at once, so
+        # the whole lot costs one round trip instead of one each.
+        #
+        # @example
+        #   heads, branches = repo.batch [[:heads], [:branches, nodes]]
+        # @param [Array<Array>] calls each command to run, as the name of the
+        #   method followed by its arguments
+        # @return [Array] the results of each command, in order
+        def batch(calls)
+          calls.map {|command, *args| send command, *args }
+        end
+        
         ##
         # Raises an exception if we don't have a given capability.
         # 
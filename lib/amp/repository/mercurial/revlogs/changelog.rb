@@ -171,8 +171,143 @@ module Amp
     class ChangeLog < Revlog
       attr_accessor :delay_count, :delay_name, :index_file, :delay_buffer, :node_map
       
-      class ChangelogEntry < Struct.new(:manifest_node, :user, :time, :files, :description, :extra)
+      ##
+      # = ChangelogEntry
+      # One revision of the changelog: the manifest node, user, [time, timezone],
+      # files, description and extra data. Can be indexed like the array it used
+      # to be (entry[0] is the manifest node, and so on).
+      #
+      # Entries read from the changelog hold on to the revision's raw text, and
+      # only decode a field the first time it's asked for - most callers only
+      # want one or two of them.
+      class ChangelogEntry
+        include Enumerable
+        
+        FIELDS = [:manifest_node, :user, :time, :files, :description, :extra]
+        
+        ##
+        # Makes an entry that decodes its fields from a changelog revision's
+        # text, as they're needed. Only the line breaks of the header are found
+        # up front.
+        #
+        # @param [String] text the decompressed revision
+        # @return [ChangelogEntry] the entry for the revision
+        def self.parse(text)
+          entry = allocate
+          entry.send :parse_lazily, text
+          entry
+        end
+        
+        ##
+        # Decodes the extra data stored with the commit.
+        #
+        # @param [String] text the extra data, as stored after the date
+        # @return [Hash] the key-value pairs
+        def self.decode_extra(text)
+          extra = {}
+          text.split("\0").select {|l| l.any? }.
+                           map {|l| l.remove_slashes.split(":",2) }.
+                           each {|k,v| extra[k]=v }
+          extra
+        end
+        
+        ##
+        # Makes an entry out of already-decoded fields.
+        def initialize(manifest_node, user, time, files, description, extra)
+          @fields = {:manifest_node => manifest_node, :user => user, :time => time,
+                     :files => files, :description => description, :extra => extra}
+        end
+        
+        FIELDS.each do |name|
+          class_eval "def #{name}; field(#{name.inspect}); end"
+        end
         alias_method :desc, :description
+        
+        ##
+        # The branch the revision was committed on.
+        def branch
+          extra["branch"]
+        end
+        
+        ##
+        # Looks up a field by position (as in the old array format) or name.
+        def [](key)
+          key = FIELDS[key] if key.is_a?(Integer)
+          key && FIELDS.include?(key.to_sym) ? field(key.to_sym) : nil
+        end
+        
+        def to_a
+          FIELDS.map {|name| field(name) }
+        end
+        alias_method :values, :to_a
+        
+        def each(&block)
+          to_a.each(&block)
+          self
+        end
+        
+        def ==(other)
+          other.is_a?(ChangelogEntry) && to_a == other.to_a
+        end
+        
+        def inspect
+          "#<#{self.class.name} #{FIELDS.map {|f| "#{f}=#{field(f).inspect}" }.join(", ")}>"
+        end
+        
+        private
+        
+        def parse_lazily(text)
+          @fields = {}
+          @text = text
+          # the header is the manifest, user and date lines, then one line
+          # per file, then a blank line before the description.
+          @header_end = text.index("\n\n")
+          @user_start = text.index("\n") + 1
+          @date_start = text.index("\n", @user_start) + 1
+          @files_start = (text.index("\n", @date_start) || @header_end) + 1
+        end
+        
+        def field(name)
+          @fields.fetch(name) { @fields[name] = send("decode_#{name}") }
+        end
+        
+        def decode_manifest_node
+          @text[0, @user_start - 1].unhexlify
+        end
+        
+        def decode_user
+          @text[@user_start, @date_start - @user_start - 1] #TODO: encoding
+        end
+        
+        ##
+        # The date line has the time and timezone, and sometimes the extra
+        # data - so we decode both at once.
+        def decode_date_line
+          date_line = @text[@date_start, @files_start - @date_start - 1]
+          time, timezone, extra = date_line.split(' ', 3)
+          extra = extra ? self.class.decode_extra(extra) : {}
+          extra["branch"] ||= "default"
+          @fields[:extra] = extra
+          @fields[:time]  = [time.to_f, timezone.to_i]
+        end
+        
+        def decode_time
+          decode_date_line
+        end
+        
+        def decode_extra
+          decode_date_line
+          @fields[:extra]
+        end
+        
+        def decode_files
+          return [] if @files_start > @header_end
+          @text[@files_start, @header_end - @files_start].split("\n")
+        end
+        
+        def decode_description
+          @text[@header_end + 2..-1] #TODO: encoding
+        end
       end
       
       ##
@@ -265,11 +400,7 @@ module Amp
       # @param [String] text the data in the revision, decompressed
       # @return [Hash] key-value pairs, joining each file with its extra data
       def decode_extra(text)
-        extra = {}
-        text.split("\0").select {|l| l.any? }.
-                         map {|l| l.remove_slashes.split(":",2) }.
-                         each {|k,v| extra[k]=v }
-        extra
+        ChangelogEntry.decode_extra text
       end
       
       ##
@@ -285,38 +416,54 @@ module Amp
       # that tells us everything about the revision - the manifest_entry, the user
       # who committed it, timestamps, the relevant filenames, the description
       # message, and any extra data.
+      #
+      # Only the revision's text is read here - each field is decoded the first
+      # time it's used.
       # 
       # @todo Text encodings, I hate you. but i must do them
       # @param [Fixnum] node the node ID to lookup into the revision log
-      # @return [(String, String, [Float, Integer], [String], String, Hash)]
-      #   The format is [ManifestEntry, Username, [Time, Timezone], [Filenames],
-      #   Message, ExtraData].
+      # @return [ChangelogEntry] The format is [ManifestEntry, Username,
+      #   [Time, Timezone], [Filenames], Message, ExtraData].
       def read(node)
         text = decompress_revision node
         if text.nil? || text.empty?
           return ChangelogEntry.new(NULL_ID, "", [0,0], [], "", {"branch" => "default"})
         end
-        #p text
-        last = text.index("\n\n")
-        desc = text[last+2..-1] #TODO: encoding
-        l = text[0..last].split("\n")
-        manifest = l[0].unhexlify
-        user = l[1] #TODO: encoding
-        extra_data = l[2].split(' ', 3)
-        if extra_data.size != 3
-          time = extra_data.shift.to_f
-          timezone = extra_data.shift.to_i
-          extra = {}
-        else
-          time, timezone, extra = extra_data
-          time, timezone = time.to_f, timezone.to_i
-          extra = decode_extra extra
+        ChangelogEntry.parse text
+      end
+      
+      ##
+      # Decodes a single field of every revision in a range, without decoding
+      # anything else about them.
+      # 
+      # @example changelog.each_field(:user, 0..10) {|index, user| ... }
+      # @param [Symbol] field the field to decode (see {ChangelogEntry::FIELDS}),
+      #   or :branch
+      # @param [Range, Array<Fixnum>] indices the revisions to look at
+      # @yield [index, value] each revision's index, and its value for the field
+      # @return [Array] the values, in order, if no block is given
+      def each_field(field, indices = 0...self.size)
+        field = field.to_sym
+        unless field == :branch || ChangelogEntry::FIELDS.include?(field)
+          raise ArgumentError.new("Unknown changelog field: #{field}")
         end
-        extra["branch"] ||= "default"
         
-        files = l[3..-1]
-              
-        ChangelogEntry.new(manifest, user, [time, timezone], files, desc, extra)
+        values = []
+        indices.each do |index|
+          value = read(node_id_for_index(index)).send field
+          block_given? ? yield(index, value) : values << value
+        end
+        block_given? ? self : values
+      end
+      
+      ##
+      # Looks up just the branch a revision was committed on, without
+      # decoding the rest of its ChangelogEntry.
+      # 
+      # @param [Fixnum] index the revision's index in the changelog
+      # @return [String] the name of the revision's branch
+      def branch_for_index(index)
+        read(node_id_for_index(index)).branch
       end
       
       ##
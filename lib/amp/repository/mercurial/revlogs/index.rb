@@ -330,6 +330,7 @@ module Amp
           
           journal << {:file => data_file,  :offset => offset}
           journal << {:file => index_file, :offset => curr * entry.size}
+          journal.flush
           
           data_file_handle.write data[:compression] if data[:compression].any?
           data_file_handle.write data[:text]
@@ -469,23 +470,29 @@ module Amp
           
           entry = pack_entry entry, link
           
+          index_file_handle ||= (opened = true && @opener.open(index_file, "a+"))
+          # append-mode handles report 0 until their first write, so find the
+          # end ourselves: the journal needs the offsets up front
+          index_file_handle.seek(0, IO::SEEK_END)
+          offset = index_file_handle.tell
+          
           @opener.open(data_file, "a+") do |data_file_handle|
+            data_file_handle.seek(0, IO::SEEK_END)
             data_offset = data_file_handle.tell
             
+            # both truncation points have to hit the journal before either
+            # file grows
+            journal << {:file => data_file, :offset => data_offset, :data => curr}
+            journal << {:file => index_file, :offset => offset, :data => curr}
+            journal.flush
+            
             data_file_handle.write data[:compression] if data[:compression].any?
             data_file_handle.write data[:text]
             data_file_handle.flush
-            
-            journal << {:file => data_file, :offset => data_offset, :data => curr}
           end
           
-          index_file_handle ||= (opened = true && @opener.open(index_file, "a+"))
-          
-          offset = index_file_handle.tell
           index_file_handle.write entry
           index_file_handle.close if opened
-          
-          journal << {:file => index_file, :offset => offset, :data => curr}
         end
     
         def fix_first_entry!
@@ -644,16 +651,17 @@ module Amp
           
           index_file_handle ||= (opened = true && @opener.open(index_file, "a+"))
           
+          index_file_handle.seek(0, IO::SEEK_END)
           offset = index_file_handle.tell
           
+          journal << {:file => index_file, :offset => offset, :data => curr}
+          journal.flush
+          
           index_file_handle.write entry
           index_file_handle.write data[:compression] if data[:compression].any?
           index_file_handle.write data[:text]
           
           index_file_handle.close if opened
-          
-          journal << {:file => index_file, :offset => offset, :data => curr}
-          
         end
         
       end
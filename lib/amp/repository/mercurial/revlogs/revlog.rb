@@ -576,6 +576,26 @@ module Amp
         data_file
       end
       
+      ##
+      # Reads the data for a run of revisions into the cache in one go, so
+      # get_chunk finds them there instead of going back to the file for each
+      # one. Handy for walking backwards, since get_chunk only ever caches
+      # forward from the revision it's asked for. The range is widened to
+      # include the bases of the revisions' delta chains.
+      # 
+      # @param [Fixnum] first the index of the first revision to load
+      # @param [Fixnum] last the index of the last revision to load
+      def prefetch_chunks(first, last)
+        first = (first..last).map {|rev| self[rev].base_rev }.push(first).min
+        start = data_start_for_index first
+        endpt = data_end_for_index last
+        if @index.inline?
+          start += (first + 1) * @index.entry_size
+          endpt += (last + 1) * @index.entry_size
+        end
+        load_cache(nil, start, endpt - start).close
+      end
+      
       ##
       # Gets a chunk of data from the datafile (or, if inline, from the index
       # file). Just give it a revision index and which data file to use
@@ -867,6 +887,7 @@ module Amp
           journal << {:file => @data_file,  :offset => endpt}
           data_file_handle = open(@data_file, "a")
         end
+        journal.flush
         
         begin #errors abound here i guess
           chain = nil
@@ -16,6 +16,15 @@ module Amp
   module Repositories
     class RepoError < StandardError; end
     
+    class << self
+      ##
+      # An optional cache of opened repositories, keyed by path. Only
+      # long-running processes (such as the command server) set this.
+      #
+      # @return [#[], #[]=, nil] the cache, if there is one
+      attr_accessor :cache
+    end
+    
     ##
     # Picks a repository provided a user configuration, a path, and whether
     # we have permission to create the repository.
@@ -28,8 +37,16 @@ module Amp
     # Note: this does NOT handle when there are two types of repositories in
     # a given directory.
     def self.pick(config, path='', create=false)
+      if cache && !create && (repo = cache[path])
+        return repo
+      end
+      
       GenericRepoPicker.each do |picker|
-        return picker.pick(config, path, create) if picker.repo_in_dir?(path)
+        next unless picker.repo_in_dir?(path)
+        
+        repo = picker.pick(config, path, create)
+        cache[path] = repo if cache
+        return repo
       end
       
       # We have found... nothing
@@ -0,0 +1,260 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+require 'digest/sha1'
+require 'fileutils'
+require 'thread'
+require 'zlib'
+
+module Amp
+  module Servers
+
+    ##
+    # = BundleCache
+    # Keeps the compressed changegroups the server sends out, on disk, so
+    # that when a crowd of clients pulls the same new changesets after a
+    # push, the bundle is only built once.
+    #
+    # Bundles are keyed by the kind of request, its bases and heads, and the
+    # repository's tip - so any new commit makes every old bundle stale, and
+    # they're thrown out the next time the cache is used.
+    #
+    # The first request for a bundle starts building it in the background,
+    # into a file. Every request for it, including that first one, streams
+    # the file as it grows, so nobody waits for the whole bundle, and a
+    # client hanging up doesn't stop the build for the others.
+    class BundleCache
+      CHUNK_SIZE = 64.kb
+      # Part of the key, in case bundles are ever compressed differently
+      COMPRESSION = "deflate"
+
+      @caches = {}
+      @caches_lock = Mutex.new
+
+      ##
+      # The cache for a repository, shared by every request for it.
+      #
+      # @param [Repository] repo the repository being served
+      # @return [BundleCache] the repository's bundle cache
+      def self.for(repo)
+        @caches_lock.synchronize do
+          @caches[repo.root] ||= new(File.join(repo.hg, "cache", "bundles"))
+        end
+      end
+
+      ##
+      # @param [String] dir where to keep the bundles
+      def initialize(dir)
+        @dir     = dir
+        @entries = {}
+        @tip     = nil
+        @lock    = Mutex.new
+      end
+
+      ##
+      # Gets a bundle, building it if nobody has yet.
+      #
+      # @param [Repository] repo the repository being served
+      # @param [Symbol] kind the kind of request (:changegroup, say)
+      # @param [Array<String>] bases the binary node IDs the bundle starts from
+      # @param [Array<String>] heads the binary node IDs it goes up to
+      # @yield builds the bundle, if it isn't cached
+      # @yieldreturn [IO] the uncompressed bundle
+      # @return [Entry::Reader] a Rack body that streams the compressed
+      #   bundle. The file is already open, so the bundle can't be expired
+      #   out from under it.
+      def fetch(repo, kind, bases, heads, &generator)
+        tip = repo.changelog.tip.hexlify
+        key = Digest::SHA1.hexdigest([kind, COMPRESSION, tip,
+                                      bases.map {|n| n.hexlify }.sort.join(","),
+                                      heads.map {|n| n.hexlify }.sort.join(",")].join(" "))
+        @lock.synchronize do
+          expire! tip unless @tip == tip
+          entry = @entries[key]
+          if entry.nil? || entry.failed?
+            entry = @entries[key] = Entry.new(File.join(@dir, "#{tip[0, 12]}-#{key}"))
+            unless entry.complete?
+              FileUtils.mkdir_p @dir
+              entry.start(&generator)
+            end
+          end
+          entry.open
+        end
+      end
+
+      private
+
+      ##
+      # Forgets the bundles for the old tip, and deletes their files. Bundles
+      # still being built are left to finish for whoever's reading them.
+      def expire!(tip)
+        @tip = tip
+        @entries.delete_if {|key, entry| entry.done? }
+        building = @entries.values.map {|entry| entry.partial_path }
+        Dir[File.join(@dir, "*")].each do |path|
+          next if File.basename(path).index(tip[0, 12]) == 0 || building.include?(path)
+          File.unlink path rescue nil
+        end
+      end
+
+      ##
+      # = Entry
+      # One bundle: the background build writing it, and the requests
+      # reading it. Readers follow the file as it's written, waiting whenever
+      # they catch up with the writer.
+      class Entry
+        ##
+        # = Reader
+        # One request's view of a bundle: an open handle on its file, which
+        # stays readable even if the cache deletes the file meanwhile.
+        class Reader
+          def initialize(entry, file)
+            @entry, @file = entry, file
+          end
+
+          ##
+          # For Rack compliance. Streams the compressed bundle.
+          def each(&block)
+            @entry.follow @file, &block
+          ensure
+            close
+          end
+
+          ##
+          # For Rack compliance. Called even if #each never was.
+          def close
+            @file.close unless @file.closed?
+          end
+        end
+
+        # Where the bundle is written while it's being built
+        attr_reader :partial_path
+
+        ##
+        # @param [String] path where the finished bundle is kept
+        def initialize(path)
+          @path    = path
+          @partial_path = path + ".partial"
+          @done    = File.exist?(path)
+          @size    = @done ? File.size(path) : 0
+          @error   = nil
+          @lock    = Mutex.new
+          @written = ConditionVariable.new
+        end
+
+        ##
+        # Has the build finished, one way or another?
+        def done?
+          @done
+        end
+
+        ##
+        # Has the bundle been built?
+        def complete?
+          @done && @error.nil?
+        end
+
+        ##
+        # Did building the bundle fail?
+        def failed?
+          @done && !@error.nil?
+        end
+
+        ##
+        # Starts building the bundle in the background. The file is created
+        # right away, so readers can open it before the build gets going.
+        #
+        # @yieldreturn [IO] the uncompressed bundle
+        def start(&generator)
+          file = File.open(@partial_path, "wb")
+          Thread.new { generate(file, &generator) }
+        end
+
+        ##
+        # Opens the bundle for reading - the finished file, or the one being
+        # built, if it isn't finished yet.
+        #
+        # @return [Reader] a Rack body that streams the bundle
+        def open
+          @lock.synchronize do
+            raise @error if @error
+            Reader.new self, File.open(@done ? @path : @partial_path, "rb")
+          end
+        end
+
+        ##
+        # Streams the compressed bundle from an open file, waiting for the
+        # build to catch up whenever we get ahead of it.
+        #
+        # @param [File] file the bundle, from #open
+        # @yield [chunk] each piece of the bundle, in order
+        def follow(file)
+          position = 0
+          loop do
+            available = @lock.synchronize do
+              @written.wait(@lock) while @size == position && !@done
+              raise @error if @error
+              @size
+            end
+            break if available == position
+
+            chunk = file.read([available - position, CHUNK_SIZE].min)
+            position += chunk.size
+            yield chunk
+          end
+        end
+
+        private
+
+        ##
+        # Builds the bundle, compressing what the block returns into the
+        # file.
+        def generate(file)
+          deflater = Zlib::Deflate.new
+          source   = yield
+          while (chunk = source.read(CHUNK_SIZE)) && !chunk.empty?
+            wrote file, deflater.deflate(chunk)
+          end
+          wrote file, deflater.finish
+          file.close
+          @lock.synchronize do
+            File.rename @partial_path, @path
+            @done = true
+            @written.broadcast
+          end
+        rescue Exception => err
+          file.close unless file.closed?
+          @lock.synchronize do
+            # before anyone can see we're done, and start a new build there
+            File.unlink @partial_path rescue nil
+            @error, @done = err, true
+            @written.broadcast
+          end
+        end
+
+        ##
+        # Writes a piece of the bundle, and wakes up any readers waiting for it.
+        def wrote(file, data)
+          return if data.empty?
+          file.write data
+          file.flush
+          @lock.synchronize do
+            @size += data.size
+            @written.broadcast
+          end
+        end
+      end
+    end
+  end
+end
@@ -0,0 +1,218 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+# This file is loaded by the thin client (bin/ampc) *without* the rest of
+# amp, so it must not depend on anything outside the standard library.
+
+module Amp
+  module Servers
+
+    ##
+    # = CommandChannel
+    # The wire format spoken between the command server and its clients.
+    # Everything travels in frames: a one-byte channel name, a 4-byte
+    # big-endian payload length, and the payload itself.
+    #
+    # Client to server:
+    #   'R' - the request: the working directory, then each argument,
+    #         separated by NUL bytes. Always the first frame.
+    #   'i' - stdin data, in reply to an 'I' frame. Empty means EOF.
+    #
+    # Server to client:
+    #   'o' - data for stdout
+    #   'e' - data for stderr
+    #   'I' - the command wants stdin. The payload is the number of bytes
+    #         wanted, packed as a 4-byte integer.
+    #   'r' - the command finished. The payload is the exit status, packed
+    #         as a 4-byte integer. Always the last frame.
+    class CommandChannel
+      HEADER_FORMAT = "aN"
+      HEADER_SIZE   = 5
+
+      attr_reader :socket
+
+      def initialize(socket)
+        @socket = socket
+      end
+
+      ##
+      # Writes a single frame.
+      #
+      # @param [String] channel the one-letter channel name
+      # @param [String] data the payload
+      def write_frame(channel, data="")
+        data = CommandChannel.binary data
+        @socket.write([channel, data.bytesize].pack(HEADER_FORMAT) + data)
+        @socket.flush
+      end
+
+      ##
+      # A copy of +data+ as raw bytes, so lengths are counted in bytes and
+      # it can be joined to other binary strings, whatever its encoding.
+      #
+      # @param [String] data the string
+      # @return [String] the same bytes, with no encoding
+      def self.binary(data)
+        data = data.dup
+        data.force_encoding("BINARY") if data.respond_to? :force_encoding
+        data
+      end
+
+      ##
+      # Reads a single frame, blocking until it's all here.
+      #
+      # @return [[String, String], nil] the channel and the payload, or nil
+      #   if the other side hung up
+      def read_frame
+        header = @socket.read HEADER_SIZE
+        return nil if header.nil? || header.size < HEADER_SIZE
+        channel, length = header.unpack(HEADER_FORMAT)
+        data = length > 0 ? @socket.read(length) : ""
+        return nil if data.nil? || data.size < length
+        [channel, data]
+      end
+
+      ##
+      # Packs a request for the server.
+      #
+      # @param [String] cwd the directory to run the command in
+      # @param [Array<String>] argv the command-line arguments
+      # @return [String] the payload of an 'R' frame
+      def self.pack_request(cwd, argv)
+        ([cwd] + argv).join("\0")
+      end
+
+      ##
+      # Unpacks a request from a client.
+      #
+      # @param [String] payload the payload of an 'R' frame
+      # @return [[String, Array<String>]] the working directory and arguments
+      def self.unpack_request(payload)
+        cwd, *argv = payload.split("\0", -1)
+        [cwd, argv]
+      end
+
+      ##
+      # An IO-alike that ships everything written to it off over one channel.
+      # This is what $stdout and $stderr become while a command runs.
+      class Writer
+        def initialize(channel, name)
+          @channel, @name = channel, name
+        end
+
+        def write(data)
+          data = data.to_s
+          @channel.write_frame @name, data unless data.empty?
+          data.bytesize
+        end
+
+        def <<(data)
+          write data
+          self
+        end
+
+        def print(*args)
+          args.each {|arg| write arg }
+          nil
+        end
+
+        def puts(*args)
+          return write("\n") && nil if args.empty?
+          args.flatten.each do |arg|
+            line = arg.to_s
+            write(line.end_with?("\n") ? line : line + "\n")
+          end
+          nil
+        end
+
+        def printf(*args)
+          write sprintf(*args)
+          nil
+        end
+
+        def flush; self; end
+        def sync; true; end
+        def sync=(value); end
+        def tty?; false; end
+        alias_method :isatty, :tty?
+        def fileno; nil; end
+      end
+
+      ##
+      # An IO-alike that asks the client for data whenever it's read from.
+      # This is what $stdin becomes while a command runs.
+      class Reader
+        CHUNK_SIZE = 4096
+
+        def initialize(channel)
+          @channel = channel
+          @buffer  = CommandChannel.binary ""
+          @eof     = false
+        end
+
+        ##
+        # Reads up to +length+ bytes, or everything up to EOF if no length
+        # is given.
+        def read(length=nil)
+          if length
+            fill until @eof || @buffer.size >= length
+            return nil if @buffer.empty? && length > 0
+            @buffer.slice!(0, length)
+          else
+            fill until @eof
+            @buffer.slice!(0, @buffer.size)
+          end
+        end
+
+        ##
+        # Reads a line, including its newline.
+        def gets
+          fill until @eof || @buffer.index("\n")
+          return nil if @buffer.empty?
+          newline = @buffer.index("\n")
+          @buffer.slice!(0, newline ? newline + 1 : @buffer.size)
+        end
+
+        def each_line
+          while line = gets
+            yield line
+          end
+        end
+        alias_method :each, :each_line
+
+        def eof?
+          fill if @buffer.empty? && !@eof
+          @buffer.empty? && @eof
+        end
+
+        def tty?; false; end
+        alias_method :isatty, :tty?
+
+        private
+
+        ##
+        # Asks the client for another chunk of stdin.
+        def fill
+          @channel.write_frame 'I', [CHUNK_SIZE].pack("N")
+          channel, data = @channel.read_frame
+          if channel != 'i' || data.empty?
+            @eof = true
+          else
+            @buffer << data
+          end
+        end
+      end
+    end
+  end
+end
@@ -0,0 +1,201 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+require 'socket'
+need { 'command_channel' }
+
+module Amp
+  module Servers
+
+    ##
+    # = CommandServer
+    # Runs amp commands on behalf of thin clients (bin/ampc) connecting over
+    # a unix socket. Amp's code, the commands, and any repositories the
+    # commands open stay loaded between requests, so a client pays for
+    # neither Ruby's startup nor re-parsing the changelog and dirstate.
+    #
+    # Requests are handled one at a time: commands use $stdout, ARGV and the
+    # current directory, none of which can be shared.
+    #
+    # @see CommandChannel for the wire protocol
+    class CommandServer
+
+      ##
+      # Repositories opened by commands run in the server, keyed by the path
+      # they were picked with. A cached repository is thrown out as soon as
+      # any of the files it was read from changes on disk.
+      class RepositoryCache
+        # The files whose stat data decide whether a cached repository is
+        # still good, relative to the repository's root.
+        SIGNATURE_FILES = %w(.hg/requires .hg/hgrc .hg/dirstate .hg/branch
+                             .hg/localtags .hg/branchheads.cache
+                             .hg/store/00changelog.i .hg/store/00manifest.i
+                             .hg/store/fncache .git/HEAD .git/index
+                             .git/packed-refs .git/config)
+
+        def initialize
+          @repos = {}
+        end
+
+        ##
+        # Looks up the repository last picked for +path+, as long as nothing
+        # it depends on has changed since.
+        #
+        # @param [String] path the path the repository was picked with
+        # @return [AbstractLocalRepository, nil] the repository, if it's fresh
+        def [](path)
+          repo, signature = @repos[path]
+          return nil unless repo
+          return repo if signature == signature_for(repo.root)
+
+          @repos.delete path
+          nil
+        end
+
+        ##
+        # Remembers a freshly picked repository. Only local repositories are
+        # kept - there's no mtime to check for a remote one.
+        #
+        # @param [String] path the path the repository was picked with
+        # @param [AbstractLocalRepository] repo the repository
+        def []=(path, repo)
+          return unless repo.respond_to?(:local?) && repo.local?
+          @repos[path] = [repo, signature_for(repo.root)]
+        end
+
+        ##
+        # Forgets every repository.
+        def clear
+          @repos.clear
+        end
+
+        private
+
+        ##
+        # Inode, size and mtime of each signature file. The inode is what
+        # catches atomic rewrites landing within the same mtime tick.
+        def signature_for(root)
+          SIGNATURE_FILES.map do |file|
+            begin
+              stat = File.stat File.join(root, file)
+              [stat.ino, stat.size, stat.mtime.to_f]
+            rescue Errno::ENOENT, Errno::ENOTDIR
+              nil
+            end
+          end
+        end
+      end
+
+      attr_reader :socket_path
+
+      ##
+      # @param [String] socket_path where to create the unix socket
+      def initialize(socket_path)
+        @socket_path = File.expand_path socket_path
+      end
+
+      ##
+      # Listens for clients until interrupted.
+      def run!
+        Repositories.cache = RepositoryCache.new
+        File.unlink @socket_path if File.socket? @socket_path
+        server = UNIXServer.new @socket_path
+        File.chmod 0600, @socket_path
+
+        UI.status "command server listening on #{@socket_path}"
+        trap("INT")  { server.close }
+        trap("TERM") { server.close }
+
+        loop do
+          begin
+            client = server.accept
+          rescue IOError, Errno::EBADF
+            break # closed by a signal
+          end
+
+          begin
+            serve client
+          rescue Errno::EPIPE, Errno::ECONNRESET
+            # the client went away mid-command; nothing to report it to
+          ensure
+            client.close unless client.closed?
+          end
+        end
+      ensure
+        Repositories.cache = nil
+        File.unlink @socket_path if File.socket? @socket_path
+      end
+
+      ##
+      # Runs one client's command and sends back its exit status.
+      #
+      # @param [UNIXSocket] socket the connected client
+      # @raise [Errno::EPIPE, Errno::ECONNRESET] if the client hangs up
+      def serve(socket)
+        channel = CommandChannel.new socket
+        type, payload = channel.read_frame
+        return unless type == 'R'
+
+        cwd, argv = CommandChannel.unpack_request payload
+        status = run_command channel, cwd, argv
+        channel.write_frame 'r', [status].pack("N") if status.is_a? Integer
+      end
+
+      ##
+      # Runs a command as if from the command line, with its input and output
+      # redirected over the channel.
+      #
+      # @param [CommandChannel] channel the client's channel
+      # @param [String] cwd the client's working directory
+      # @param [Array<String>] argv the client's arguments
+      # @return [Integer] the exit status
+      # @raise [Errno::EPIPE, Errno::ECONNRESET] if the client hangs up
+      def run_command(channel, cwd, argv)
+        saved = [$stdout, $stderr, $stdin, ARGV.dup, Dir.pwd]
+        $stdout = CommandChannel::Writer.new channel, 'o'
+        $stderr = CommandChannel::Writer.new channel, 'e'
+        $stdin  = CommandChannel::Reader.new channel
+        $break  = false
+        ARGV.replace argv
+        Dir.chdir cwd
+
+        status = Dispatch.run ? 0 : 1
+      rescue SystemExit => e # Trollop exits on --help and bad options
+        status = e.status
+      rescue Errno::EPIPE, Errno::ECONNRESET
+        raise
+      rescue Exception => e
+        $stderr.puts "#{e.class}: #{e}"
+        status = 255
+      ensure
+        # a command that didn't finish may have left half-updated state
+        # in memory
+        Repositories.cache.clear if Repositories.cache && status != 0
+        $stdout, $stderr, $stdin = saved[0], saved[1], saved[2]
+        ARGV.replace saved[3]
+        Dir.chdir saved[4]
+      end
+
+      ##
+      # The socket used when none is given: one per repository, inside its
+      # metadata directory.
+      #
+      # @param [AbstractLocalRepository] repo the repository being served
+      # @return [String] the path to the socket
+      def self.default_socket_for(repo)
+        repo.join "cmdserver.sock"
+      end
+    end
+  end
+end
@@ -71,8 +71,10 @@ module Sinatra
     end
     
     # All the commands we are capable of accepting
-    ACCEPTABLE_COMMANDS = [ 'branches', 'heads', 'lookup', 'capabilities', 'between', 'changegroup', 'changegroupsubset', 'unbundle' ]
-    READABLE_COMMANDS   = [ 'branches', 'heads', 'lookup', 'capabilities', 'between', 'changegroup', 'changegroupsubset' ]
+    ACCEPTABLE_COMMANDS = [ 'batch', 'branches', 'heads', 'lookup', 'known', 'capabilities', 'between', 'changegroup', 'changegroupsubset', 'getbundle', 'stream_out', 'unbundle' ]
+    READABLE_COMMANDS   = [ 'batch', 'branches', 'heads', 'lookup', 'known', 'capabilities', 'between', 'changegroup', 'changegroupsubset', 'getbundle', 'stream_out' ]
+    # The commands that can be run as part of a batch
+    BATCHABLE_COMMANDS  = [ 'branches', 'heads', 'lookup', 'between', 'known' ]
     
   end
   
@@ -143,6 +145,24 @@ module Sinatra
       amp_repo.heads.map {|x| x.hexlify}.join(" ") << "\n"
     end
     
+    ##
+    # Command: known
+    # Requires an explicit capability: known
+    #
+    # Says which of the given nodes the repository has. Clients use it to
+    # find what they have in common with us by sampling their history.
+    #
+    # HTTP param: nodes. The node IDs to look for, in hex, separated by spaces.
+    #
+    # @param [Repository] amp_repo the repository the nodes are looked up in
+    # @return [String] a response to deliver to the client: a "1" for each node
+    #   we have and a "0" for each we don't, in order, with nothing between them.
+    def amp_get_known(amp_repo)
+      headers plain_headers
+      nodes = params["nodes"].to_s.split(" ").map {|x| x.unhexlify }
+      amp_repo.known(nodes).map {|yes| yes ? "1" : "0" }.join
+    end
+    
     def amp_get_branches(amp_repo)
       headers plain_headers
       nodes = []
@@ -168,8 +188,8 @@ module Sinatra
     #   "capability". No spaces are allowed in the capability= fragment.
     def amp_get_capabilities(amp_repo)
       headers plain_headers
-      caps = ["lookup", "changegroupsubset"]
-      # uncompressed for streaming?
+      caps = ["lookup", "changegroupsubset", "batch", "known", "getbundle"]
+      caps << "stream=1" if allow_stream?(amp_repo)
       caps << "unbundle=#{Amp::Mercurial::RevlogSupport::ChangeGroup::FORMAT_PRIORITIES.join(',')}"
       caps.join(' ') << "\n"
     end
@@ -294,6 +314,9 @@ module Sinatra
     #   data on the fly without using ridiculous amounts of memory, and with the
     #   correct headers. It ends up being the changegroup, or a large bundled up
     #   set of changesets, for the client to add to its repo (or just examine).
+    #   The compressed changegroup is cached until the next commit, so clients
+    #   asking for the same one all share a single copy.
+    # @see Amp::Servers::BundleCache
     def amp_get_changegroup(amp_repo)
       headers = gzipped_response
       
@@ -302,7 +325,7 @@ module Sinatra
         nodes = params["roots"].split(" ").map {|i| i.unhexlify }
       end
       
-      result = DelayedGzipper.new do
+      result = Amp::Servers::BundleCache.for(amp_repo).fetch(amp_repo, :changegroup, nodes, []) do
         amp_repo.changegroup(nodes, :serve)
       end
       
@@ -340,13 +363,170 @@ module Sinatra
       bases = params["bases"].split(" ").map {|i| i.unhexlify } if params["bases"]
       heads = params["heads"].split(" ").map {|i| i.unhexlify } if params["heads"]
       
-      result = DelayedGzipper.new do
+      result = Amp::Servers::BundleCache.for(amp_repo).fetch(amp_repo, :changegroupsubset, bases, heads) do
         amp_repo.changegroup_subset bases, heads, :serve
       end
       
       throw :halt, [200, headers, result]
     end
     
+    ##
+    # Command: getbundle
+    # Requires an explicit capability: getbundle
+    #
+    # Gets every changeset that's an ancestor of the given heads but not of the
+    # given common nodes. Clients that found the common nodes with +known+ only
+    # know the heads of what they have, not the roots of what they're missing.
+    #
+    # HTTP Param: common. The heads of what the client has, as hex node IDs
+    # separated by spaces.
+    # HTTP Param: heads. The heads the client wants, in the same form. All of
+    # our heads, if left out.
+    #
+    # @param [Repository] amp_repo the repository from which we are requesting the
+    #   changegroup.
+    # @return [String] the changegroup, gzipped on the fly and cached just as
+    #   for changegroup.
+    def amp_get_getbundle(amp_repo)
+      headers = gzipped_response
+      
+      common, heads = [], []
+      
+      common = params["common"].split(" ").map {|i| i.unhexlify } if params["common"]
+      heads  = params["heads"].split(" ").map {|i| i.unhexlify } if params["heads"]
+      
+      result = Amp::Servers::BundleCache.for(amp_repo).fetch(amp_repo, :getbundle, common, heads) do
+        amp_repo.get_bundle common, heads, :serve
+      end
+      
+      throw :halt, [200, headers, result]
+    end
+    
+    ##
+    # Command: batch
+    # Requires an explicit capability: batch
+    #
+    # Runs several commands in one request, so a client doing discovery over a
+    # slow link doesn't pay a round trip for each one. Only the small, read-only
+    # commands in BATCHABLE_COMMANDS can be batched.
+    #
+    # HTTP param: cmds. The commands, separated by semicolons. Each is the
+    # command's name, a space, and its parameters as comma-separated key=value
+    # pairs. Colons, commas, semicolons and equals signs in keys and values are
+    # escaped as :c, :o, :s and :e (see Amp::Mercurial::Batch). Example:
+    #     heads ;branches nodes=abcdeabcde...
+    #
+    # @param [Repository] amp_repo the repository the commands are run on
+    # @return [String] each command's response, escaped the same way, and
+    #   separated by semicolons
+    def amp_get_batch(amp_repo)
+      original = params
+      results = params["cmds"].to_s.split(";").map do |cmd|
+        name, args = cmd.split(" ", 2)
+        throw :halt, [400, "can't batch #{name}\n"] unless AmpExtension::BATCHABLE_COMMANDS.include?(name)
+        
+        self.params = original.merge(Amp::Mercurial::Batch.decode_args(args))
+        Amp::Mercurial::Batch.escape send("amp_get_#{name}", amp_repo)
+      end
+      headers plain_headers
+      results.join(";")
+    ensure
+      self.params = original
+    end
+    
+    ##
+    # Should we serve uncompressed streaming clones of this repository?
+    # Mercurial turns them off with server.uncompressed = false.
+    #
+    # @param [Repository] amp_repo the repository being served
+    # @return [Boolean] is the stream_out command allowed?
+    def allow_stream?(amp_repo)
+      amp_repo.respond_to?(:stream_out_entries) &&
+        amp_repo.config["server"]["uncompressed", Boolean, true]
+    end
+    
+    ##
+    # = StoreStreamer
+    # The body of a stream_out response. Like DelayedGzipper, nothing is read
+    # until Rack asks for it, and then the store files are read straight off
+    # the disk and handed to the server a chunk at a time, so the whole store
+    # never sits in memory.
+    #
+    # The format is Mercurial's: a status line ("0" for OK), a line with the
+    # number of files and total bytes, and then for each file, a line with
+    # its name, a NUL, and its size, followed by exactly that many bytes.
+    class StoreStreamer
+      CHUNK_SIZE = 64.kb
+      
+      ##
+      # @param [Repository] amp_repo the repository being cloned
+      # @param [Array<(String, String, Integer)>] entries the snapshot of the
+      #   store to send, from LocalRepository#stream_out_entries
+      def initialize(amp_repo, entries)
+        @store, @entries = amp_repo.store, entries
+      end
+      
+      ##
+      # The total number of bytes of file data to be sent.
+      def total_bytes
+        @entries.inject(0) {|sum, (_, _, size)| sum + size }
+      end
+      
+      ##
+      # The length of the whole response, known ahead of time so the server
+      # doesn't have to fall back to chunked encoding.
+      def content_length
+        header = "0\n#{@entries.size} #{total_bytes}\n".bytesize
+        @entries.inject(header + total_bytes) {|sum, (name, _, size)| sum + "#{name}\0#{size}\n".bytesize }
+      end
+      
+      ##
+      # For Rack compliance. Yields the stream a piece at a time.
+      def each
+        yield "0\n"
+        yield "#{@entries.size} #{total_bytes}\n"
+        @entries.each do |name, path, size|
+          yield "#{name}\0#{size}\n"
+          File.open(File.join(@store.path, path), "rb") do |file|
+            # the file may have been appended to since the snapshot, so only
+            # the bytes that existed then get sent
+            left = size
+            while left > 0 && (chunk = file.read([left, CHUNK_SIZE].min))
+              left -= chunk.bytesize
+              yield chunk
+            end
+            raise IOError.new("#{name} was truncated while streaming") if left > 0
+          end
+        end
+      end
+    end
+    
+    ##
+    # Command: stream_out
+    # Requires an explicit capability: stream
+    #
+    # Sends a raw copy of the store, for uncompressed clones. This is much
+    # less work for us than building a changegroup - we just copy files - and
+    # much less for the client than applying one, at the cost of some extra
+    # bandwidth.
+    #
+    # @param [Repository] amp_repo the repository being cloned
+    # @return [String] the stream, or an error code: 1 if streaming is turned
+    #   off, 2 if the store couldn't be locked.
+    def amp_get_stream_out(amp_repo)
+      headers "content-type" => "application/mercurial-0.1"
+      return "1\n" unless allow_stream?(amp_repo)
+      
+      begin
+        entries = amp_repo.stream_out_entries
+      rescue LockError
+        return "2\n"
+      end
+      
+      streamer = StoreStreamer.new amp_repo, entries
+      throw :halt, [200, response.headers.merge("Content-Length" => streamer.content_length.to_s), streamer]
+    end
+    
     def amp_get_fake_writing(amp_repo)
       "You're logged in!"
     end
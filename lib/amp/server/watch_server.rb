@@ -0,0 +1,353 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+require 'socket'
+require 'find'
+
+module Amp
+  module Servers
+
+    ##
+    # = WatchServer
+    # Watches a working directory with inotify, and tells `amp status` which
+    # paths have changed since it last asked, so status can look at those
+    # instead of walking the whole tree.
+    #
+    # Answers are relative to a clock token. Each answer hands out a new
+    # token; the next query passes it back and gets every path touched
+    # since. If the server can't vouch for that - it was restarted, the
+    # kernel's event queue overflowed, or we ran out of inotify watches -
+    # it says so, and the client walks the tree like it would without us.
+    #
+    # Queries travel as CommandChannel frames:
+    #   'Q' - client to server: the token from last time (empty for none)
+    #   'q' - server to client: the new token, "1" if the paths are
+    #         complete or "0" if the client has to walk, then the paths,
+    #         all separated by NUL bytes. Directories that were deleted or
+    #         moved away end in a slash - everything under them is gone.
+    class WatchServer
+      # How long a client waits for an answer before walking anyway
+      QUERY_TIMEOUT = 2
+
+      ##
+      # = Tree
+      # The inotify side: a watch on every directory in the working
+      # directory, and the paths that have changed, stamped with the tick
+      # they changed on.
+      class Tree
+        # inotify_event: watch descriptor, mask, cookie, name length
+        EVENT_FORMAT = "iLLL"
+        EVENT_SIZE   = 16
+        # Past this many changed paths, we forget them all and make the
+        # next client walk, rather than grow forever
+        MAX_CHANGES  = 100_000
+
+        # The IO events are read from, for IO.select
+        attr_reader :io
+
+        ##
+        # Watches every directory under +root+.
+        #
+        # @param [String] root the working directory
+        # @param [Array<String>] skip directories at the root to leave alone
+        #   (the repository's own metadata)
+        def initialize(root, skip = [])
+          @root  = root
+          @skip  = skip
+          fd = Support::Inotify.init
+          raise ArgumentError.new("inotify isn't available here") unless fd
+          @fd    = fd
+          @io    = IO.for_fd fd
+          @mask  = Support::Inotify::MODIFY | Support::Inotify::ATTRIB |
+                   Support::Inotify::CREATE | Support::Inotify::DELETE |
+                   Support::Inotify::MOVED_FROM | Support::Inotify::MOVED_TO |
+                   Support::Inotify::DELETE_SELF | Support::Inotify::MOVE_SELF |
+                   Support::Inotify::ONLYDIR | Support::Inotify::DONT_FOLLOW
+          @resets  = 0
+          @dirs    = {} # watch descriptor => path
+          @watches = {} # path => watch descriptor
+          @gone    = false
+          reset!
+        end
+
+        ##
+        # Has the working directory itself been deleted or moved?
+        def gone?
+          @gone
+        end
+
+        ##
+        # Reads whatever events are waiting, without blocking.
+        def process_events
+          while IO.select([@io], nil, nil, 0)
+            data = @io.sysread 64.kb
+            pos = 0
+            while pos + EVENT_SIZE <= data.size
+              wd, mask, _cookie, length = data[pos, EVENT_SIZE].unpack(EVENT_FORMAT)
+              name = data[pos + EVENT_SIZE, length]
+              name = name[0, name.index("\0") || name.size]
+              handle wd, mask, name
+              pos += EVENT_SIZE + length
+            end
+          end
+        end
+
+        ##
+        # Which paths have changed since +token+ was handed out? Reads any
+        # waiting events first, so anything that finished changing before
+        # the question shows up in the answer.
+        #
+        # @param [String] token a token from an earlier answer, or ""
+        # @return [Array<String, Array<String>>] the new token, and the
+        #   changed paths - or nil, if the caller has to walk the tree
+        def changed_since(token)
+          process_events
+          epoch, tick = token.to_s.split(":")
+          paths = nil
+          if @complete && epoch == @epoch && tick.to_i <= @tick
+            since = tick.to_i
+            paths = []
+            @changes.each {|path, stamp| paths << path if stamp > since }
+          end
+
+          answer = ["#{@epoch}:#{@tick}", paths]
+          @tick += 1 # anything from now on is newer than this token
+          answer
+        end
+
+        def close
+          @io.close unless @io.closed?
+        end
+
+        private
+
+        ##
+        # Forgets every change and moves to a new epoch, so every token
+        # handed out so far is stale.
+        def new_epoch!
+          @resets += 1
+          @epoch   = "#{Process.pid}.#{Time.now.to_i}.#{@resets}"
+          @tick    = 0
+          @changes = {}
+        end
+
+        ##
+        # Starts over after events were lost: a new epoch, and watches for
+        # any directories that turned up in the meantime.
+        def reset!
+          new_epoch!
+          @complete = true
+          watch_tree ""
+        end
+
+        ##
+        # Adds watches for +dir+ and everything under it. If +record+ is
+        # set, the files found are recorded as changed - they may have
+        # arrived before the watch did.
+        def watch_tree(dir, record = false)
+          start = dir.empty? ? @root : File.join(@root, dir)
+          Find.find(start) do |path|
+            relative = path[(@root.size + 1)..-1] || ""
+            if File.directory?(path) && !File.symlink?(path)
+              Find.prune if @skip.include? relative
+              watch relative
+            elsif record
+              change relative
+            end
+          end
+        rescue Errno::ENOENT, Errno::ENOTDIR
+          # it went away while we looked; its events will say so
+        end
+
+        def watch(dir)
+          path = dir.empty? ? @root : File.join(@root, dir)
+          wd = Support::Inotify.add_watch @fd, path, @mask
+          @dirs[wd] = dir
+          @watches[dir] = wd
+        rescue Errno::ENOSPC
+          UI.warn "out of inotify watches - raise fs.inotify.max_user_watches" if @complete
+          @complete = false
+        rescue Errno::ENOENT, Errno::ENOTDIR, Errno::EACCES
+        end
+
+        ##
+        # Stops watching +dir+ and everything under it. Used when a
+        # directory is moved away, since its watches would follow it.
+        def unwatch(dir)
+          prefix = dir + "/"
+          @watches.keys.each do |path|
+            next unless path == dir || path.start_with?(prefix)
+            wd = @watches.delete path
+            @dirs.delete wd
+            Support::Inotify.rm_watch @fd, wd
+          end
+        end
+
+        def change(path)
+          new_epoch! if @changes.size >= MAX_CHANGES
+          @changes[path] = @tick
+        end
+
+        def handle(wd, mask, name)
+          return reset! if mask & Support::Inotify::Q_OVERFLOW != 0
+          dir = @dirs[wd]
+          return unless dir
+
+          if mask & Support::Inotify::IGNORED != 0
+            @dirs.delete wd
+            @watches.delete dir if @watches[dir] == wd
+          elsif name.empty? # the directory itself
+            @gone = true if dir.empty? &&
+                            mask & (Support::Inotify::DELETE_SELF | Support::Inotify::MOVE_SELF) != 0
+          else
+            path = dir.empty? ? name : "#{dir}/#{name}"
+            return if @skip.include? path
+
+            if mask & Support::Inotify::ISDIR == 0
+              change path
+            elsif mask & (Support::Inotify::CREATE | Support::Inotify::MOVED_TO) != 0
+              watch_tree path, true
+            elsif mask & (Support::Inotify::DELETE | Support::Inotify::MOVED_FROM) != 0
+              unwatch path
+              change path + "/"
+            end
+          end
+        end
+      end
+
+      attr_reader :socket_path
+
+      ##
+      # @param [String] root the working directory to watch
+      # @param [String] socket_path where to create the unix socket
+      # @param [Array<String>] skip directories at the root not to watch
+      def initialize(root, socket_path, skip = [".hg", ".git"])
+        @root        = root
+        @socket_path = File.expand_path socket_path
+        @skip        = skip
+      end
+
+      ##
+      # Watches the tree and answers clients until interrupted, or until the
+      # working directory goes away.
+      def run!
+        if WatchServer.query(@socket_path, "")
+          UI.warn "#{@root} is already being watched (queries on #{@socket_path})"
+          return
+        end
+        tree = Tree.new @root, @skip
+        File.unlink @socket_path if File.socket? @socket_path
+        server = UNIXServer.new @socket_path
+        File.chmod 0600, @socket_path
+
+        UI.status "watching #{@root} (queries on #{@socket_path})"
+        trap("INT")  { server.close }
+        trap("TERM") { server.close }
+
+        until tree.gone?
+          begin
+            ready, _, _ = IO.select([server, tree.io])
+          rescue IOError, Errno::EBADF
+            break # closed by a signal
+          end
+
+          tree.process_events if ready.include? tree.io
+          next unless ready.include? server
+
+          begin
+            client = server.accept
+          rescue IOError, Errno::EBADF
+            break
+          end
+
+          begin
+            serve tree, client
+          rescue Errno::EPIPE, Errno::ECONNRESET
+          ensure
+            client.close unless client.closed?
+          end
+        end
+      ensure
+        tree.close if tree
+        File.unlink @socket_path if server && File.socket?(@socket_path)
+      end
+
+      ##
+      # Answers one client.
+      #
+      # @param [Tree] tree the tree being watched
+      # @param [UNIXSocket] socket the connected client
+      def serve(tree, socket)
+        channel = CommandChannel.new socket
+        type, token = channel.read_frame
+        return unless type == 'Q'
+
+        token, paths = tree.changed_since token
+        channel.write_frame 'q', ([token, paths ? "1" : "0"] + (paths || [])).join("\0")
+      end
+
+      ##
+      # Asks a running server what's changed.
+      #
+      # @param [String] socket_path the server's socket
+      # @param [String] token the token from the last answer, or ""
+      # @return [Array<String, Array<String>>, nil] the new token, and the
+      #   changed paths (nil if the caller has to walk the tree anyway) - or
+      #   nil if no server answered
+      def self.query(socket_path, token)
+        return nil unless File.socket? socket_path
+        socket  = UNIXSocket.new socket_path
+        channel = CommandChannel.new socket
+        channel.write_frame 'Q', token.to_s
+        return nil unless IO.select([socket], nil, nil, QUERY_TIMEOUT)
+
+        type, payload = channel.read_frame
+        return nil unless type == 'q'
+        token, complete, *paths = payload.split("\0")
+        [token, complete == "1" ? paths : nil]
+      rescue Errno::ECONNREFUSED, Errno::ENOENT, Errno::EPIPE, Errno::ECONNRESET
+        nil # a stale socket from a server that's gone away
+      ensure
+        socket.close if socket && !socket.closed?
+      end
+
+      ##
+      # Starts a server for +repo+ in the background, detached from us.
+      #
+      # @param [AbstractLocalRepository] repo the repository to watch
+      def self.spawn(repo)
+        amp = File.join(Amp::CODE_ROOT, "..", "bin", "amp")
+        pid = fork do
+          Process.setsid
+          $stdin.reopen  "/dev/null"
+          $stdout.reopen "/dev/null", "w"
+          $stderr.reopen "/dev/null", "w"
+          Dir.chdir repo.root
+          exec amp, "serve", "--watch"
+        end
+        Process.detach pid
+      end
+
+      ##
+      # The socket used when none is given: one per repository, inside its
+      # metadata directory.
+      #
+      # @param [AbstractLocalRepository] repo the repository being watched
+      # @return [String] the path to the socket
+      def self.default_socket_for(repo)
+        repo.join "watch.sock"
+      end
+    end
+  end
+end
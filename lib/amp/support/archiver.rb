@@ -0,0 +1,375 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+require 'fileutils'
+require 'zlib'
+
+module Amp
+  module Support
+    ##
+    # = Archiver
+    # Writes a revision out as a directory, a tarball (plain, gzipped or
+    # bzipped) or a zip file, for `amp archive`.
+    #
+    # File contents are read on worker threads and written out in order, so
+    # only a window's worth of files is ever in memory. The compression is
+    # spread over the workers too: tarballs are compressed in independent
+    # blocks and zip members one at a time. Blocks and members are cut the
+    # same way every time, so the output doesn't depend on the thread
+    # scheduling.
+    #
+    # @example
+    #   Archiver.open("tgz", "release.tgz", :prefix => "release") do |archive|
+    #     archive.write(files) {|file| [File.read(file), 0644] }
+    #   end
+    class Archiver
+      TYPES = %w(files tar tbz2 tgz uzip zip)
+      # How many threads read and compress by default
+      DEFAULT_THREADS = 4
+
+      ##
+      # One file on its way into the archive. +crc+, +method+ and
+      # +compressed+ are only filled in for zip files.
+      Entry = Struct.new(:name, :data, :mode, :crc, :method, :compressed)
+
+      ##
+      # Creates an archive, yields it, and finishes it off.
+      #
+      # @see #initialize
+      # @yield [archive] the new archive
+      def self.open(type, dest, opts = {})
+        archive = new type, dest, opts
+        begin
+          yield archive
+        ensure
+          archive.close
+        end
+      end
+
+      ##
+      # The prefix an archive's files go under if none is given: the
+      # archive's name, minus the extension.
+      #
+      # @param [String] dest the archive's filename
+      # @return [String] the prefix
+      def self.default_prefix(dest)
+        File.basename(dest).sub(/\.(tar\.gz|tgz|tar\.bz2|tbz2|tar|zip)\z/, "")
+      end
+
+      ##
+      # A copy of +str+ as raw bytes. File names come out of manifests that
+      # way, and a name's length in an archive header is counted in bytes.
+      #
+      # @param [String] str the string
+      # @return [String] the same bytes, with no encoding
+      def self.binary(str)
+        str = str.dup
+        str.force_encoding "BINARY" if str.respond_to? :force_encoding
+        str
+      end
+
+      ##
+      # @param [String] type the kind of archive (see TYPES)
+      # @param [String] dest where to write it
+      # @param [Hash] opts the options
+      # @option opts [String] :prefix the directory to put everything under
+      # @option opts [Integer] :mtime the time to stamp on every file
+      # @option opts [Integer] :threads how many threads to use
+      # @option opts [Proc] :progress called with each file's name as it's
+      #   written
+      def initialize(type, dest, opts = {})
+        raise ArgumentError.new("Unknown archive type: #{type}") unless TYPES.include? type.to_s
+        @prefix   = Archiver.binary(opts[:prefix] || (type.to_s == "files" ? "" : Archiver.default_prefix(dest)))
+        @mtime    = opts[:mtime] || 0
+        @threads  = opts[:threads] || DEFAULT_THREADS
+        @progress = opts[:progress]
+
+        @file = File.open(dest, "wb") unless type.to_s == "files"
+        @sink = case type.to_s
+                when "files" then DirectorySink.new dest
+                when "tar"   then TarSink.new @file, @mtime
+                when "tgz"   then TarSink.new GzipStream.new(@file, @threads), @mtime
+                when "tbz2"  then TarSink.new Bzip2Stream.new(@file, @threads), @mtime
+                when "uzip"  then ZipSink.new @file, @mtime, false
+                when "zip"   then ZipSink.new @file, @mtime, true
+                end
+      end
+
+      ##
+      # Adds files to the archive. The block is run on the worker threads,
+      # several files at a time, but the files go into the archive in the
+      # order given.
+      #
+      # @param [Array] files the files to add - anything the block knows
+      #   how to read
+      # @yield [file] reads a file. Runs on the workers, so it mustn't touch
+      #   anything another file's read might.
+      # @yieldreturn [Array<String, String, Integer>] the file's path in the
+      #   archive, its contents and its mode
+      def write(files, &reader)
+        pool = OrderedPool.new(@threads) do |file|
+          name, data, mode = reader.call file
+          name = Archiver.binary name
+          name = File.join(@prefix, name) unless @prefix.empty?
+          @sink.prepare Entry.new(name, data, mode || 0644)
+        end
+        pool.on_result do |entry|
+          @sink.add entry
+          @progress.call entry.name if @progress
+        end
+        files.each {|file| pool << file }
+        pool.finish
+      ensure
+        pool.stop if pool
+      end
+
+      ##
+      # Finishes the archive off.
+      def close
+        return unless @sink
+        @sink.close
+        @sink = nil
+      ensure
+        @file.close if @file && !@file.closed?
+      end
+
+      ##
+      # Writes each file into a directory.
+      class DirectorySink
+        def initialize(dir)
+          @dir = Archiver.binary dir
+          FileUtils.mkdir_p dir
+        end
+
+        def prepare(entry)
+          entry
+        end
+
+        def add(entry)
+          path = File.join(@dir, entry.name)
+          FileUtils.mkdir_p File.dirname(path)
+          File.open(path, "wb") {|f| f.write entry.data }
+          File.chmod entry.mode, path
+        end
+
+        def close; end
+      end
+
+      ##
+      # Writes each file into a tarball, with minitar.
+      class TarSink
+        def initialize(io, mtime)
+          @io    = io
+          @mtime = mtime
+          @tar   = Archive::Tar::Minitar::Writer.new io
+        end
+
+        def prepare(entry)
+          entry
+        end
+
+        def add(entry)
+          data = entry.data
+          @tar.add_file_simple(entry.name, :size => data.size, :mode => entry.mode,
+                                           :mtime => @mtime) {|f| f.write data }
+        end
+
+        def close
+          @tar.close
+          @io.close if @io.respond_to?(:finish) # a compressed stream
+        end
+      end
+
+      ##
+      # Writes a zip file. Each member is compressed on its own by #prepare,
+      # on a worker; #add just writes it out. We write the zip ourselves,
+      # instead of going through rubyzip, because it wants to compress
+      # members as they're written.
+      class ZipSink
+        STORED, DEFLATED = 0, 8
+        # 2.0, so readers know about directories and deflate
+        VERSION = 20
+        # The limits of a zip without the zip64 extensions
+        MAX_ENTRIES, MAX_SIZE = 0xffff, 0xffffffff
+
+        def initialize(io, mtime, compress)
+          @io       = io
+          @compress = compress
+          @central  = Archiver.binary ""
+          @count    = 0
+          @offset   = 0
+          time = Time.at(mtime)
+          time = Time.local(1980) if time.year < 1980
+          @dos_time = (time.hour << 11) | (time.min << 5) | (time.sec / 2)
+          @dos_date = ((time.year - 1980) << 9) | (time.month << 5) | time.day
+        end
+
+        ##
+        # Compresses a member, unless that makes it bigger.
+        def prepare(entry)
+          entry.crc = Zlib.crc32 entry.data
+          entry.method, entry.compressed = STORED, entry.data
+          if @compress
+            deflater = Zlib::Deflate.new(Zlib::DEFAULT_COMPRESSION, -Zlib::MAX_WBITS)
+            compressed = deflater.deflate(entry.data, Zlib::FINISH)
+            deflater.close
+            entry.method, entry.compressed = DEFLATED, compressed if compressed.bytesize < entry.data.bytesize
+          end
+          entry
+        end
+
+        def add(entry)
+          if (@count += 1) > MAX_ENTRIES || entry.data.bytesize > MAX_SIZE || @offset > MAX_SIZE
+            raise ArgumentError.new("archive is too big for a zip file")
+          end
+          name  = Archiver.binary entry.name
+          # bit 11 marks a UTF-8 name
+          flags = name.unpack("C*").any? {|byte| byte > 127 } ? 0x800 : 0
+          sizes = [entry.crc, entry.compressed.bytesize, entry.data.bytesize]
+
+          @io.write [0x04034b50, VERSION, flags, entry.method, @dos_time, @dos_date].pack("Vvvvvv") +
+                    sizes.pack("VVV") + [name.bytesize, 0].pack("vv") + name
+          @io.write entry.compressed
+          @central << [0x02014b50, (3 << 8) | VERSION, VERSION, flags, entry.method,
+                       @dos_time, @dos_date].pack("Vvvvvvv") + sizes.pack("VVV") +
+                      [name.bytesize, 0, 0, 0, 0, (0100000 | entry.mode) << 16, @offset].pack("vvvvvVV") + name
+          @offset += 30 + name.bytesize + entry.compressed.bytesize
+        end
+
+        ##
+        # Writes the central directory, which lists every member and where
+        # it starts.
+        def close
+          @io.write @central
+          @io.write [0x06054b50, 0, 0, @count, @count, @central.bytesize, @offset, 0].pack("VvvvvVVv")
+        end
+      end
+
+      ##
+      # = CompressedStream
+      # An IO-alike that compresses what's written to it in fixed-size
+      # blocks, on an OrderedPool, and writes the compressed blocks out in
+      # order. Subclasses say how to compress a block, and what goes before
+      # and after them all.
+      class CompressedStream
+        def initialize(io, threads, block_size)
+          @io         = io
+          @block_size = block_size
+          @buffer     = ""
+          @pool = OrderedPool.new(threads) {|args| compress(*args) }
+          @pool.on_result {|data| @io.write data }
+          @io.write header
+        end
+
+        def write(data)
+          @buffer << data
+          push @buffer.slice!(0, @block_size), false while @buffer.size >= @block_size
+          data.size
+        end
+
+        ##
+        # Compresses the rest, and waits for all the blocks to be written.
+        def finish
+          push @buffer, true
+          @buffer = ""
+          @pool.finish
+          @io.write trailer
+        ensure
+          @pool.stop
+        end
+        alias_method :close, :finish
+
+        private
+
+        def header;  ""; end
+        def trailer; ""; end
+
+        def push(block, last)
+          @pool << [block, last]
+        end
+      end
+
+      ##
+      # A gzip file, compressed the way pigz does it: each block is deflated
+      # on its own, primed with the 32K before it so it compresses nearly as
+      # well as one long stream, and ends on a byte boundary so the pieces
+      # can be stuck together.
+      class GzipStream < CompressedStream
+        BLOCK_SIZE = 128.kb
+        WINDOW     = 32.kb
+
+        def initialize(io, threads, level = Zlib::DEFAULT_COMPRESSION)
+          @level = level
+          @crc   = Zlib.crc32
+          @size  = 0
+          @tail  = ""
+          super io, threads, BLOCK_SIZE
+        end
+
+        private
+
+        # no name, no timestamp (so the same input makes the same file),
+        # made on Unix
+        def header
+          [0x1f, 0x8b, 8, 0, 0, 0, 3].pack("CCCCVCC")
+        end
+
+        def trailer
+          [@crc, @size & 0xffffffff].pack("VV")
+        end
+
+        def push(block, last)
+          @crc   = Zlib.crc32 block, @crc
+          @size += block.size
+          @pool << [block, @tail, last]
+          @tail = (@tail + block)[-WINDOW..-1] || @tail + block
+        end
+
+        def compress(block, dictionary, last)
+          deflater = Zlib::Deflate.new(@level, -Zlib::MAX_WBITS)
+          deflater.set_dictionary dictionary unless dictionary.empty?
+          deflater.deflate(block, last ? Zlib::FINISH : Zlib::SYNC_FLUSH)
+        ensure
+          deflater.close if deflater
+        end
+      end
+
+      ##
+      # A bzip2 file, made of one complete bzip2 stream per block, one after
+      # another - which bunzip2 reads as the whole thing, the same way it
+      # reads pbzip2's output.
+      class Bzip2Stream < CompressedStream
+        # bzip2 -9's block size, so we don't lose anything by splitting
+        BLOCK_SIZE = 900_000
+
+        def initialize(io, threads)
+          @empty = true
+          super io, threads, BLOCK_SIZE
+        end
+
+        private
+
+        def push(block, last)
+          return if block.empty? && !(last && @empty)
+          @empty = false
+          super
+        end
+
+        def compress(block, last)
+          BZ2.compress block
+        end
+      end
+    end
+  end
+end
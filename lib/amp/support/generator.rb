@@ -37,8 +37,21 @@
 #
 # Allows you to create an object that lazily generates values and yields them 
 # when the next() method is called. 
+#
+# There are two ways of jumping in and out of +generator_loop+. Fibers are
+# used when the ruby has them (1.9 and up): switching fibers is cheap.
+# Otherwise, we fall back to continuations, which copy the whole C stack
+# every time one is captured - that's twice per value generated.
 class Generator
   
+  class << self
+    ##
+    # Which way new generators switch in and out of +generator_loop+: either
+    # :fiber or :continuation. Mostly here so the two can be benchmarked.
+    attr_accessor :backend
+  end
+  self.backend = defined?(::Fiber) ? :fiber : :continuation
+  
   ##
   # Generic initializer for a Generator. If you subclass, you must caller super
   # to initialize the continuation ivars.
@@ -48,29 +61,20 @@ class Generator
   end
   
   ##
-  # Runs the next iteration of the generator. Uses continuations to jump across
-  # the stack all willy-nilly like.
+  # Runs the next iteration of the generator.
   #
-  # @return [Object] the next generated object.
+  # @return [Object] the next generated object. Once the loop has finished,
+  #   this is whatever +generator_loop+ returned.
   def next
-    # by setting @current_context to +here+, when @current_context is called, next() will
-    # return to its caller.
-    callcc do |here|
-      @current_context = here
-      if (@yield_context ||= nil)
-        # Run next iteration of the running loop
-        @yield_context.call
-      else
-        # Start the loop
-        generator_loop
-	    end
-    end
+    @backend ||= Generator.backend
+    @backend == :fiber ? next_with_fiber : next_with_continuation
   end
   
   ##
   # Resets the generator from the beginning
   def reset
     @yield_context = nil
+    @fiber, @finished, @backend = nil, nil, nil
   end
   
   private
@@ -78,15 +82,47 @@ class Generator
   ##
   # Yields a value from within the generator_loop method to the caller of +next+.
   # This method actually is what returns a value from a call to next through the
-  # roundabout nature of continuations.
+  # roundabout nature of continuations (or, far less roundabout, fibers).
   #
   # @param value the value to return from +next+
   def yield_gen(value)
-    callcc do |cont|
-      @yield_context = cont
-      @current_context.call value # causes next() to immediately return +value+
+    if @backend == :fiber
+      Fiber.yield value
+    else
+      callcc do |cont|
+        @yield_context = cont
+        @current_context.call value # causes next() to immediately return +value+
+      end
+    end
+  end
+  
+  ##
+  # Runs the loop until it yields, in its own fiber.
+  def next_with_fiber
+    return @result if @finished
+    @fiber ||= Fiber.new do
+      @result = generator_loop
+      @finished = true
+      @result
+    end
+    @fiber.resume
+  end
+  
+  ##
+  # Uses continuations to jump across the stack all willy-nilly like.
+  def next_with_continuation
+    # by setting @current_context to +here+, when @current_context is called, next() will
+    # return to its caller.
+    callcc do |here|
+      @current_context = here
+      if (@yield_context ||= nil)
+        # Run next iteration of the running loop
+        @yield_context.call
+      else
+        # Start the loop
+        generator_loop
+	    end
     end
   end
   
 end
-
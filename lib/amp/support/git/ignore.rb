@@ -0,0 +1,135 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+module Amp
+  module Git
+
+    ##
+    # = Ignore
+    # Git's ignore rules: .git/info/exclude, then the .gitignore in each
+    # directory from the root on down, with later patterns overriding earlier
+    # ones (and ! un-ignoring things). Each .gitignore is read the first time
+    # something in its directory is checked.
+    class Ignore
+      Pattern = Struct.new(:regexp, :negated, :directory_only, :base)
+
+      ##
+      # @param [String] root the root of the working directory
+      def initialize(root)
+        @root        = root
+        @patterns    = {}
+        @directories = {}
+        exclude = File.join(root, ".git", "info", "exclude")
+        @global = File.exist?(exclude) ? parse(File.read(exclude), "") : []
+      end
+
+      ##
+      # Is the path ignored? Anything inside an ignored directory is, no
+      # matter what else the patterns say.
+      #
+      # @param [String] path the path, relative to the root
+      # @param [Boolean] directory is it a directory? If not given and it
+      #   matters, we'll check.
+      # @return [Boolean] is it ignored?
+      def ignored?(path, directory = nil)
+        return false if path.nil? || path.empty? # the root never is
+        parent = File.dirname(path)
+        return true if parent != "." && ignored_directory?(parent)
+        match path, directory
+      end
+
+      private
+
+      def ignored_directory?(path)
+        @directories.fetch(path) { @directories[path] = ignored?(path, true) }
+      end
+
+      ##
+      # Runs the path through every pattern that applies to it. The last one
+      # that matches decides.
+      def match(path, directory)
+        result = false
+        patterns_for(File.dirname(path)).each do |pattern|
+          relative = pattern.base.empty? ? path : path[pattern.base.size + 1..-1]
+          next unless relative =~ pattern.regexp
+          if pattern.directory_only
+            directory = File.directory?(File.join(@root, path)) if directory.nil?
+            next unless directory
+          end
+          result = !pattern.negated
+        end
+        result
+      end
+
+      ##
+      # The patterns that apply inside +dir+, least important first.
+      def patterns_for(dir)
+        dir = "" if dir == "."
+        @patterns[dir] ||= begin
+          parent   = dir.empty? ? @global : patterns_for(File.dirname(dir))
+          ignore   = File.join(@root, dir, ".gitignore")
+          patterns = File.exist?(ignore) ? parse(File.read(ignore), dir) : []
+          parent + patterns
+        end
+      end
+
+      ##
+      # Turns the text of an ignore file into patterns.
+      def parse(text, base)
+        text.split("\n").map {|line| compile line, base }.compact
+      end
+
+      ##
+      # Turns one line of an ignore file into a pattern. A pattern with a
+      # slash anywhere but the end is anchored to the ignore file's
+      # directory; otherwise it can match at any depth.
+      def compile(line, base)
+        line = line.sub(/\s+\z/, "")
+        return nil if line.empty? || line[0, 1] == "#"
+
+        negated = line[0, 1] == "!"
+        line = line[1..-1] if negated
+        line = line[1..-1] if line[0, 1] == "\\" # an escaped # or !
+        directory_only = line[-1, 1] == "/"
+        line = line.chomp("/")
+        anchored = line.include?("/")
+        line = line[1..-1] if line[0, 1] == "/"
+
+        glob   = glob_to_regexp line
+        regexp = anchored ? /\A#{glob}\z/ : /(?:\A|\/)#{glob}\z/
+        Pattern.new(regexp, negated, directory_only, base)
+      end
+
+      ##
+      # Translates a glob into a regexp: * and ? don't cross slashes, and **
+      # matches any number of directories.
+      def glob_to_regexp(glob)
+        regexp = ""
+        scanner = glob.scan(/\*\*\/|\/\*\*\z|\*\*|\*|\?|\[[^\]]*\]|[^*?\[]+|./)
+        scanner.each do |token|
+          regexp << case token
+                    when "**/"   then "(?:.*/)?"
+                    when "/**"   then "/.*"
+                    when "**"    then ".*"
+                    when "*"     then "[^/]*"
+                    when "?"     then "[^/]"
+                    when /\A\[/  then token.sub(/\A\[!/, "[^")
+                    else Regexp.escape(token)
+                    end
+        end
+        regexp
+      end
+    end
+  end
+end
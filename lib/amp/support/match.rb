@@ -65,7 +65,7 @@ module Amp
       when Regexp
         [arg]
       when Array
-        matcher_for_text arg.join("\n") if arg.any?
+        matcher_for_patterns arg if arg.any?
       when String
         [matcher_for_string(arg)]  if arg.any?
       end
@@ -90,6 +90,7 @@ module Amp
     # @param [Hash, [#include?, Regexp, Regexp] either a hash or 
     #   arrays in the order of: files, include, exclude
     def initialize(*args, &block)
+      @block_given = !block.nil? # the positional form clobbers +block+
       if (hash = args.first).is_a? Hash
         @files   = hash[:files]   || []
         @include = hash[:include]
@@ -103,16 +104,29 @@ module Amp
         @exclude = exclude
       end
       
+      @block_given ||= !block.nil?
       @block = block || proc { false }
+      compile!
     end
     
+    ##
+    # The directories, relative to the repository root, that a walk has to
+    # descend into to find every file that could match, besides the explicit
+    # files (which are looked up directly). That's only known when every
+    # include pattern is a literal path prefix and there's no block; if it
+    # can't be known, the answer is nil, meaning the whole tree.
+    # 
+    # @example Match.create(:includer => "path:lib/amp").roots # => ["lib"]
+    # @return [Array<String>, nil] the directories to walk, or nil for all
+    attr_reader :roots
+    
     ##
     # Is +file+ an exact match?
     # 
     # @param [String] file the file to test
     # @return [Boolean] is it an exact match?
     def exact?(file)
-      @files.include?(file)
+      @file_set.has_key? file
     end
     
     ##
@@ -122,7 +136,7 @@ module Amp
     # @param [String] file the file to test
     # @return [Boolean] is it a failure match?
     def failure?(file)
-      @exclude && @exclude.any? {|r| file =~ r}
+      @excluder ? @excluder.call(file) : false
     end
     
     ##
@@ -163,7 +177,7 @@ module Amp
     # @param [String] file the file to test
     # @return [Boolean] is it to be included?
     def included?(file)
-      @include && @include.any? {|r| file =~ r}
+      @includer ? @includer.call(file) : false
     end
     
     ##
@@ -177,5 +191,44 @@ module Amp
       included?(file) || (@block && @block.call(file))
     end
     
+    private
+    
+    ##
+    # Readies the files and patterns for lookups: the explicit files go into
+    # a hash, and the includes and excludes are each compiled into a single
+    # {Mercurial::Ignore::Matcher}, so a check costs one prefix lookup and at
+    # most one regexp match, however many patterns were given.
+    def compile!
+      @file_set = Hash.with_keys [@files].flatten
+      @includer = compile_patterns @include
+      @excluder = compile_patterns @exclude
+      @roots    = find_roots
+    end
+    
+    def compile_patterns(patterns)
+      patterns = [patterns].flatten.compact
+      patterns.empty? ? nil : Mercurial::Ignore::Matcher.new(patterns)
+    end
+    
+    ##
+    # @see roots
+    def find_roots
+      return nil if @block_given
+      return []  unless @includer
+      return nil unless @includer.literals_only?
+      
+      dirs = @includer.literals.map do |literal|
+        slash = literal.rindex "/"
+        return nil unless slash && slash > 0 # could be anything at the top
+        literal[0, slash]
+      end
+      
+      # no need to walk a directory twice
+      dirs.uniq.sort.inject([]) do |roots, dir|
+        roots << dir unless roots.any? {|root| dir[0, root.size + 1] == root + "/" }
+        roots
+      end
+    end
+    
   end
 end
\ No newline at end of file
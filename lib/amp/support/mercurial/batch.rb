@@ -0,0 +1,79 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+module Amp
+  module Mercurial
+    ##
+    # = Batch
+    # The encoding used by the batch wire command, shared by the client
+    # (HTTPRepository) and the server (the amp extension). Commands are
+    # separated by semicolons, and each one's parameters are comma-separated
+    # key=value pairs - so colons, commas, semicolons and equals signs in
+    # keys, values and results are escaped, Mercurial-style, as :c, :o, :s
+    # and :e.
+    #
+    # @example
+    #   Batch.encode_args(:key => "a,b") # => "key=a:ob"
+    #   Batch.decode_args("key=a:ob")    # => {"key" => "a,b"}
+    module Batch
+      extend self
+
+      # What each special character is escaped as
+      ESCAPES   = {":" => ":c", "," => ":o", ";" => ":s", "=" => ":e"}
+      # And back again
+      UNESCAPES = ESCAPES.invert
+
+      ##
+      # Escapes a key, value or result, so it can't be confused with the
+      # separators.
+      #
+      # @param [String] plain the text to escape
+      # @return [String] the escaped text
+      def escape(plain)
+        plain.gsub(/[:,;=]/) {|char| ESCAPES[char] }
+      end
+
+      ##
+      # Undoes {#escape}.
+      #
+      # @param [String] escaped the escaped text
+      # @return [String] the original text
+      def unescape(escaped)
+        escaped.gsub(/:[cose]/) {|escape| UNESCAPES[escape] }
+      end
+
+      ##
+      # Encodes one command's parameters.
+      #
+      # @param [Hash] args the parameters
+      # @return [String] the parameters, as "key=value,key=value"
+      def encode_args(args)
+        args.map {|key, value| "#{escape key.to_s}=#{escape value.to_s}" }.join(",")
+      end
+
+      ##
+      # Decodes one command's parameters.
+      #
+      # @param [String] encoded the parameters, from {#encode_args}
+      # @return [Hash<String => String>] the parameters
+      def decode_args(encoded)
+        encoded.to_s.split(",").inject({}) do |hash, pair|
+          key, value = pair.split("=", 2)
+          hash[unescape key] = unescape(value.to_s)
+          hash
+        end
+      end
+    end
+  end
+end
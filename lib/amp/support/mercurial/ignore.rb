@@ -19,14 +19,17 @@ module Amp
       
       COMMENT = /((^|[^\\])(\\\\)*)#.*/
       SYNTAXES = {'re'      => :regexp,  'regexp' => :regexp, 'glob' => :glob,
-                  'relglob' => :relglob, 'relre'  => :regexp, 'path' => :glob,
+                  'relglob' => :relglob, 'relre'  => :regexp, 'path' => :path,
                   'relpath' => :relglob}
+      # What a path: pattern ends in: the path is a file, or a directory
+      PATH_SUFFIX = "(?:/|$)"
       
       ##
       # Parses the ignore file, +file+ (or ".hgignore")
       # 
       # @param [String] root the root of the repo
       # @param [Array<String>] files absolute paths to files
+      # @return [Matcher] a compiled matcher for all the patterns in the files
       def parse_ignore(root, files=[])
         real_files   = files.select {|f| File.exist? File.join(root, f) }
         all_patterns = real_files.inject [] do |collection, file|  
@@ -34,8 +37,8 @@ module Amp
           collection.concat matcher_for_text(text) # i know this is evil
         end # real_files.inject
         
-        # here's the proc to do the tests
-        regexps_to_proc all_patterns
+        # here's the object to do the tests
+        Matcher.new all_patterns
       end
       
       ##
@@ -87,6 +90,29 @@ module Amp
         end # lines.inject
       end
       
+      ##
+      # Like matcher_for_text, except for a list of patterns, each of which
+      # may name its own syntax. A "syntax: glob" entry sets the syntax for
+      # the patterns after it that don't, as it would in a file; patterns
+      # before any are parsed with matcher_for_string.
+      # 
+      # @example matcher_for_patterns(["syntax: glob", "*.rb", "re:^lib/"])
+      # @param [Array<String>] patterns the patterns to parse
+      # @return [Array<Regexp>] the regexps generated from the strings and syntaxes
+      def matcher_for_patterns(patterns)
+        syntax = nil
+        patterns.inject [] do |regexps, pattern|
+          if pattern.start_with? "syntax:"
+            syntax = SYNTAXES[pattern[7..-1].strip] || :regexp
+            regexps
+          elsif syntax && !(pattern =~ /^(\w+):/ && SYNTAXES[$1])
+            regexps << parse_line(syntax, pattern)
+          else
+            regexps << matcher_for_string(pattern)
+          end
+        end
+      end
+      
       ##
       # Much like matcher_for_text, except tailored to single line strings
       # 
@@ -99,7 +125,7 @@ module Amp
           include_syntax = :regexp      # just a line, no specified syntax
           include_regexp = string       # no syntax, thus whole thing is pattern
         else
-          include_syntax = $1.to_sym    # the syntax is the first match
+          include_syntax = SYNTAXES[$1] || $1.to_sym # the syntax is the first match
           include_regexp = $2.strip     # the rest of the string is the pattern
         end
         parse_line include_syntax, include_regexp
@@ -110,7 +136,7 @@ module Amp
       # a valid regexp or nil. If it is nil, it means the
       # syntax was incorrect.
       # 
-      # @param [Symbol] syntax the syntax to parse with (:regexp, :glob, :relglob)
+      # @param [Symbol] syntax the syntax to parse with (:regexp, :glob, :relglob, :path)
       # @param [String] line the line to parse
       # @return [NilClass, Regexp] nil means the syntax was a bad choice
       def parse_line(syntax, line)
@@ -134,6 +160,10 @@ module Amp
           end
           joined = ps.join '/(?:.*/)*'
           pattern = syntax == :glob ? /^#{joined}/ : /#{joined}/
+        when :path
+          # path: a file, or a directory and everything in it, relative to
+          # the root of the repository. No special characters at all.
+          pattern = Regexp.new("^" + Regexp.escape(line) + PATH_SUFFIX)
         else
           pattern = nil
         end
@@ -160,6 +190,120 @@ module Amp
       end
       alias_method :regexp_to_proc, :regexps_to_proc
       
+      ##
+      # = Matcher
+      # All of the ignore patterns, compiled so that checking a path doesn't
+      # mean trying every pattern in turn. Patterns that are just a literal
+      # anchored at the root ("glob:build") go into a
+      # {Amp::Support::PrefixSet}, as do the directories named by path:
+      # patterns ("path:node_modules"), which also match exactly that path.
+      # Everything else is unioned into a single regexp. It quacks like the
+      # proc {Ignore#regexps_to_proc} makes.
+      class Matcher
+        # The literal prefixes (and path: paths) pulled out of the patterns
+        attr_reader :literals
+        
+        ##
+        # @param [Array<Regexp, nil>] regexps the patterns, as from
+        #   {Ignore#matcher_for_text}. nils are skipped.
+        def initialize(*regexps)
+          @prefixes = Amp::Support::PrefixSet.new
+          @paths    = {}
+          @literals = []
+          others    = []
+          regexps.flatten.compact.each do |regexp|
+            if path = literal_path(regexp)
+              @prefixes << path + "/"
+              @paths[path] = true
+              @literals << path
+            elsif literal = literal_prefix(regexp)
+              @prefixes << literal
+              @literals << literal
+            else
+              others << regexp
+            end
+          end
+          @combined    = others.empty? ? nil : Regexp.union(*others)
+          @directories = {}
+        end
+        
+        ##
+        # Is the given path ignored?
+        #
+        # @param [String] file the path, relative to the repository root
+        # @return [Boolean] whether any pattern matches the path
+        def call(file)
+          return false unless file # the walker asks about the root as nil
+          return true if @paths[file] || @prefixes.prefix_of?(file)
+          !!(@combined && @combined =~ file)
+        end
+        alias_method :[], :call
+        
+        ##
+        # Is everything under the given directory ignored? That's the case if
+        # the directory, or any directory above it, is ignored, so the walker
+        # can skip the whole tree. Answers are remembered, since every file in
+        # a directory asks about the same parents.
+        #
+        # @param [String] dir the directory, relative to the repository root
+        # @return [Boolean] whether the directory is wholly ignored
+        def ignoring_directory?(dir)
+          return @directories[dir] if @directories.has_key? dir
+          parent = File.dirname dir
+          above  = parent != "." && parent != dir && ignoring_directory?(parent)
+          @directories[dir] = above || call(dir)
+        end
+        
+        ##
+        # Were all of the patterns literal prefixes? If so, {#literals} says
+        # everything there is to know about what matches.
+        def literals_only?
+          @combined.nil?
+        end
+        
+        def to_proc
+          method(:call).to_proc
+        end
+        
+        private
+        
+        ##
+        # If the regexp is a path: pattern, returns the path.
+        #
+        # @param [Regexp] regexp the pattern to examine
+        # @return [String, nil] the path, or nil if it's any other regexp
+        def literal_path(regexp)
+          source = regexp.source
+          return nil unless regexp.options == 0 && source.end_with?(PATH_SUFFIX)
+          literal_prefix Regexp.new(source[0, source.size - PATH_SUFFIX.size])
+        end
+        
+        ##
+        # If the regexp only ever matches one literal string at the start of
+        # the path, returns that string.
+        #
+        # @param [Regexp] regexp the pattern to examine
+        # @return [String, nil] the literal prefix, or nil if it's a real regexp
+        def literal_prefix(regexp)
+          return nil unless regexp.options == 0
+          source = regexp.source
+          return nil unless source[0, 1] == "^"
+          
+          literal, rest = "", source[1..-1]
+          until rest.empty?
+            if rest =~ /\A\\([^a-zA-Z0-9])/  # escaped punctuation is literal
+              literal << $1
+            elsif rest =~ /\A[^.*+?()\[\]{}|^$\\]+/
+              literal << $&
+            else
+              return nil
+            end
+            rest = $'
+          end
+          literal
+        end
+      end
+      
     end
   end
 end
\ No newline at end of file
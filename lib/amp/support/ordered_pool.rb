@@ -0,0 +1,135 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+require 'thread'
+
+module Amp
+  module Support
+    ##
+    # = OrderedPool
+    # Runs a block over a stream of items on a few worker threads, and hands
+    # the results back in the order the items went in - no matter which
+    # worker finished first. Only +window+ items may be in flight at once,
+    # so pushing more waits for the oldest result; that keeps memory flat
+    # however many items go by.
+    #
+    # Results are handed to the #on_result block in the pushing thread, so
+    # it doesn't need to be thread-safe.
+    #
+    # @example
+    #   pool = OrderedPool.new(4) {|block| Zlib::Deflate.deflate block }
+    #   pool.on_result {|compressed| out.write compressed }
+    #   blocks.each {|block| pool << block }
+    #   pool.finish
+    class OrderedPool
+      ##
+      # Starts the workers.
+      #
+      # @param [Integer] threads how many workers to run
+      # @param [Integer] window how many items may be in flight at once
+      # @yield [item] the work. Runs on the workers.
+      # @yieldreturn the result, passed to the #on_result block
+      def initialize(threads, window = threads * 4, &work)
+        @work    = work
+        @window  = [window, 1].max
+        @jobs    = Queue.new
+        @results = {}
+        @lock    = Mutex.new
+        @ready   = ConditionVariable.new
+        @pushed  = @emitted = 0
+        @threads = Array.new([threads, 1].max) { Thread.new { run } }
+      end
+
+      ##
+      # Sets the block that receives each result, in order.
+      #
+      # @yield [result] a result
+      # @return [OrderedPool] self
+      def on_result(&block)
+        @output = block
+        self
+      end
+
+      ##
+      # Queues up an item. Any results that are ready (in order) are handed
+      # out first, and if the window's full, we wait for the oldest. If an
+      # item's work raised an exception, it's raised here.
+      #
+      # @param item the item to work on
+      # @return [OrderedPool] self
+      def <<(item)
+        @jobs << [@pushed, item]
+        @pushed += 1
+        emit_next while @pushed - @emitted >= @window || ready?
+        self
+      end
+
+      ##
+      # Waits for the rest of the results, hands them out, and stops the
+      # workers.
+      def finish
+        emit_next while @emitted < @pushed
+      ensure
+        stop
+      end
+
+      ##
+      # Stops the workers, dropping anything that hasn't been started. Safe
+      # to call more than once.
+      def stop
+        return unless @threads
+        @jobs.clear
+        @threads.each { @jobs << nil }
+        @threads.each {|thread| thread.join }
+        @threads = nil
+      end
+
+      private
+
+      ##
+      # A worker: take an item, do the work, file the result under the
+      # item's index.
+      def run
+        while job = @jobs.pop
+          index, item = job
+          result = begin
+            [true, @work.call(item)]
+          rescue Exception => err
+            [false, err]
+          end
+          @lock.synchronize do
+            @results[index] = result
+            @ready.broadcast
+          end
+        end
+      end
+
+      def ready?
+        @lock.synchronize { @results.has_key? @emitted }
+      end
+
+      ##
+      # Waits for the next result in line, and hands it out.
+      def emit_next
+        ok, value = @lock.synchronize do
+          @ready.wait(@lock) until @results.has_key? @emitted
+          @results.delete @emitted
+        end
+        @emitted += 1
+        raise value unless ok
+        @output.call value if @output
+      end
+    end
+  end
+end
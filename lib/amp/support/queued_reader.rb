@@ -0,0 +1,157 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+require 'thread'
+
+module Amp
+  module Support
+    ##
+    # = QueuedReader
+    # An IO-alike that reads chunks produced by another thread. The producer
+    # (say, a network read) runs in the background and hands its chunks over
+    # through a bounded queue, so it can keep reading while we're busy with
+    # the last chunk - but it can never get more than a few chunks ahead of
+    # us, so memory use stays flat no matter how much data goes by.
+    #
+    # @example
+    #   reader = QueuedReader.new do |sink|
+    #     response.read_body {|chunk| sink << chunk }
+    #   end
+    #   reader.gets # => the first line of the body
+    class QueuedReader
+      # How many chunks the producer may get ahead of us by default
+      DEFAULT_DEPTH = 16
+
+      ##
+      # Starts the producer thread.
+      #
+      # @param [Integer] depth how many chunks may be waiting at once
+      # @yield [sink] the producer. Runs in its own thread.
+      # @yieldparam [#<<] sink push each chunk of data onto this. The stream
+      #   ends when the block returns.
+      def initialize(depth = DEFAULT_DEPTH, &producer)
+        @queue  = SizedQueue.new depth
+        @buffer = ""
+        @eof    = false
+        @error  = nil
+        @aborted = false
+        @thread = Thread.new do
+          begin
+            producer.call @queue
+          rescue Exception => err
+            @error = err
+          ensure
+            # nobody's reading after an abort, and the queue may be full
+            @queue << nil unless @aborted
+          end
+        end
+      end
+
+      ##
+      # Reads up to +length+ bytes, or everything up to EOF if no length is
+      # given. Only returns fewer than +length+ bytes at the end of the stream.
+      #
+      # @param [Integer] length how many bytes to read
+      # @return [String, nil] the data, or nil at EOF
+      def read(length = nil)
+        if length
+          fill until @eof || @buffer.size >= length
+          return nil if @buffer.empty? && length > 0
+          @buffer.slice!(0, length)
+        else
+          fill until @eof
+          @buffer.slice!(0, @buffer.size)
+        end
+      end
+
+      ##
+      # Reads whatever's already arrived, up to +length+ bytes, waiting only
+      # if nothing has. Like IO#readpartial, for passing data along as soon
+      # as it's made rather than in fixed-size pieces.
+      #
+      # @param [Integer] length the most bytes to return
+      # @return [String] the data
+      # @raise [EOFError] if the stream is over
+      def readpartial(length)
+        fill while @buffer.empty? && !@eof
+        raise EOFError.new("end of stream") if @buffer.empty?
+        @buffer.slice!(0, length)
+      end
+      
+      ##
+      # Reads a line, including its newline.
+      #
+      # @return [String, nil] the line, or nil at EOF
+      def gets
+        fill until @eof || @buffer.index("\n")
+        return nil if @buffer.empty?
+        newline = @buffer.index("\n")
+        @buffer.slice!(0, newline ? newline + 1 : @buffer.size)
+      end
+
+      ##
+      # Are we out of data?
+      def eof?
+        fill if @buffer.empty? && !@eof
+        @buffer.empty? && @eof
+      end
+
+      ##
+      # Lets the producer finish, dropping anything we haven't read, and
+      # waits for its thread. Whatever it's reading from is left in a sane
+      # state that way - a half-read HTTP response, say, would otherwise try
+      # to read the rest of itself again later. If the producer failed, its
+      # exception is raised here. Does nothing after {#abort}.
+      def close
+        return nil if @aborted
+        until @eof
+          @buffer = ""
+          fill
+        end
+        @buffer = ""
+        @thread.join
+        nil
+      end
+      
+      ##
+      # Stops the producer where it is, and drops anything unread. Only for
+      # when something's already gone wrong: whatever the producer was
+      # reading from can't be trusted afterward. Doesn't wait for the
+      # producer's thread, which may be stuck pushing onto a full queue
+      # until it's killed.
+      def abort
+        @aborted = true
+        @thread.kill if @thread.alive?
+        @queue.clear
+        @buffer, @eof = "", true
+        nil
+      end
+
+      private
+
+      ##
+      # Takes the next chunk off the queue, waiting for it if need be. If the
+      # producer died, its exception is raised here, in the reading thread.
+      def fill
+        chunk = @queue.pop
+        if chunk.nil?
+          @eof = true
+          raise @error if @error
+        else
+          @buffer << chunk
+        end
+      end
+    end
+  end
+end
@@ -675,6 +675,18 @@ class Integer
   alias_method :gigabyte, :gigabytes
   alias_method :gb,       :gigabytes
   
+  ##
+  # Formats the number, taken as a count of bytes, for people to read.
+  #
+  # @example 1536.to_human # => "1.5 KB"
+  # @return [String] the size in the biggest unit that keeps it above 1
+  def to_human
+    return "#{self} bytes" if self < 1.kb
+    [[1.gb, "GB"], [1.mb, "MB"], [1.kb, "KB"]].each do |size, unit|
+      return "#{"%.1f" % (to_f / size)} #{unit}" if self >= size
+    end
+  end
+  
 end
 
 class String
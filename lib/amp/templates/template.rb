@@ -88,7 +88,8 @@ module Amp
         end
       end
       
-      attr_accessor :name, :renderer, :text
+      attr_accessor :name, :type, :renderer
+      attr_reader :text
       
       ##
       # Creates a new template with the given values. The name is how you will reference the
@@ -100,39 +101,107 @@ module Amp
       # @param [String] text the text of the template, which presumably has some templating
       #   code to substitute in local variables and make a nice output system.
       def initialize(type, name, renderer = :erb, text = "")
-        @name, @renderer, @text = name, renderer, text
+        @type, @name, @renderer = type, name, renderer
+        self.text = text
         Template.register(type, name, self)
       end
       
+      ##
+      # Changes the text of the template, throwing away anything compiled from
+      # the old text.
+      #
+      # @param [String] text the new text of the template
+      def text=(text)
+        @text = text
+        @compiled = {}
+        @erb_source = @haml_engine = nil
+      end
+      
       ##
       # Renders the template with the given local variables. Uses whichever templating engine
       # you set. Note: if you use HAML, you'll need to have HAML installed. This is why none
       # of the default templates use HAML.
       #
-      # @param [Hash] locals the local variables passed to the template. Works for HAML so far,
-      #   not for erb.
+      # The template is only parsed once, but the Ruby it turns into still has to be
+      # evaluated in the binding on every call. If you're rendering a lot of things
+      # (like every changeset in the repo), use {#render_into}.
+      #
+      # @param [Hash] locals the local variables passed to the template.
       # @return [String] the parsed template
-      # @todo make locals work for ERb without bootleg hax
       def render(locals = {}, render_binding = binding)
         # expose this local to make it easier, even if it's nil
         
         case renderer.to_sym
         when :erb
-          require 'erb'
           locals_assigns = locals.map { |k,v| "#{k} = locals[#{k.inspect}]" }
           eval locals_assigns.join("\n"), render_binding
           
-          erb = ERB.new(text, 0, "-")
-          erb.result render_binding
+          eval "_amp_out = ''\n#{erb_source}\n_amp_out", render_binding
+        when :haml
+          haml_engine.render render_binding, locals
+        end
+      end
+      
+      ##
+      # Renders the template onto the end of +out+. The template is compiled into
+      # a proc the first time it's used with a given set of local variable names
+      # (and kind of context), and that proc is reused from then on, so rendering
+      # it over and over again costs about as much as a method call.
+      #
+      # @param [#<<] out where to write the rendered template
+      # @param [Hash] locals the local variables passed to the template
+      # @param [Object] context the object the template runs inside of - any
+      #   methods it calls that aren't locals are sent here
+      # @return [#<<] out
+      def render_into(out, locals = {}, context = nil)
+        case renderer.to_sym
+        when :erb
+          context.instance_exec(out, locals, &compiled(locals, context))
         when :haml
+          out << haml_engine.render(context || Object.new, locals)
+        end
+        out
+      end
+      
+      private
+      
+      ##
+      # The template as Ruby code, which appends to +_amp_out+ as it runs.
+      def erb_source
+        @erb_source ||= begin
+          require 'erb'
+          compiler = ERB::Compiler.new("-")
+          compiler.pre_cmd  = []
+          compiler.post_cmd = []
+          compiler.put_cmd  = compiler.insert_cmd = "_amp_out.concat"
+          source = compiler.compile(text)
+          source.is_a?(Array) ? source.first : source # newer ERBs add the encoding
+        end
+      end
+      
+      ##
+      # The Haml engine for the template. Building one parses the template, so
+      # we only do it once.
+      def haml_engine
+        @haml_engine ||= begin
           require 'rubygems'
           require 'haml'
-          haml = Haml::Engine.new(text)
-          haml.render render_binding, locals
+          Haml::Engine.new(text)
         end
       end
       
-      private
+      ##
+      # The template compiled into a proc that takes the output and the
+      # locals. The locals are unpacked into real local variables up front,
+      # so each set of local variable names gets its own proc.
+      def compiled(locals, context)
+        key = [context.class, locals.keys.sort_by {|k| k.to_s }]
+        @compiled[key] ||= begin
+          assigns = key.last.map {|k| "#{k} = _amp_locals[#{k.inspect}]\n" }.join
+          source  = "proc do |_amp_out, _amp_locals|\n#{assigns}#{erb_source}\n_amp_out\nend"
+          context.class.class_eval source, "(template #{type}/#{name})", 0
+        end
+      end
       
     end
     
@@ -155,10 +224,33 @@ module Amp
           renderer = KNOWN_EXTENSIONS.select {|ext| file.end_with? ext}.first
         end
         raise ArgumentError.new("No renderer specified for #{file.inspect}") if renderer.nil?
-        @file = file
+        @file  = file
+        @mtime = File.mtime(file)
         super(type, name, renderer, File.read(file))
       end
       
+      ##
+      # The text of the template. If the file has been changed since we read
+      # it, it's read again (and recompiled when next rendered).
+      def text
+        mtime = File.mtime(file) rescue @mtime
+        if mtime != @mtime
+          @mtime = mtime
+          self.text = File.read(file)
+        end
+        super
+      end
+      
+      def render(*args)
+        text # pick up any changes to the file
+        super
+      end
+      
+      def render_into(*args)
+        text
+        super
+      end
+      
       def save!
         File.open(file, "w") { |out| out.write text }
       end
@@ -169,6 +261,18 @@ module Amp
     # Class for specifying a tiny bit of text to be interpreted as ERb code, and
     # using that as a template.
     class RawERbTemplate < Template
+      @cache = {}
+      
+      ##
+      # The raw template for the given text, made the first time it's asked for
+      # so it's only compiled once.
+      #
+      # @param [String] text the ERb (or a plain Ruby expression) to render
+      # @return [RawERbTemplate] the template
+      def self.for(text)
+        @cache[text] ||= new(text)
+      end
+      
       def initialize(text)
         text = "<%= #{text} %>" unless text.include?("<%")
         super(:raw, "raw#{(rand * 65535).to_i}", :erb, text)
@@ -177,16 +281,3 @@ module Amp
     
   end
 end
-
-module Amp
-  module KernelMethods
-    def template(name, *args)
-      if args.size > 2 || args.empty?
-        raise ArgumentError.new('Usage of template: template(name, text)'+
-                                'or template(name, renderer, text)')
-      end
-      template = (args.size > 1) ? args[0] : :erb
-      Support::Template.new(:all, name, template, args.last)
-    end
-  end
-end
\ No newline at end of file
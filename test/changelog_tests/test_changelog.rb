@@ -86,6 +86,30 @@ of stuff"
     assert_equal({"branch" => "silly", "close" => "1"}, result[5])
   end
   
+  def test_decoding_entry_without_files_or_extra
+    def @changelog.decompress_revision(*args)
+      "1023456789010234567890102345678901023456\nadgar\n1271004470 14400\n\none line"
+    end
+    result = @changelog.read("abcde")
+    assert_equal "one line", result.description
+    assert_equal [], result.files
+    assert_equal "adgar", result.user
+    assert_equal [1271004470, 14400], result.time
+    assert_equal({"branch" => "default"}, result.extra)
+  end
+  
+  def test_each_field
+    def @changelog.node_id_for_index(index); index; end
+    def @changelog.decompress_revision(index)
+      "1023456789010234567890102345678901023456\nuser#{index}\n0 0 branch:b#{index}\nfile\n\ndesc"
+    end
+    assert_equal ["user1", "user2", "user3"], @changelog.each_field(:user, 1..3)
+    branches = []
+    @changelog.each_field(:branch, [4, 2]) {|index, branch| branches << [index, branch] }
+    assert_equal [[4, "b4"], [2, "b2"]], branches
+    assert_raises(ArgumentError) { @changelog.each_field(:color, 1..1) }
+  end
+  
   def test_add_changes_invalid_username_raises
     assert_raises(Amp::Mercurial::RevlogSupport::RevlogError) do
       @changelog.add(nil, nil, nil, nil, nil, nil, "invalid\nusername")
@@ -0,0 +1,63 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+require File.join(File.expand_path(File.dirname(__FILE__)), '../testutilities')
+require File.expand_path(File.join(File.dirname(__FILE__), "../../lib/amp"))
+
+class TestHashCache < AmpTestCase
+  HashCache = Amp::Repositories::Mercurial::HashCache
+  NODE = "\1" * 20
+  
+  def setup
+    super
+    @file  = write_file("file") {|io| io << "contents" }
+    @cache = File.join(tempdir, "cache", "hashcache")
+    File.utime Time.now - 3600, Time.now - 3600, @file
+  end
+  
+  def test_remembers_across_saves
+    cache = HashCache.new @cache
+    cache["file", File.lstat(@file)] = NODE
+    cache.write
+    assert_equal NODE, HashCache.new(@cache)["file", File.lstat(@file)]
+  end
+  
+  def test_forgets_changed_files
+    cache = HashCache.new @cache
+    cache["file", File.lstat(@file)] = NODE
+    File.utime Time.now - 60, Time.now - 60, @file
+    assert_nil cache["file", File.lstat(@file)]
+  end
+  
+  def test_racy_files_are_not_saved
+    File.utime Time.now, Time.now, @file
+    cache = HashCache.new @cache
+    cache["file", File.lstat(@file)] = NODE
+    cache.write
+    assert_nil HashCache.new(@cache)["file", File.lstat(@file)]
+  end
+  
+  def test_non_ascii_paths
+    name = "\303\251.txt" # é.txt
+    name.force_encoding "UTF-8" if name.respond_to? :force_encoding
+    cache = HashCache.new @cache
+    cache[name, File.lstat(@file)] = NODE
+    cache["file", File.lstat(@file)] = NODE
+    cache.write
+    
+    reread = HashCache.new(@cache)
+    assert_equal NODE, reread[name, File.lstat(@file)]
+    assert_equal NODE, reread["file", File.lstat(@file)]
+  end
+end
@@ -100,6 +100,35 @@ class TestLocalRepo < AmpTestCase
     assert_equal expected, actual
   end
   
+  def test_known
+    nodes = [@repo[0].node, "\1" * 20, @repo[3].node]
+    assert_equal [true, false, true], @repo.known(nodes)
+  end
+  
+  def test_get_bundle_starts_at_the_missing_roots
+    def @repo.changegroup_subset(roots, heads, source); [roots, heads]; end
+    
+    assert_equal [[@repo[2].node], [@repo[3].node]], @repo.get_bundle([@repo[1].node], [], :serve)
+    assert_equal [[@repo[0].node], [@repo[2].node]], @repo.get_bundle([], [@repo[2].node], :serve)
+  end
+  
+  def test_common_nodes_by_sampling
+    new_head = "\xff" * 20
+    remote = Object.new
+    remote.instance_variable_set :@nodes, [@repo[0].node, @repo[1].node]
+    remote.instance_variable_set :@heads, [@repo[1].node, new_head]
+    def remote.capable?(capability); %w(known getbundle).include? capability; end
+    def remote.batch(calls); calls.map {|command, *args| send command, *args }; end
+    def remote.heads; @heads; end
+    def remote.known(nodes); nodes.map {|node| @nodes.include? node }; end
+    
+    assert @repo.sampling_discovery?(remote)
+    base = {}
+    assert_equal [[@repo[1].node], [new_head], [new_head]],
+                 @repo.common_nodes(remote, :base => base)
+    assert_equal [@repo[1].node], base.keys
+  end
+  
   def test_status
     
     actual = @repo.status(:ignored => true, :clean => true, :unknown => true,
@@ -278,6 +278,19 @@ class TestRevlog < AmpTestCase
                " diff. they're fixed with hacks. test in for a complex unified diff!"
     assert_equal expected, result
   end
+  
+  def test_prefetch_chunks
+    plain    = Amp::Mercurial::Revlog.new(@opener, TEST_REVLOG_INDEX)
+    expected = 50.downto(40).map {|rev| plain.decompress_revision plain.node_id_for_index(rev) }
+    
+    @revlog.prefetch_chunks 40, 50
+    cache = @revlog.instance_variable_get(:@chunk_cache)[1]
+    actual = 50.downto(40).map {|rev| @revlog.decompress_revision @revlog.node_id_for_index(rev) }
+    assert_equal expected, actual
+    # everything came out of the one read
+    assert_same cache, @revlog.instance_variable_get(:@chunk_cache)[1]
+  end
+  
   def test_revlog_add_revision
     cmp_file = "./test/revlog_tests/revision_added_changelog.i"
     new_file = "./test/revlog_tests/test_adding_index.i"
@@ -18,6 +18,7 @@ require File.expand_path(File.join(File.dirname(__FILE__), "../../lib/amp"))
 class TestFilenameCacheStore < AmpTestCase
   STORE_PATH = File.expand_path(File.join(File.dirname(__FILE__)))
   def setup
+    super
     @store = Amp::Repositories::Mercurial::Stores.pick(['store','fncache'], STORE_PATH, Amp::Opener)
   end
   
@@ -45,6 +46,63 @@ class TestFilenameCacheStore < AmpTestCase
     assert_equal expected, result
   end
   
+  def test_hybrid_encode_cache
+    stores = Amp::Repositories::Mercurial::Stores
+    path   = "data/lib/AMP.rb.i"
+    assert_equal "data/lib/_a_m_p.rb.i", stores.hybrid_encode(path)
+    assert_equal "data/lib/_a_m_p.rb.i", stores.hybrid_encode(path)
+    
+    size = stores.encoded_path_cache_size
+    stores.encoded_path_cache_size = 0
+    assert_equal "data/lib/_a_m_p.rb.i", stores.hybrid_encode(path)
+    assert_equal "00changelog.i", stores.hybrid_encode("00changelog.i")
+  ensure
+    stores.encoded_path_cache_size = size
+  end
+  
+  def test_auxilliary_encode
+    stores = Amp::Repositories::Mercurial::Stores
+    assert_equal "data/au~78.c/co~6e", stores.auxilliary_encode("data/aux.c/con")
+    assert_equal "data/com9/foo~2e/bar~20", stores.auxilliary_encode("data/com9/foo./bar ")
+    assert_equal ".con/auxiliary", stores.auxilliary_encode(".con/auxiliary")
+  end
+  
+  def test_fncache_appends_wait_for_journal
+    FileUtils.mkdir_p tempdir
+    opener = Amp::Opener.new(tempdir)
+    opener.default = :open_file
+    fncache = Amp::Repositories::Mercurial::Stores::FilenameCache::FilenameCacheOpener.new(opener)
+    fncache_file = File.join(tempdir, "fncache")
+    
+    journal = Amp::Mercurial::Journal.new(:journal => File.join(tempdir, "journal"), :opener => fncache)
+    fncache.add_filename "data/a.i"
+    fncache.add_filename "data/b.i"
+    fncache.add_filename "data/a.i"
+    assert !File.exist?(fncache_file)
+    journal.close
+    assert_file_contents fncache_file, "data/a.i\ndata/b.i\n"
+    
+    journal = Amp::Mercurial::Journal.new(:journal => File.join(tempdir, "journal"), :opener => fncache)
+    fncache.add_filename "data/rolled_back.i"
+    journal.delete
+    
+    fncache.add_filename "data/c.i" # no journal, so it's written right away
+    assert_file_contents fncache_file, "data/a.i\ndata/b.i\ndata/c.i\n"
+    assert_equal %w(data/a.i data/b.i data/c.i), fncache.filenames.sort
+  end
+  
+  def test_walk_sends_changelog_last
+    FileUtils.mkdir_p File.join(tempdir, "data", "sub")
+    %w(00changelog.i 00manifest.i data/a.i data/sub/b.d).each do |f|
+      File.open(File.join(tempdir, f), "w") {|fp| fp.write f }
+    end
+    store = Amp::Repositories::Mercurial::Stores.pick([], tempdir, Amp::Opener)
+    
+    names = store.walk.map {|name, path, size| name }
+    assert_equal %w(data/a.i data/sub/b.d 00manifest.i 00changelog.i), names
+    assert_equal store.walk.map {|e| e[2] }, names.map {|n| n.size }
+  end
+  
   def test_normal_encode
     result = Amp::Repositories::Mercurial::Stores.encode_filename("data/ABCDEFGHIJKLMNOPQRSTUVWXYZ/HAHAH"+
                                        "A????WHHHHHHHHHHHAAAAAAAAATTTTTTTTTT/"+
@@ -0,0 +1,94 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+require File.join(File.expand_path(File.dirname(__FILE__)), 'testutilities')
+require File.expand_path(File.join(File.dirname(__FILE__), "../lib/amp"))
+
+class TestArchiver < AmpTestCase
+  include Amp::Support
+  
+  FILES = [["a", "hello\n", 0644], ["dir/b", "x" * 300_000, 0755], ["dir/c", "", 0644]]
+  
+  def setup
+    super
+    FileUtils.mkdir_p tempdir
+  end
+  
+  def archive(type, name, threads = 3)
+    dest = File.join(tempdir, name)
+    Archiver.open(type, dest, :prefix => "pre", :mtime => 1262304000, :threads => threads) do |archive|
+      archive.write(FILES) {|file| file }
+    end
+    dest
+  end
+  
+  def test_gzip_stream_spans_blocks
+    data = (0...100_000).map {|i| "line #{i}\n" }.join
+    out  = StringIO.new
+    stream = Archiver::GzipStream.new(out, 3)
+    data.scan(/.{1,5000}/m) {|chunk| stream.write chunk }
+    stream.finish
+    assert_equal data, Zlib::GzipReader.new(StringIO.new(out.string)).read
+  end
+  
+  def test_tgz_contents
+    files = {}
+    Zlib::GzipReader.open(archive("tgz", "out.tgz")) do |gz|
+      Archive::Tar::Minitar::Reader.open(gz) do |tar|
+        tar.each_entry {|entry| files[entry.full_name] = [entry.read.to_s, entry.mode] }
+      end
+    end
+    assert_equal ["hello\n", 0644], files["pre/a"]
+    assert_equal ["x" * 300_000, 0755], files["pre/dir/b"]
+    assert_equal ["", 0644], files["pre/dir/c"]
+  end
+  
+  def test_output_does_not_depend_on_threads
+    %w(tgz zip).each do |type|
+      assert_equal File.open(archive(type, "one.#{type}", 1), "rb") {|f| f.read },
+                   File.open(archive(type, "many.#{type}", 4), "rb") {|f| f.read }
+    end
+  end
+  
+  def test_zip_members
+    data = File.open(archive("zip", "out.zip"), "rb") {|f| f.read }
+    assert_equal [0x04034b50], data[0, 4].unpack("V")
+    assert_equal 3, data[-22..-1].unpack("VvvvvVVv")[3]
+    assert data.index("pre/dir/b")
+    assert data.size < 300_000 # dir/b was deflated
+  end
+  
+  def test_zip_non_ascii_names
+    prefix, name = "pr\303\251", "\303\251t\303\251" # pré/été
+    if prefix.respond_to? :force_encoding
+      prefix.force_encoding "UTF-8"
+      name.force_encoding "UTF-8"
+    end
+    dest = File.join(tempdir, "utf8.zip")
+    Archiver.open("zip", dest, :prefix => prefix, :mtime => 1262304000) do |archive|
+      archive.write([[name, "hello\n", 0644], ["a", "hi\n", 0644]]) {|file| file }
+    end
+    
+    data = File.open(dest, "rb") {|f| f.read }
+    length = data[26, 2].unpack("v").first
+    assert_equal Archiver.binary("pr\303\251/\303\251t\303\251"), data[30, length]
+    assert_equal 0x800, data[6, 2].unpack("v").first
+    central = data[-22..-1].unpack("VvvvvVVv")[6]
+    assert_equal [0x02014b50], data[central, 4].unpack("V")
+  end
+  
+  def test_unknown_type
+    assert_raises(ArgumentError) { Archiver.new("rar", File.join(tempdir, "x.rar")) }
+  end
+end
@@ -0,0 +1,74 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+require File.join(File.expand_path(File.dirname(__FILE__)), 'testutilities')
+require File.expand_path(File.join(File.dirname(__FILE__), "../lib/amp"))
+begin
+  require File.expand_path(File.join(File.dirname(__FILE__), "../lib/amp/server/extension/amp_extension"))
+rescue LoadError
+  # no sinatra - the server side can't be tested
+end
+
+class TestBatch < AmpTestCase
+  Batch = Amp::Mercurial::Batch
+
+  def test_escape_round_trip
+    plain = "a:b,c;d=e::,;=:c"
+    escaped = Batch.escape plain
+    assert escaped !~ /[,;=]/
+    assert_equal plain, Batch.unescape(escaped)
+  end
+
+  def test_args_round_trip
+    args = {"key" => "x=y,z", "pairs" => "ab-cd ef-01", "empty" => ""}
+    encoded = Batch.encode_args args
+    assert_equal 2, encoded.count(",")
+    assert_equal args, Batch.decode_args(encoded)
+    assert_equal({}, Batch.decode_args(nil))
+  end
+
+  ##
+  # Just enough of a Sinatra request for the AmpRepoMethods helpers.
+  class FakeRequest
+    include Sinatra::AmpRepoMethods if defined? Sinatra::AmpRepoMethods
+    attr_accessor :params
+    def headers(*args); end
+  end
+
+  def test_server_batch
+    return unless defined? Sinatra::AmpRepoMethods
+    repo = Object.new
+    def repo.heads; ["\1" * 20, "\2" * 20]; end
+    def repo.branches(*nodes); nodes.map {|n| [n, "\3" * 20] }; end
+
+    request = FakeRequest.new
+    request.params = {"cmd" => "batch",
+                      "cmds" => "heads ;branches #{Batch.encode_args "nodes" => "01" * 20}"}
+    heads, branches = request.amp_get_batch(repo).split(";", -1).map {|body| Batch.unescape body }
+    assert_equal "#{"01" * 20} #{"02" * 20}\n", heads
+    assert_equal "#{"01" * 20} #{"03" * 20}\n", branches
+    assert_equal "batch", request.params["cmd"]
+  end
+
+  def test_server_known
+    return unless defined? Sinatra::AmpRepoMethods
+    repo = Object.new
+    def repo.known(nodes); nodes.map {|n| n == "\1" * 20 }; end
+
+    request = FakeRequest.new
+    request.params = {"cmd" => "batch",
+                      "cmds" => "known #{Batch.encode_args "nodes" => "#{"01" * 20} #{"02" * 20}"}"}
+    assert_equal "10", Batch.unescape(request.amp_get_batch(repo))
+  end
+end
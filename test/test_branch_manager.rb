@@ -0,0 +1,187 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+require File.join(File.expand_path(File.dirname(__FILE__)), 'testutilities')
+require File.expand_path(File.join(File.dirname(__FILE__), "../lib/amp"))
+
+##
+# Runs the branch cache against a made-up changelog, which remembers which
+# revisions have had their branch looked up. The cache file is real.
+class TestBranchManager < AmpTestCase
+  NULL_ID  = Amp::Mercurial::RevlogSupport::Node::NULL_ID
+  NULL_REV = Amp::Mercurial::RevlogSupport::Node::NULL_REV
+
+  class FakeChangelog
+    attr_reader :scanned
+
+    def initialize
+      @revs, @scanned, @next_node = [], [], 1
+    end
+
+    ##
+    # Adds a revision on +branch+, with the given parent revisions (the
+    # previous revision, by default).
+    def add(branch, *parents)
+      parents = [size - 1] if parents.empty?
+      @revs << [[@next_node].pack("N") * 5, parents, branch]
+      @next_node += 1
+      size - 1
+    end
+
+    ##
+    # Throws away every revision from +rev+ on, like strip and rollback do.
+    def strip(rev)
+      @revs.slice!(rev..-1)
+    end
+
+    def size; @revs.size; end
+    def tip; size.zero? ? NULL_ID : @revs.last[0]; end
+    def node_id_for_index(rev); @revs[rev][0]; end
+
+    def parent_indices_for_index(rev)
+      (@revs[rev][1] + [NULL_REV, NULL_REV])[0, 2]
+    end
+
+    def each_field(field, indices)
+      indices.each do |rev|
+        @scanned << rev
+        yield rev, @revs[rev][2]
+      end
+    end
+  end
+
+  class FakeRepo
+    include Amp::Repositories::Mercurial::BranchManager
+    attr_reader :changelog
+
+    def initialize(changelog, dir)
+      @changelog = changelog
+      @hg_opener = Amp::Opener.new dir
+      @hg_opener.default = :open_file
+    end
+  end
+
+  def setup
+    super
+    FileUtils.mkdir_p tempdir
+    @changelog = FakeChangelog.new
+    # default: 0 - 1 - 2 - 3
+    #               \
+    # stable:        4 - 5
+    4.times { @changelog.add "default" }
+    @changelog.add "stable", 1
+    @changelog.add "stable"
+  end
+
+  ##
+  # A new repository object, so the cache comes from disk - as it would for
+  # the next amp command.
+  def repo
+    FakeRepo.new @changelog, tempdir
+  end
+
+  def node(rev)
+    @changelog.node_id_for_index rev
+  end
+
+  ##
+  # The heads, as worked out from scratch.
+  def expected_heads
+    File.unlink File.join(tempdir, "branchheads.cache")
+    heads = repo.update_branch_cache!
+    @changelog.scanned.clear
+    heads
+  end
+
+  def test_scans_everything_without_a_cache
+    heads = repo.update_branch_cache!
+    assert_equal [node(3)], heads["default"]
+    assert_equal [node(5)], heads["stable"]
+    assert_equal((0..5).to_a, @changelog.scanned)
+    assert File.exist?(File.join(tempdir, "branchheads.cache"))
+  end
+
+  def test_up_to_date_cache_is_not_scanned_again
+    manager = repo
+    manager.update_branch_cache!
+    @changelog.scanned.clear
+
+    manager.update_branch_cache!
+    repo.update_branch_cache!
+    assert_equal [], @changelog.scanned
+  end
+
+  def test_extends_the_cache_across_new_revisions
+    repo.update_branch_cache!
+    @changelog.add "default"        # 6, on 5 - a new default head
+    @changelog.add "stable", 5      # 7
+    @changelog.add "stable", 6, 7   # 8, merging them
+    @changelog.scanned.clear
+
+    heads = repo.update_branch_cache!
+    assert_equal [6, 7, 8], @changelog.scanned
+    assert_equal [node(3), node(6)], heads["default"]
+    assert_equal [node(8)], heads["stable"]
+    assert_equal expected_heads, heads
+  end
+
+  def test_memory_cache_is_extended_too
+    manager = repo
+    manager.update_branch_cache!
+    @changelog.add "stable"
+    @changelog.scanned.clear
+
+    assert_equal [node(6)], manager.update_branch_cache!["stable"]
+    assert_equal [6], @changelog.scanned
+  end
+
+  def test_rebuilt_after_rollback
+    repo.update_branch_cache!
+    @changelog.strip 5
+    @changelog.scanned.clear
+
+    heads = repo.update_branch_cache!
+    assert_equal((0..4).to_a, @changelog.scanned)
+    assert_equal [node(4)], heads["stable"]
+  end
+
+  def test_rebuilt_when_the_cached_tip_was_replaced
+    repo.update_branch_cache!
+    # strip 4 and 5, and commit two more - the cache's tip number is still
+    # in range, but it's a different revision
+    @changelog.strip 4
+    @changelog.add "default"
+    @changelog.add "other", 2
+    @changelog.scanned.clear
+
+    heads = repo.update_branch_cache!
+    assert_equal((0..5).to_a, @changelog.scanned)
+    assert !heads.has_key?("stable")
+    assert_equal [node(4)], heads["default"]
+    assert_equal [node(5)], heads["other"]
+  end
+
+  def test_invalidate_rereads_the_cache
+    manager = repo
+    manager.update_branch_cache!
+    @changelog.add "stable"
+    repo.update_branch_cache! # someone else updates the file
+    @changelog.scanned.clear
+
+    # the file's up to date now, so after invalidating nothing's scanned
+    manager.invalidate_branch_cache!
+    assert_equal [node(6)], manager.update_branch_cache!["stable"]
+    assert_equal [], @changelog.scanned
+  end
+end
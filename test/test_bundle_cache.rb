@@ -0,0 +1,114 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+require 'stringio'
+require File.join(File.expand_path(File.dirname(__FILE__)), 'testutilities')
+require File.expand_path(File.join(File.dirname(__FILE__), "../lib/amp"))
+
+class TestBundleCache < AmpTestCase
+  BundleCache = Amp::Servers::BundleCache
+
+  ##
+  # An uncompressed bundle that's only as far along as the test says: each
+  # read returns the next chunk pushed, and nil ends it.
+  class GatedSource
+    def initialize
+      @chunks = Queue.new
+    end
+
+    def <<(chunk)
+      @chunks << chunk
+      self
+    end
+
+    def read(length)
+      @chunks.pop
+    end
+  end
+
+  def setup
+    super
+    @dir   = File.join(tempdir, "bundles")
+    @cache = BundleCache.new @dir
+    @repo  = repo_at "\1" * 20
+    # incompressible, so the deflater has something to write right away
+    @data  = (0...200_000).map { rand(256) }.pack("C*")
+  end
+
+  def repo_at(tip)
+    Struct.new(:changelog).new(Struct.new(:tip).new(tip))
+  end
+
+  def fetch(repo = @repo, &generator)
+    @cache.fetch(repo, :changegroup, ["\0" * 20], [], &generator)
+  end
+
+  def contents(body)
+    data = ""
+    body.each {|chunk| data << chunk }
+    Zlib::Inflate.inflate data
+  end
+
+  def test_requests_share_a_build
+    source, builds = GatedSource.new, 0
+    first  = fetch { builds += 1; source }
+    second = fetch { builds += 1; source }
+    source << @data << nil
+
+    assert_equal @data, contents(first)
+    assert_equal @data, contents(second)
+    assert_equal @data, contents(fetch { builds += 1; StringIO.new("other") })
+    assert_equal 1, builds
+  end
+
+  def test_reader_waits_for_the_writer
+    source = GatedSource.new
+    chunks = Queue.new
+    reader = Thread.new do
+      fetch { source }.each {|chunk| chunks << chunk }
+      chunks << :done
+    end
+
+    source << @data
+    data = chunks.pop # got here before the build finished
+    source << @data << nil
+    while (chunk = chunks.pop) != :done
+      data << chunk
+    end
+    reader.join
+    assert_equal @data * 2, Zlib::Inflate.inflate(data)
+  end
+
+  def test_new_tip_expires_old_bundles
+    assert_equal @data, contents(fetch { StringIO.new @data }) # built
+    old = fetch { flunk "should have been cached" }
+    newer = fetch(repo_at("\2" * 20)) { StringIO.new "newer" }
+
+    assert_equal ["#{("\2" * 20).hexlify[0, 12]}-"],
+                 Dir[File.join(@dir, "*")].map {|path| File.basename(path)[0, 13] }
+    # already handed out, so it can still be read
+    assert_equal @data, contents(old)
+    assert_equal "newer", contents(newer)
+  end
+
+  def test_failed_build_is_retried
+    assert_raises(IOError) do
+      # it may fail before fetch opens it, or while we read it
+      contents(fetch { raise IOError.new("changegroup failed") })
+    end
+
+    assert_equal @data, contents(fetch { StringIO.new @data })
+    assert_equal [], Dir[File.join(@dir, "*.partial")]
+  end
+end
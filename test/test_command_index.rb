@@ -0,0 +1,130 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+require File.join(File.expand_path(File.dirname(__FILE__)), 'testutilities')
+require File.expand_path(File.join(File.dirname(__FILE__), "../lib/amp"))
+require File.expand_path(File.join(File.dirname(__FILE__), "../lib/amp/commands/command.rb"))
+require File.expand_path(File.join(File.dirname(__FILE__), "../lib/amp/commands/command_index.rb"))
+include Amp::KernelMethods
+
+##
+# Indexes a made-up set of commands: one global file, and one for the
+# :indexed workflow, written fresh into the tempdir for each test.
+class TestCommandIndex < AmpTestCase
+  CommandIndex = Amp::CommandIndex
+
+  def setup
+    super
+    @commands = File.join(tempdir, "commands")
+    FileUtils.mkdir_p @commands
+    @global = write_command "global_#{name}.rb", "idx_global_#{name}"
+    @flow   = write_command "flow_#{name}.rb", "idx_flow_#{name}", :fl
+
+    CommandIndex.cache_dir = File.join(tempdir, "cache")
+    reset_index
+    @saved_commands = Amp::Command.all_commands.dup
+    Amp::Command.all_commands.clear
+
+    global, flow = [@global], [@global, @flow]
+    @index = class << CommandIndex; self; end
+    @index.send :alias_method, :real_command_files, :command_files
+    @index.send :alias_method, :real_global_command_files, :global_command_files
+    @index.send(:define_method, :command_files) {|_| flow }
+    @index.send(:define_method, :global_command_files) { global }
+  end
+
+  def teardown
+    @index.send :alias_method, :command_files, :real_command_files
+    @index.send :alias_method, :global_command_files, :real_global_command_files
+    Amp::Command.all_commands.replace @saved_commands
+    CommandIndex.cache_dir = nil
+    reset_index
+    super
+  end
+
+  ##
+  # Forgets what's been indexed and loaded, as a new amp process would.
+  def reset_index
+    CommandIndex.instance_variable_set :@indexes, {}
+    CommandIndex.instance_variable_set :@loaded, {}
+  end
+
+  ##
+  # Forgets the made-up commands too, as if amp had just started.
+  def restart
+    reset_index
+    Amp::Command.all_commands.clear
+    $".delete @global
+    $".delete @flow
+  end
+
+  def write_command(file, command, *synonyms)
+    path = File.join(@commands, file)
+    File.open(path, "w") do |f|
+      f.puts "command :#{command} do |c|"
+      f.puts "  c.workflow :indexed"
+      f.puts "  c.synonym #{synonyms.map {|s| s.inspect }.join(", ")}" if synonyms.any?
+      f.puts "  c.desc 'for the test'"
+      f.puts "end"
+    end
+    path
+  end
+
+  def index_files
+    Dir[File.join(tempdir, "cache", "*")]
+  end
+
+  def test_index_is_saved_in_the_cache
+    CommandIndex.prepare :indexed
+    assert_equal 1, index_files.size
+    assert_match(/command_index-[0-9a-f]{12}\.indexed$/, index_files.first)
+    assert_equal [:"idx_global_#{name}", :"idx_flow_#{name}", :fl],
+                 CommandIndex.names_for_workflow(:indexed)
+  end
+
+  def test_synonym_loads_its_file
+    CommandIndex.prepare :indexed
+    restart
+
+    CommandIndex.prepare :indexed # fresh, so nothing's loaded
+    assert_nil Amp::Command.all_commands[:"idx_flow_#{name}"]
+    assert CommandIndex.require_command(:fl)
+    assert_not_nil Amp::Command.all_commands[:"idx_flow_#{name}"]
+    assert !CommandIndex.require_command(:fl) # already loaded
+    assert !CommandIndex.require_command(:nonexistent)
+  end
+
+  def test_changed_command_file_makes_the_index_stale
+    CommandIndex.prepare :indexed
+    restart
+    File.open(@flow, "a") {|f| f.puts "# changed" }
+    assert_nil CommandIndex.send(:index_for, :indexed)
+
+    CommandIndex.prepare :indexed
+    assert_not_nil CommandIndex.send(:index_for, :indexed)
+  end
+
+  def test_saved_from_outside_a_repository
+    # what the dispatcher does when there's no repository
+    CommandIndex.require_global
+    CommandIndex.prepare :indexed
+    assert_equal 1, index_files.size
+  end
+
+  def test_not_saved_when_commands_came_from_elsewhere
+    command(:"idx_elsewhere_#{name}") {|c| c.workflow :indexed }
+    CommandIndex.prepare :indexed
+    assert_equal [], index_files
+  end
+end
@@ -0,0 +1,190 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+require 'socket'
+require File.join(File.expand_path(File.dirname(__FILE__)), 'testutilities')
+require File.expand_path(File.join(File.dirname(__FILE__), "../lib/amp"))
+
+# the dispatcher is only loaded for the command line; the tests stand in
+# for it anyway
+module Amp
+  class Dispatch
+    def self.run; true; end
+  end unless defined? Amp::Dispatch
+end
+
+##
+# Runs a CommandServer in a thread, with Dispatch.run replaced by whatever
+# each test wants the "command" to do.
+class TestCommandServer < AmpTestCase
+  CommandChannel = Amp::Servers::CommandChannel
+
+  def setup
+    super
+    FileUtils.mkdir_p tempdir
+    @socket_path = File.join(tempdir, "cmdserver.sock")
+    @command = lambda { true }
+    command = lambda { @command.call }
+    @dispatch = class << Amp::Dispatch; self; end
+    @dispatch.send :alias_method, :real_run, :run
+    @dispatch.send(:define_method, :run) { command.call }
+  end
+
+  def teardown
+    @dispatch.send :alias_method, :run, :real_run
+    if @server
+      @server.kill
+      @server.join
+      trap("INT", "DEFAULT")
+      trap("TERM", "DEFAULT")
+    end
+    super
+  end
+
+  def start_server
+    @server = Thread.new { Amp::Servers::CommandServer.new(@socket_path).run! }
+    sleep 0.05 until File.socket? @socket_path
+  end
+
+  ##
+  # Sends a request, and collects every frame until the exit status.
+  def request(*argv)
+    channel = connect(*argv)
+    output, status = "", nil
+    loop do
+      # a server that's died leaves us waiting forever
+      flunk "the server stopped answering" unless IO.select([channel.socket], nil, nil, 10)
+      break unless frame = channel.read_frame
+      type, data = frame
+      case type
+      when 'o' then output << data
+      when 'I' then channel.write_frame 'i', ""
+      when 'r' then status = data.unpack("N").first
+      end
+    end
+    [output, status]
+  ensure
+    channel.socket.close if channel
+  end
+
+  def connect(*argv)
+    channel = CommandChannel.new UNIXSocket.new(@socket_path)
+    channel.write_frame 'R', CommandChannel.pack_request(tempdir, argv)
+    channel
+  end
+
+  def test_frames_count_bytes
+    left, right = UNIXSocket.pair
+    sending, receiving = CommandChannel.new(left), CommandChannel.new(right)
+    text = "caf\303\251 \342\230\203"
+    text.force_encoding("UTF-8") if text.respond_to? :force_encoding
+    sending.write_frame 'o', text
+    sending.write_frame 'e'
+
+    channel, data = receiving.read_frame
+    assert_equal 'o', channel
+    assert_equal CommandChannel.binary(text), data
+    assert_equal ['e', ""], receiving.read_frame
+
+    left.write "o\0\0\0\005ab" # cut off in the middle of the payload
+    left.close
+    assert_nil receiving.read_frame
+  ensure
+    right.close if right
+  end
+
+  def test_request_round_trip
+    payload = CommandChannel.pack_request "/some/dir", ["log", "", "-l", "3"]
+    assert_equal ["/some/dir", ["log", "", "-l", "3"]], CommandChannel.unpack_request(payload)
+    assert_equal ["/some/dir", []], CommandChannel.unpack_request(CommandChannel.pack_request("/some/dir", []))
+  end
+
+  def test_runs_commands_in_the_clients_directory
+    dirs = []
+    @command = lambda do
+      dirs << Dir.pwd
+      puts ARGV.join(" ")
+      true
+    end
+    start_server
+
+    assert_equal ["status -q\n", 0], request("status", "-q")
+    @command = lambda { dirs << Dir.pwd; print "no"; false }
+    assert_equal ["no", 1], request
+    assert_equal [File.expand_path(tempdir)] * 2, dirs.map {|dir| File.expand_path dir }
+  end
+
+  def test_stdin_is_read_from_the_client
+    @command = lambda { print $stdin.read.upcase; true }
+    start_server
+
+    channel = connect
+    assert_equal ['I', [4096].pack("N")], channel.read_frame
+    channel.write_frame 'i', "abc"
+    assert_equal 'I', channel.read_frame.first
+    channel.write_frame 'i', ""
+    assert_equal ['o', "ABC"], channel.read_frame
+    assert_equal ['r', [0].pack("N")], channel.read_frame
+    assert_nil channel.read_frame
+  ensure
+    channel.socket.close if channel
+  end
+
+  def test_client_hanging_up_mid_command
+    hung_up = Queue.new
+    @command = lambda do
+      print "first"
+      hung_up.pop
+      1000.times { print "x" * 4096 } # the output has nowhere to go
+      true
+    end
+    start_server
+
+    channel = connect
+    assert_equal ['o', "first"], channel.read_frame
+    channel.socket.close
+    hung_up << true
+
+    @command = lambda { print "still here"; true }
+    assert_equal ["still here", 0], request
+    assert @server.alive?
+  end
+
+  def test_client_hanging_up_before_an_error_is_reported
+    hung_up = Queue.new
+    @command = lambda do
+      print "first"
+      hung_up.pop
+      sleep 0.1 # for the hangup to reach the server
+      raise ArgumentError.new("the error goes to stderr, which is gone")
+    end
+    start_server
+
+    channel = connect
+    assert_equal ['o', "first"], channel.read_frame
+    channel.socket.close
+    hung_up << true
+
+    @command = lambda { true }
+    assert_equal ["", 0], request
+    assert @server.alive?
+  end
+
+  def test_default_socket_is_in_the_metadata_directory
+    repo = Amp::Repositories::Git::LocalRepository.allocate
+    repo.root = tempdir
+    assert_equal File.join(tempdir, ".git", "cmdserver.sock"),
+                 Amp::Servers::CommandServer.default_socket_for(repo)
+  end
+end
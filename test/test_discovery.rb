@@ -0,0 +1,144 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+require File.join(File.expand_path(File.dirname(__FILE__)), 'testutilities')
+require File.expand_path(File.join(File.dirname(__FILE__), "../lib/amp"))
+
+##
+# Runs discovery between made-up histories: the local one is a changelog
+# stand-in, and the remote has some subset of its nodes (plus, maybe, some
+# of its own) and counts the round trips it's asked for.
+class TestDiscovery < AmpTestCase
+  Discovery = Amp::Graphs::Mercurial::Discovery
+  NULL_ID   = Amp::Mercurial::RevlogSupport::Node::NULL_ID
+  NULL_REV  = Amp::Mercurial::RevlogSupport::Node::NULL_REV
+
+  ##
+  # A history, as a list of each revision's parent revisions.
+  class FakeChangelog
+    attr_reader :node_map
+
+    def initialize(parents)
+      @parents  = parents
+      @node_map = {NULL_ID => NULL_REV}
+      parents.size.times {|rev| @node_map[node_id_for_index(rev)] = rev }
+    end
+
+    def size; @parents.size; end
+
+    def node_id_for_index(rev)
+      [rev + 1].pack("N") * 5
+    end
+
+    def parent_indices_for_index(rev)
+      (@parents[rev] + [NULL_REV, NULL_REV])[0, 2]
+    end
+  end
+
+  ##
+  # A remote with the given nodes. Each batch, and each +known+ outside of
+  # one, is a round trip.
+  class FakeRemote
+    attr_reader :round_trips, :asked
+
+    def initialize(nodes, heads)
+      @nodes, @heads = Hash.with_keys(nodes), heads
+      @round_trips, @asked = 0, 0
+    end
+
+    def heads
+      @heads
+    end
+
+    def known(nodes)
+      @round_trips += 1 unless @batching
+      @asked += nodes.size
+      nodes.map {|node| @nodes.include? node }
+    end
+
+    def batch(calls)
+      @round_trips += 1
+      @batching = true
+      calls.map {|command, *args| send command, *args }
+    ensure
+      @batching = false
+    end
+  end
+
+  ##
+  # Runs discovery, and gives back the common heads as revisions.
+  def discover(changelog, remote_revs, remote_heads = nil)
+    nodes  = remote_revs.map {|rev| changelog.node_id_for_index rev }
+    remote = FakeRemote.new nodes, remote_heads || [nodes.last || NULL_ID]
+    discovery = Discovery.new changelog, remote
+    common, heads = discovery.run
+    assert_equal remote.round_trips, discovery.round_trips
+    [common.map {|node| changelog.node_map[node] }.sort, heads, discovery, remote]
+  end
+
+  def linear(size)
+    FakeChangelog.new((0...size).map {|rev| rev.zero? ? [] : [rev - 1] })
+  end
+
+  def test_remote_has_everything
+    changelog = linear 50
+    common, heads, discovery = discover(changelog, (0...50).to_a)
+    assert_equal [49], common
+    assert_equal [changelog.node_id_for_index(49)], heads
+    assert_equal 1, discovery.round_trips
+  end
+
+  def test_remote_has_nothing
+    common, heads, discovery = discover(linear(50), [], [NULL_ID])
+    assert_equal [NULL_REV], common
+    assert_equal 1, discovery.round_trips
+  end
+
+  def test_long_linear_history_takes_few_round_trips
+    changelog = linear 1000
+    # the remote's heads are ones we don't have, so it has to sample
+    common, heads, discovery, remote = discover(changelog, (0..400).to_a, ["\xff" * 20])
+    assert_equal [400], common
+    assert discovery.round_trips <= 5, "took #{discovery.round_trips} round trips"
+  end
+
+  def test_branches
+    # 0 - 1 - 2 - 3 - 4 - ... - 99
+    #      \
+    #       100 - 101 - ... - 199
+    #              \
+    #               and 200 merges 150 and 99
+    parents = (0...200).map do |rev|
+      case rev
+      when 0   then []
+      when 100 then [1]
+      else          [rev - 1]
+      end
+    end
+    parents << [150, 99]
+    changelog = FakeChangelog.new parents
+    remote = (0..60).to_a + (100..150).to_a
+    common, heads, discovery = discover(changelog, remote, ["\xff" * 20])
+    assert_equal [60, 150], common
+    assert discovery.round_trips <= 5, "took #{discovery.round_trips} round trips"
+  end
+
+  def test_known_remote_head_settles_its_ancestors
+    changelog = linear 300
+    common, heads, discovery, remote = discover(changelog, (0..250).to_a)
+    assert_equal [250], common
+    # only what's above the remote head is left to ask about
+    assert remote.asked <= 1 + 49, "asked about #{remote.asked} nodes"
+  end
+end
@@ -25,6 +25,13 @@ class FibonacciGeneratorTester < Generator
   end
 end
 
+class CountdownGeneratorTester < Generator
+  def generator_loop
+    3.downto(1) {|i| yield_gen i }
+    :liftoff
+  end
+end
+
 class TestGenerator < AmpTestCase
   def setup
     @generator = FibonacciGeneratorTester.new
@@ -45,4 +52,24 @@ class TestGenerator < AmpTestCase
     assert_equal 1, @generator.next
   end
   
+  def test_finished_loop
+    generator = CountdownGeneratorTester.new
+    assert_equal [3, 2, 1, :liftoff, :liftoff], (1..5).map { generator.next }
+  end
+  
+  def test_backends_agree
+    backends = [:continuation]
+    backends << :fiber if defined?(::Fiber)
+    results = backends.map do |backend|
+      begin
+        old, Generator.backend = Generator.backend, backend
+        generator = FibonacciGeneratorTester.new
+        (1..10).map { generator.next }
+      ensure
+        Generator.backend = old
+      end
+    end
+    results.each {|result| assert_equal [1, 1, 2, 3, 5, 8, 13, 21, 34, 55], result }
+  end
+  
 end
\ No newline at end of file
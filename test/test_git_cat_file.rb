@@ -0,0 +1,66 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+require File.join(File.expand_path(File.dirname(__FILE__)), 'testutilities')
+require File.expand_path(File.join(File.dirname(__FILE__), "../lib/amp"))
+
+class TestGitCatFile < AmpTestCase
+  include Amp::Git
+
+  def setup
+    super
+    @root = File.join(tempdir, "repo")
+    @git_dir = File.join(@root, ".git")
+  end
+
+  # CatFile runs git, so there's nothing to test without it. Makes a
+  # repository with one commit, of one file.
+  def make_repo
+    return false unless system("git --version > /dev/null 2>&1")
+    FileUtils.mkdir_p @root
+    File.open(File.join(@root, "README"), "w") {|f| f << "hello\n" }
+    git = %Q{git --git-dir="#{@git_dir}" --work-tree="#{@root}" -c user.name=amp -c user.email=amp@example.com}
+    system("#{git} init -q && #{git} add README && #{git} commit -q -m first") or flunk "couldn't make a git repository"
+  end
+
+  def test_read
+    return unless make_repo
+    cat_file = CatFile.new @git_dir
+    type, data, sha = cat_file.read "HEAD:README"
+    assert_equal :blob, type
+    assert_equal "hello\n", data
+    assert_match(/\A[0-9a-f]{40}\z/, sha)
+    assert_nil cat_file.read("HEAD:missing")
+    assert_nil cat_file.read("HEAD\nHEAD")
+
+    type, data, _ = cat_file.read "HEAD"
+    assert_equal :commit, type
+    assert data.include?("\nfirst\n")
+  ensure
+    cat_file.close if cat_file
+  end
+
+  def test_resolve_falls_back_only_for_syntax_it_cant_parse
+    return unless make_repo
+    store = ObjectStore.new @git_dir
+    assert_nil store.resolve("MERGE_HEAD")
+    assert_nil store.resolve("no-such-branch")
+    assert_nil store.instance_variable_get(:@cat_file)
+
+    blob = store.resolve "HEAD:README"
+    assert_equal [:blob, "hello\n"], store.read(blob)
+  ensure
+    store.close if store
+  end
+end
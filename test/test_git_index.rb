@@ -0,0 +1,119 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+require File.join(File.expand_path(File.dirname(__FILE__)), 'testutilities')
+require File.expand_path(File.join(File.dirname(__FILE__), "../lib/amp"))
+
+class TestGitIndex < AmpTestCase
+  include Amp::Git
+
+  SHA = "\1" * 20
+
+  def test_reads_version_2
+    path = write_index 2, [["a", 0], ["dir/b", 0]]
+    index = Index.new path
+    assert_equal 2, index.version
+    assert_equal ["a", "dir/b"], index.paths
+    assert_equal 12, index["dir/b"].size
+    assert_equal SHA, index["a"].sha
+    assert index["a"].executable?
+  end
+
+  def test_reads_version_4_prefixes
+    path = write_index 4, [["dir/abc", 0], ["dir/abd", 0], ["other", 0]]
+    assert_equal ["dir/abc", "dir/abd", "other"], Index.new(path).paths
+  end
+
+  def test_conflicts
+    path = write_index 2, [["a", 1], ["a", 2], ["a", 3], ["b", 0]]
+    index = Index.new path
+    assert index.conflicted?("a")
+    assert !index.conflicted?("b")
+    assert_equal 2, index.size
+  end
+
+  def test_missing_index_is_empty
+    assert_equal [], Index.new(File.join(tempdir, "nothing")).paths
+  end
+
+  def test_ignore
+    write_file(".gitignore") {|io| io << "*.log\n!keep.log\n/top\nbuild/\ndoc/**/gen\n" }
+    write_file("sub/.gitignore") {|io| io << "local*\n" }
+    FileUtils.mkdir_p File.join(tempdir, "build")
+    ignore = Ignore.new tempdir
+
+    assert ignore.ignored?("x.log")
+    assert ignore.ignored?("sub/deep/x.log")
+    assert !ignore.ignored?("keep.log")
+    assert ignore.ignored?("top")
+    assert !ignore.ignored?("sub/top")
+    assert ignore.ignored?("build/out")
+    assert !ignore.ignored?("build", false)
+    assert ignore.ignored?("doc/gen")
+    assert ignore.ignored?("doc/a/b/gen")
+    assert ignore.ignored?("sub/localfile")
+    assert !ignore.ignored?("localfile")
+  end
+
+  def test_blob_sha_of_a_symlink_counts_bytes
+    FileUtils.mkdir_p tempdir
+    target = "caf\303\251"
+    target.force_encoding("UTF-8") if target.respond_to? :force_encoding
+    File.symlink target, File.join(tempdir, "link")
+    File.open(File.join(tempdir, "file"), "wb") {|f| f.write "\0\377 bytes\n" }
+    repo = Object.new
+    def repo.root; @root; end
+    repo.instance_variable_set :@root, tempdir
+    staging = Amp::Repositories::Git::StagingArea.new repo
+
+    Dir.chdir(tempdir) { system "git init -q && git add link file" } or flunk "git failed"
+    # readlink gives back UTF-8 under a UTF-8 locale, whatever ours is
+    file = class << File; self; end
+    file.send :alias_method, :real_readlink, :readlink
+    file.send(:define_method, :readlink) do |path|
+      link = real_readlink(path)
+      link.respond_to?(:force_encoding) ? link.force_encoding("UTF-8") : link
+    end
+    %w(link file).each do |name|
+      expected = Dir.chdir(tempdir) { `git ls-files -s #{name}`.split(" ")[1] }
+      st = File.lstat File.join(tempdir, name)
+      assert_equal expected, staging.send(:blob_sha, name, st).unpack("H*").first
+    end
+  ensure
+    file.send :alias_method, :readlink, :real_readlink if file
+  end
+
+  private
+
+  ##
+  # Writes out an index with the given [path, stage] entries.
+  def write_index(version, entries)
+    data = ["DIRC", version, entries.size].pack("a4NN")
+    last = ""
+    entries.each do |path, stage|
+      start = data.size
+      data << [0, 0, 0, 0, 0, 0, 0100755, 0, 0, 12].pack("N10") << SHA
+      data << [(stage << 12) | [path.size, 0xfff].min].pack("n")
+      if version == 4
+        common = 0
+        common += 1 while common < last.size && last[common] == path[common]
+        data << [last.size - common].pack("C") << path[common..-1] << "\0"
+      else
+        data << path << "\0" * (8 - (data.size - start) % 8)
+      end
+      last = path
+    end
+    write_file("index") {|io| io << data }
+  end
+end
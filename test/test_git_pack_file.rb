@@ -0,0 +1,50 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+require File.join(File.expand_path(File.dirname(__FILE__)), 'testutilities')
+require File.expand_path(File.join(File.dirname(__FILE__), "../lib/amp"))
+
+class TestGitPackFile < AmpTestCase
+  include Amp::Git
+  
+  def test_apply_delta
+    base  = "hello world"
+    delta = [11, 17].pack("CC") +
+            [0x91, 0, 6].pack("CCC") + [6].pack("C") + "there " + [0x91, 6, 5].pack("CCC")
+    assert_equal "hello there world", PackFile.apply_delta(base, delta)
+  end
+  
+  def test_apply_delta_big_sizes
+    base  = "a" * 200
+    delta = [200 & 0x7f | 0x80, 1, 3].pack("CCC") + [3].pack("C") + "xyz"
+    assert_equal "xyz", PackFile.apply_delta(base, delta)
+  end
+  
+  def test_apply_delta_wrong_base
+    delta = [5, 3].pack("CC") + [3].pack("C") + "xyz"
+    assert_raises(ObjectStore::CorruptObjectError) { PackFile.apply_delta("abc", delta) }
+  end
+  
+  def test_delta_base_cache_evicts_least_recently_used
+    cache = ObjectStore::DeltaBaseCache.new 10
+    cache[:a] = [:blob, "aaa"]
+    cache[:b] = [:blob, "bbb"]
+    cache[:c] = [:blob, "ccc"]
+    cache[:a]
+    cache[:d] = [:blob, "ddd"]
+    assert_equal [:blob, "aaa"], cache[:a]
+    assert_nil cache[:b]
+    assert_equal [:blob, "ddd"], cache[:d]
+  end
+end
@@ -0,0 +1,110 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+require 'webrick'
+require File.join(File.expand_path(File.dirname(__FILE__)), 'testutilities')
+require File.expand_path(File.join(File.dirname(__FILE__), "../lib/amp"))
+
+##
+# Talks to a WEBrick stand-in for a Mercurial server, which answers every
+# command with its own name (unless it's been given a better answer), and
+# counts the connections and requests made to it.
+class TestHTTPRepository < AmpTestCase
+  def setup
+    @connections = 0
+    @requests = []
+    @answers = {}
+    @close_after_each = false
+    @server = WEBrick::HTTPServer.new(:Port => 0, :BindAddress => "127.0.0.1",
+                                      :Logger => WEBrick::Log.new(nil, 0), :AccessLog => [],
+                                      :AcceptCallback => proc { @connections += 1 })
+    @server.mount_proc("/") do |req, res|
+      res["Content-Type"] = "application/mercurial-0.1"
+      res["Connection"]   = "close" if @close_after_each
+      @requests << req.query["cmd"]
+      res.body = answer(req.query["cmd"], req.query)
+    end
+    @thread = Thread.new { @server.start }
+    sleep 0.1 until @server.status == :Running
+
+    # port 0 lets the OS pick a free one
+    port = @server.listeners.first.addr[1]
+    @repo = Amp::Repositories::Mercurial::HTTPRepository.new("http://127.0.0.1:#{port}/")
+  end
+
+  def answer(cmd, args)
+    return cmd unless @answers[cmd]
+    return @answers[cmd].call(args) unless cmd == "batch"
+    args["cmds"].split(";").map do |batched|
+      name, encoded = batched.split(" ", 2)
+      Amp::Mercurial::Batch.escape answer(name, Amp::Mercurial::Batch.decode_args(encoded))
+    end.join(";")
+  end
+
+  def teardown
+    @repo.close
+    @server.shutdown
+    @thread.join
+  end
+
+  def test_commands_share_a_connection
+    %w(heads branches between lookup heads).each do |cmd|
+      assert_equal cmd, @repo.send(:do_read, cmd)[:body]
+    end
+    assert_equal 1, @connections
+  end
+
+  def test_reconnects_when_server_hangs_up
+    @close_after_each = true
+    3.times { assert_equal "heads", @repo.send(:do_read, "heads")[:body] }
+    assert_equal 3, @connections
+  end
+
+  def test_reconnects_after_close
+    @repo.send :do_read, "heads"
+    @repo.close
+    assert_equal "lookup", @repo.send(:do_read, "lookup")[:body]
+    assert_equal 2, @connections
+  end
+
+  def test_batch
+    @answers["capabilities"] = proc { "lookup batch" }
+    @answers["heads"]        = proc { "#{"ab" * 20}\n" }
+    @answers["lookup"]       = proc {|args| "1 #{args["key"].unpack("H*").first}\n" }
+    @answers["batch"]        = true
+
+    key = "a,b;c=d:e"
+    assert_equal [["ab" * 20].map {|h| h.unhexlify }, key],
+                 @repo.batch([[:heads], [:lookup, key]])
+    assert_equal ["capabilities", "batch"], @requests
+  end
+
+  def test_known_in_a_batch
+    @answers["capabilities"] = proc { "batch known getbundle" }
+    @answers["heads"]        = proc { "#{"ab" * 20}\n" }
+    @answers["known"]        = proc {|args| args["nodes"].split(" ").map {|n| n == "ab" * 20 ? "1" : "0" }.join }
+    @answers["batch"]        = true
+
+    nodes = ["ab" * 20, "cd" * 20, "ab" * 20].map {|n| n.unhexlify }
+    assert_equal [[nodes.first], [true, false, true]],
+                 @repo.batch([[:heads], [:known, nodes]])
+    assert_equal [false], @repo.known([nodes[1]])
+    assert_equal ["capabilities", "batch", "known"], @requests
+  end
+
+  def test_between_nothing
+    assert_equal [[]], @repo.between([])
+    assert_equal [], @requests
+  end
+end
@@ -214,4 +214,34 @@ EOF
     assert proc.call(".DS_Store")
     assert proc.call("some/dir/.DS_Store")
   end
+  
+  #### Matcher #############
+  
+  def test_matcher_literal_prefixes
+    matcher = Amp::Mercurial::Ignore::Matcher.new(parse_line(:glob, "build"), parse_line(:glob, "node_modules"))
+    assert matcher.call("build/out.o")
+    assert matcher.call("node_modules/lib/index.js")
+    assert_false matcher.call("src/build/out.o")
+  end
+  
+  def test_matcher_root_is_never_ignored
+    # the walker asks about the repository root as nil
+    matcher = Amp::Mercurial::Ignore::Matcher.new(parse_line(:glob, "build"), /\.DS_Store/)
+    assert_false matcher.call(nil)
+  end
+  
+  def test_matcher_mixed_patterns
+    matcher = Amp::Mercurial::Ignore::Matcher.new(parse_line(:glob, "doc/*"), /\.DS_Store/,
+                                                  parse_line(:glob, "test/**/test_*.rb"))
+    assert matcher.call("doc/file.html")
+    assert matcher.call("some/dir/.DS_Store")
+    assert matcher.call("test/a/b/test_crazy.rb")
+    assert_false matcher.call("lib/amp.rb")
+  end
+  
+  def test_matcher_ignoring_directory
+    matcher = Amp::Mercurial::Ignore::Matcher.new(parse_line(:glob, "node_modules"))
+    assert matcher.ignoring_directory?("node_modules/lib/deep")
+    assert_false matcher.ignoring_directory?("lib/node_modules")
+  end
 end
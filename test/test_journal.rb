@@ -40,6 +40,37 @@ class TestJournal < AmpTestCase
     assert !File.exists?(tfile)
   end
   
+  def test_buffered_journal_waits_for_flush
+    tfile = "tempjournal"
+    j = Amp::Mercurial::Journal.new(:journal => tfile, :opener => simple_opener, :buffered => true)
+    j << {:file => "file", :offset => 12345}
+    j << {:file => "other", :offset => 678}
+    assert_file_contents tfile, ""
+    
+    j.flush
+    assert_file_contents tfile, "file\0#{12345}\nother\0#{678}\n"
+    assert_equal 678, j.find("other")[:offset]
+    j.close
+    
+    assert !File.exists?(tfile)
+  end
+  
+  def test_hooks
+    tfile = "tempjournal"
+    closed, aborted = 0, 0
+    j = Amp::Mercurial::Journal.new(:journal => tfile, :opener => simple_opener)
+    j.on_close { closed += 1 }
+    j.on_abort { aborted += 1 }
+    j.close
+    assert_equal [1, 0], [closed, aborted]
+    
+    j = Amp::Mercurial::Journal.new(:journal => tfile, :opener => simple_opener)
+    j.on_close { closed += 1 }
+    j.on_abort { aborted += 1 }
+    j.delete
+    assert_equal [1, 1], [closed, aborted]
+  end
+  
   def simple_opener
     opener = Amp::Opener.new(Dir.pwd)
     opener.default = :open_file
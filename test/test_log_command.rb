@@ -0,0 +1,114 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+require 'stringio'
+require File.join(File.expand_path(File.dirname(__FILE__)), 'testutilities')
+require File.expand_path(File.join(File.dirname(__FILE__), "../lib/amp"))
+require File.expand_path(File.join(File.dirname(__FILE__), "../lib/amp/commands/command.rb"))
+include Amp::KernelMethods
+load File.expand_path(File.join(File.dirname(__FILE__), "../lib/amp/commands/commands/workflows/hg/log.rb"))
+
+##
+# Runs `amp log` against a made-up repository, whose changesets render as
+# a couple hundred bytes each and remember that they were rendered.
+class TestLogCommand < AmpTestCase
+  class FakeChangelog
+    attr_reader :prefetched
+    def initialize; @prefetched = []; end
+    def prefetch_chunks(first, last); @prefetched << [first, last]; end
+  end
+
+  class FakeChangeset
+    def initialize(rev, rendered)
+      @rev, @rendered = rev, rendered
+    end
+
+    def to_templated_s(opts)
+      @rendered << @rev
+      opts[:output] << "changeset #{@rev}\n#{"." * 200}\n"
+    end
+  end
+
+  class FakeRepo
+    attr_reader :size, :changelog, :rendered
+    def initialize(size)
+      @size, @changelog, @rendered = size, FakeChangelog.new, []
+    end
+
+    def [](rev)
+      FakeChangeset.new rev, @rendered
+    end
+  end
+
+  ##
+  # Stands in for a pipe whose reader has gone away after the first write.
+  class ClosedPipe
+    def write(data)
+      raise Errno::EPIPE if @written
+      @written = true
+      data.size
+    end
+  end
+
+  ##
+  # Stands in for a pager that's shown the first screenful, and is quit
+  # while we're writing the next - slowly enough that the renderer has
+  # filled the queue by then.
+  class QuitPager
+    def write(data)
+      sleep 0.3
+      raise Errno::EPIPE if @written
+      @written = true
+      data.size
+    end
+  end
+
+  def run_log(repo, stdout)
+    old, $stdout = $stdout, stdout
+    Amp::Command.all_commands[:log].run({:repository => repo}, [])
+  ensure
+    $stdout = old
+  end
+
+  def test_output_in_order
+    repo, out = FakeRepo.new(300), StringIO.new
+    run_log repo, out
+
+    expected = 299.downto(0).map {|rev| "changeset #{rev}\n#{"." * 200}\n" }.join
+    assert_equal expected, out.string
+    assert_equal [[236, 299], [172, 235], [108, 171], [44, 107], [0, 43]],
+                 repo.changelog.prefetched
+  end
+
+  def test_stops_when_nobody_is_listening
+    repo = FakeRepo.new 100_000
+    run_log repo, ClosedPipe.new
+
+    # a few buffers' worth, not the whole history
+    rendered = repo.rendered.size
+    assert rendered < 5_000
+    sleep 0.1
+    assert_equal rendered, repo.rendered.size
+  end
+
+  def test_stops_when_the_pager_quits_on_a_full_queue
+    repo = FakeRepo.new 100_000
+    run_log repo, QuitPager.new
+
+    rendered = repo.rendered.size
+    assert rendered < 5_000
+    sleep 0.1
+    assert_equal rendered, repo.rendered.size
+  end
+end
@@ -145,4 +145,42 @@ class TestMatch < AmpTestCase
     assert @matcher1.included?('asd/.kernel.rbc') # shouldn't care about the excludes
   end
   
+  def test_literal_includes
+    matcher = Amp::Match.create :includer => ["path:lib/amp", "glob:test/data"]
+    
+    assert !matcher.call('lib/amp.rb')
+    assert !matcher.call('lib/ampx/match.rb')
+    assert matcher.call('lib/amp')
+    assert matcher.call('lib/amp/support/match.rb')
+    assert matcher.call('test/data/file.txt')
+    assert !matcher.call('lib/other.rb')
+    assert !matcher.call('bin/amp')
+  end
+  
+  def test_syntax_entries_in_an_includer
+    # what the git add and rm commands hand over
+    matcher = Amp::Match.create :files => [], :includer => ["syntax: glob", "*.rb", "re:^doc/"]
+    
+    assert matcher.call('match.rb')
+    assert !matcher.call('lib/match.rb')
+    assert matcher.call('doc/index.html')
+    assert !matcher.call('lib/x.py')
+    
+    matcher = Amp::Match.create :includer => ["\\.rb$", "syntax: glob", "lib/*.c"]
+    assert matcher.call('test/a.rb')
+    assert matcher.call('lib/a.c')
+    assert !matcher.call('test/a.c')
+  end
+  
+  def test_roots
+    matcher = Amp::Match.create :includer => ["path:lib/amp/x", "path:lib/b", "path:test/foo"]
+    assert_equal ["lib", "test"], matcher.roots
+    
+    assert_equal [], Amp::Match.create(:files => @files).roots
+    assert_nil Amp::Match.create(:includer => "path:lib").roots
+    assert_nil @matcher1.roots
+    assert_nil @matcher2.roots
+    assert_nil @matcher3.roots
+  end
+  
 end
@@ -0,0 +1,54 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+require File.join(File.expand_path(File.dirname(__FILE__)), 'testutilities')
+require File.expand_path(File.join(File.dirname(__FILE__), "../lib/amp/support/ordered_pool"))
+
+class TestOrderedPool < AmpTestCase
+  def test_results_come_out_in_order
+    # the earlier items take longest, so they finish last
+    pool = Amp::Support::OrderedPool.new(4) {|i| sleep 0.001 * (20 - i); i * 2 }
+    results = []
+    pool.on_result {|result| results << result }
+    20.times {|i| pool << i }
+    pool.finish
+    assert_equal (0...20).map {|i| i * 2 }, results
+  end
+  
+  def test_window_is_bounded
+    started = 0
+    lock = Mutex.new
+    pool = Amp::Support::OrderedPool.new(2, 3) {|i| lock.synchronize { started += 1 }; sleep 0.01 }
+    in_flight = []
+    pool.on_result { in_flight << 0 }
+    10.times {|i| pool << i; assert started - in_flight.size <= 3 }
+    pool.finish
+    assert_equal 10, in_flight.size
+  end
+  
+  def test_errors_are_raised_in_order
+    pool = Amp::Support::OrderedPool.new(2) {|i| raise IOError.new("bad #{i}") if i == 3; i }
+    results = []
+    pool.on_result {|result| results << result }
+    assert_raises(IOError) do
+      begin
+        6.times {|i| pool << i }
+        pool.finish
+      ensure
+        pool.stop
+      end
+    end
+    assert_equal [0, 1, 2], results
+  end
+end
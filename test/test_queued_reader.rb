@@ -0,0 +1,119 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+require File.join(File.expand_path(File.dirname(__FILE__)), 'testutilities')
+require File.expand_path(File.join(File.dirname(__FILE__), "../lib/amp/support/queued_reader"))
+
+class TestQueuedReader < AmpTestCase
+  def reader_for(*chunks)
+    Amp::Support::QueuedReader.new(2) do |sink|
+      chunks.each {|chunk| sink << chunk }
+    end
+  end
+  
+  def test_gets_across_chunks
+    reader = reader_for("0\n2 1", "5\nfoo", "\0", "3\nabc")
+    assert_equal "0\n", reader.gets
+    assert_equal "2 15\n", reader.gets
+    assert_equal "foo\0003\n", reader.gets
+    assert_equal "abc", reader.gets
+    assert_nil reader.gets
+  end
+  
+  def test_read_lengths
+    reader = reader_for("abc", "defg", "h")
+    assert_equal "ab", reader.read(2)
+    assert_equal "cdefg", reader.read(5)
+    assert_equal "h", reader.read(5)
+    assert_nil reader.read(1)
+    assert reader.eof?
+  end
+  
+  def test_read_everything
+    assert_equal "abcdefgh", reader_for("abc", "defg", "h").read
+  end
+  
+  def test_producer_stays_bounded
+    produced = 0
+    reader = Amp::Support::QueuedReader.new(2) do |sink|
+      100.times { sink << "x"; produced += 1 }
+    end
+    sleep 0.1
+    assert produced <= 3
+    assert_equal "x" * 100, reader.read
+  end
+  
+  def test_producer_errors_are_raised_in_reader
+    reader = Amp::Support::QueuedReader.new do |sink|
+      sink << "abc"
+      raise IOError.new("connection reset")
+    end
+    assert_equal "abc", reader.read(3)
+    assert_raises(IOError) { reader.read(1) }
+  end
+  
+  def test_readpartial_returns_what_has_arrived
+    gate = Queue.new
+    reader = Amp::Support::QueuedReader.new(2) do |sink|
+      sink << "abc"
+      gate.pop
+      sink << "def"
+    end
+    assert_equal "abc", reader.readpartial(10) # without waiting for "def"
+    gate << true
+    assert_equal "de", reader.readpartial(2)
+    assert_equal "f", reader.readpartial(10)
+    assert_raises(EOFError) { reader.readpartial(10) }
+  end
+  
+  def test_close_lets_the_producer_finish
+    finished = false
+    reader = Amp::Support::QueuedReader.new(2) do |sink|
+      10.times { sink << "x" }
+      finished = true
+    end
+    assert_equal "x", reader.read(1)
+    reader.close
+    assert finished
+    assert reader.eof?
+  end
+  
+  def test_abort_stops_the_producer
+    finished = false
+    reader = Amp::Support::QueuedReader.new(2) do |sink|
+      100.times { sink << "x" }
+      finished = true
+    end
+    assert_equal "x", reader.read(1)
+    reader.abort
+    reader.close
+    assert !finished
+    assert reader.eof?
+  end
+  
+  def test_abort_with_a_full_queue
+    pushed = Queue.new
+    reader = Amp::Support::QueuedReader.new(2) do |sink|
+      100.times { sink << "x"; pushed << true }
+    end
+    2.times { pushed.pop }
+    sleep 0.1 # the producer is now stuck on a full queue
+    reader.abort
+    reader.close
+    assert reader.eof?
+    # its thread went away without anyone taking the queued chunks
+    thread = reader.instance_variable_get(:@thread)
+    assert_not_nil thread.join(5)
+  end
+end
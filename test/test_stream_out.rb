@@ -0,0 +1,134 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+require File.join(File.expand_path(File.dirname(__FILE__)), 'testutilities')
+require File.expand_path(File.join(File.dirname(__FILE__), "../lib/amp"))
+begin
+  require File.expand_path(File.join(File.dirname(__FILE__), "../lib/amp/server/extension/amp_extension"))
+rescue LoadError
+  # no sinatra - the server side can't be tested
+end
+
+##
+# The server's side of uncompressed clones, run against a made-up store in
+# the tempdir.
+class TestStreamOut < AmpTestCase
+  ##
+  # Just enough of a Sinatra request for the AmpRepoMethods helpers.
+  class FakeRequest
+    include Sinatra::AmpRepoMethods if defined? Sinatra::AmpRepoMethods
+    attr_accessor :params
+
+    def headers(*args); end
+
+    def response
+      response = Object.new
+      def response.headers; {"content-type" => "application/mercurial-0.1"}; end
+      response
+    end
+  end
+
+  ##
+  # A repository with a store, a config, and a snapshot of the store to send.
+  class FakeRepo
+    attr_reader :store, :config
+    attr_accessor :entries
+
+    def initialize(path)
+      @store = Object.new
+      @store.instance_variable_set :@path, path
+      def @store.path; @path; end
+      @config = Amp::AmpConfig.new
+    end
+
+    def stream_out_entries
+      raise LockError.new(nil, "locked", "store/lock", "the test") if entries == :locked
+      entries
+    end
+  end
+
+  def setup
+    super
+    return unless defined? Sinatra::AmpRepoMethods
+    @store = File.join(tempdir, "store")
+    FileUtils.mkdir_p File.join(@store, "data")
+    @repo = FakeRepo.new @store
+    @repo.entries = [store_file("00changelog.i", "changes"),
+                     store_file("data/caf\303\251.i", "\0\1\2"),
+                     store_file("data/empty.d", "x" * 5)]
+    @request = FakeRequest.new
+    @request.params = {"cmd" => "stream_out"}
+  end
+
+  ##
+  # Writes a file into the store, and returns its entry.
+  def store_file(name, data)
+    File.open(File.join(@store, name), "wb") {|f| f.write data }
+    [name, name, data.size]
+  end
+
+  def body_of(streamer)
+    body = ""
+    streamer.each {|chunk| body << chunk }
+    body.force_encoding("BINARY") if body.respond_to? :force_encoding
+    body
+  end
+
+  def test_stream_format
+    return unless defined? Sinatra::AmpRepoMethods
+    streamer = Sinatra::AmpRepoMethods::StoreStreamer.new @repo, @repo.entries
+    expected = "0\n3 15\n" +
+               "00changelog.i\0007\nchanges" +
+               "data/caf\303\251.i\0003\n\0\1\2" +
+               "data/empty.d\0005\nxxxxx"
+    expected.force_encoding("BINARY") if expected.respond_to? :force_encoding
+    assert_equal expected, body_of(streamer)
+    assert_equal 15, streamer.total_bytes
+    assert_equal expected.size, streamer.content_length
+  end
+
+  def test_only_the_snapshot_is_sent
+    return unless defined? Sinatra::AmpRepoMethods
+    streamer = Sinatra::AmpRepoMethods::StoreStreamer.new @repo, @repo.entries
+    File.open(File.join(@store, "00changelog.i"), "ab") {|f| f.write "more" }
+    body = body_of(streamer)
+    assert_equal streamer.content_length, body.size
+    assert body.index("\nchangesdata/"), "sent what was appended after the snapshot"
+
+    File.open(File.join(@store, "00changelog.i"), "wb") {|f| f.write "ch" }
+    assert_raises(IOError) { body_of(streamer) }
+  end
+
+  def test_stream_out_response
+    return unless defined? Sinatra::AmpRepoMethods
+    status, headers, streamer = catch(:halt) { @request.amp_get_stream_out(@repo) }
+    assert_equal 200, status
+    assert_equal streamer.content_length.to_s, headers["Content-Length"]
+    assert_equal "application/mercurial-0.1", headers["content-type"]
+    assert_match(/(^| )stream=1( |$)/, @request.amp_get_capabilities(@repo))
+  end
+
+  def test_refused_when_uncompressed_is_off
+    return unless defined? Sinatra::AmpRepoMethods
+    @repo.config["server", "uncompressed"] = "false"
+    assert_equal "1\n", @request.amp_get_stream_out(@repo)
+    assert @request.amp_get_capabilities(@repo) !~ /stream/
+  end
+
+  def test_refused_when_the_store_is_locked
+    return unless defined? Sinatra::AmpRepoMethods
+    @repo.entries = :locked
+    assert_equal "2\n", @request.amp_get_stream_out(@repo)
+  end
+end
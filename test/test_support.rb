@@ -68,6 +68,13 @@ class TestSupport < AmpTestCase
     assert_equal "fffedabb1234", "\xff\xfe\xda\xbb\x12\x34".hexlify
   end
   
+  def test_to_human
+    assert_equal "512 bytes", 512.to_human
+    assert_equal "1.5 KB", 1536.to_human
+    assert_equal "2.0 MB", 2.mb.to_human
+    assert_equal "3.0 GB", 3.gb.to_human
+  end
+  
   ###
   # File additions. Really it's more just like 
 end
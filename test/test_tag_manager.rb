@@ -0,0 +1,186 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+require File.join(File.expand_path(File.dirname(__FILE__)), 'testutilities')
+require File.expand_path(File.join(File.dirname(__FILE__), "../lib/amp"))
+
+##
+# Runs the tags cache against a made-up repository, which counts how many
+# manifests and .hgtags revisions it's asked to read. The cache file is
+# real, in a fresh .hg for each test.
+class TestTagManager < AmpTestCase
+  NULL_ID = Amp::Mercurial::RevlogSupport::Node::NULL_ID
+
+  class FakeChangelog
+    attr_reader :node_map
+
+    def initialize
+      @nodes, @node_map = [], {}
+    end
+
+    def add
+      node = [@nodes.size + 1].pack("N") * 5
+      @node_map[node] = @nodes.size
+      @nodes << node
+      node
+    end
+
+    def size; @nodes.size; end
+    def tip; @nodes.last || NULL_ID; end
+    def rev(node); @node_map[node]; end
+  end
+
+  ##
+  # A .hgtags revision.
+  class FakeTagsFile
+    def initialize(repo, file_node)
+      @repo, @file_node = repo, file_node
+    end
+
+    def data
+      @repo.tag_reads << @file_node
+      @repo.tags_files[@file_node]
+    end
+
+    def file(file_node)
+      FakeTagsFile.new @repo, file_node
+    end
+  end
+
+  class FakeRepo
+    include Amp::Repositories::Mercurial::TagManager
+    attr_reader :changelog, :manifest_reads, :tag_reads, :tags_files
+
+    ##
+    # @param [Hash] heads each head's node, mapped to its .hgtags file node
+    # @param [Hash] tags_files each .hgtags file node, mapped to its text
+    def initialize(changelog, dir, heads, tags_files)
+      @changelog, @heads, @tags_files = changelog, heads, tags_files
+      @hg_opener = Amp::Opener.new dir
+      @manifest_reads, @tag_reads = [], []
+    end
+
+    # newest first, as LocalRepository#heads has them
+    def heads
+      @heads.keys.sort_by {|node| -changelog.rev(node) }
+    end
+
+    def [](node)
+      @manifest_reads << node
+      file_node = @heads[node]
+      changeset = Object.new
+      changeset.instance_variable_set :@file_node, file_node
+      def changeset.get_file(path)
+        raise Amp::Mercurial::RevlogSupport::LookupError.new(path) unless @file_node
+        file = Object.new
+        file.instance_variable_set :@file_node, @file_node
+        def file.file_node; @file_node; end
+        file
+      end
+      changeset
+    end
+
+    def versioned_file(path, opts)
+      FakeTagsFile.new self, opts[:file_id]
+    end
+  end
+
+  def setup
+    super
+    FileUtils.mkdir_p File.join(tempdir, ".hg")
+    @changelog = FakeChangelog.new
+    @revs = (0..3).map { @changelog.add }
+    @tags_files = {
+      "\1" * 20 => "#{@revs[0].hexlify} v1\n",
+      # v1 moved, and v2 added
+      "\2" * 20 => "#{@revs[0].hexlify} v1\n#{@revs[1].hexlify} v1\n#{@revs[2].hexlify} v2\n"
+    }
+    @heads = {@revs[3] => "\2" * 20}
+  end
+
+  ##
+  # A new repository object, so the cache comes from disk - as it would for
+  # the next amp command.
+  def repo
+    FakeRepo.new @changelog, tempdir, @heads, @tags_files
+  end
+
+  def cache_file
+    File.join(tempdir, ".hg", "cache", "tags")
+  end
+
+  def test_cache_round_trip
+    first = repo
+    tags = first.tags
+    assert_equal @revs[1], tags["v1"]
+    assert_equal @revs[2], tags["v2"]
+    assert_equal @revs[3], tags["tip"]
+    assert File.exist?(cache_file)
+
+    second = repo
+    assert_equal tags, second.tags
+    assert_equal "global", second.tag_type("v1")
+    assert_equal [], second.manifest_reads
+    assert_equal [], second.tag_reads
+    # v1's old node survives the trip
+    assert_equal [@revs[1], [@revs[0]]], second.send(:read_tags_cache)[:tags]["v1"]
+  end
+
+  def test_new_head_is_the_only_one_looked_up
+    repo.tags
+    # a new head, off revision 0, with the older .hgtags
+    new_head = @changelog.add
+    @heads[new_head] = "\1" * 20
+
+    manager = repo
+    assert_equal @revs[1], manager.tags["v1"]
+    assert_equal [new_head], manager.manifest_reads
+    assert_equal ["\1" * 20, "\2" * 20], manager.tag_reads.uniq.sort
+  end
+
+  def test_tags_reused_when_no_heads_tags_changed
+    repo.tags
+    # tip moves along, but its .hgtags is the same file revision
+    @heads.delete @revs[3]
+    new_tip = @changelog.add
+    @heads[new_tip] = "\2" * 20
+
+    manager = repo
+    assert_equal @revs[2], manager.tags["v2"]
+    assert_equal new_tip, manager.tags["tip"]
+    assert_equal [new_tip], manager.manifest_reads
+    assert_equal [], manager.tag_reads
+  end
+
+  def test_changed_tags_file_invalidates_the_cache
+    repo.tags
+    @heads.delete @revs[3]
+    new_tip = @changelog.add
+    @tags_files["\3" * 20] = @tags_files["\2" * 20] + "#{@revs[3].hexlify} v3\n"
+    @heads[new_tip] = "\3" * 20
+
+    manager = repo
+    assert_equal @revs[3], manager.tags["v3"]
+    assert_equal ["\3" * 20], manager.tag_reads
+  end
+
+  def test_head_without_tags_file
+    @heads[@revs[3]] = nil
+    assert_equal({"tip" => @revs[3]}, repo.tags)
+
+    manager = repo
+    assert_equal({"tip" => @revs[3]}, manager.tags)
+    assert_equal [], manager.manifest_reads
+  end
+end
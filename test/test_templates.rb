@@ -61,5 +61,35 @@ class TestTemplates < AmpTestCase
     assert_not_nil(Template[:mercurial, "default-commit"])
     assert_not_nil(Template[:mercurial, "default-log"])
   end
+  
+  def test_render_into
+    out = "People: "
+    @template.render_into(out, :name => "Steve", :age => 21)
+    @template.render_into(out, :name => "Ari", :age => 20)
+    assert_equal "People: Steve 21Ari 20", out
+  end
+  
+  def test_render_into_context
+    template = Template.new(:log, :context, :erb, "<%= upcase %> <%= suffix %>")
+    assert_equal "STEVE!", template.render_into("", {:suffix => "!"}, "steve").delete(" ")
+  end
+  
+  def test_file_template_reloads_when_changed
+    path = File.join(Dir.tmpdir, "amp_template_test.erb")
+    File.open(path, "w") {|f| f.write "<%= name %> v1" }
+    template = FileTemplate.new(:log, :file_test, path)
+    assert_equal "Steve v1", template.render_into("", :name => "Steve")
+    
+    File.open(path, "w") {|f| f.write "<%= name %> v2" }
+    File.utime(Time.now + 10, Time.now + 10, path)
+    assert_equal "Steve v2", template.render_into("", :name => "Steve")
+  ensure
+    File.unlink path rescue nil
+  end
+  
+  def test_raw_template_reused
+    assert_same RawERbTemplate.for("name"), RawERbTemplate.for("name")
+    assert_equal "Steve", RawERbTemplate.for("name").render_into("", :name => "Steve")
+  end
     
 end
\ No newline at end of file
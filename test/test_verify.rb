@@ -0,0 +1,84 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+require 'stringio'
+require File.join(File.expand_path(File.dirname(__FILE__)), 'testutilities')
+require File.expand_path(File.join(File.dirname(__FILE__), "../lib/amp"))
+
+##
+# Verifies a copy of the local repository tests' repository, both in one
+# process and with the file logs split between workers, and checks the two
+# find the same things.
+class TestVerify < AmpTestCase
+  TARBALL = File.expand_path(File.join(File.dirname(__FILE__), "localrepo_tests", "testrepo.tar.gz"))
+
+  def setup
+    super
+    FileUtils.mkdir_p tempdir
+    system("tar", "-C", tempdir, "-xzf", TARBALL) or flunk "couldn't unpack the test repository"
+    @path = File.join(tempdir, "testrepo")
+  end
+
+  ##
+  # Verifies the repository, returning the results and what was reported
+  # (but not the status updates).
+  def verify(opts = {})
+    repo = Amp::Repositories::Mercurial::LocalRepository.new(@path, false, Amp::AmpConfig.new)
+    old_stdout, $stdout = $stdout, StringIO.new
+    result = repo.verify opts
+    [result.to_a, $stdout.string.split("\n").reject {|line| line =~ /^status: / }]
+  ensure
+    $stdout = old_stdout
+  end
+
+  def store_file(name)
+    File.join(@path, ".hg", "store", "data", name)
+  end
+
+  def assert_same_in_workers(serial)
+    assert_equal serial[0], verify(:jobs => 2)[0]
+    # workers' messages can come out in any order
+    assert_equal serial[1].sort, verify(:jobs => 2)[1].sort
+  end
+
+  def test_partition_files_balances_the_work
+    repo = Amp::Repositories::Mercurial::LocalRepository.new(@path, false, Amp::AmpConfig.new)
+    verifier = Amp::Repositories::Mercurial::Verification::Verifier.new(repo, :jobs => 2)
+    node_ids = {"big" => {"a" => 0, "b" => 1, "c" => 2}, "mid" => {"d" => 0, "e" => 1}, "small" => {}}
+    shares = verifier.partition_files(["big", "mid", "small", "tiny"], node_ids)
+    assert_equal [["big", "tiny"], ["mid", "small"]], shares
+    assert_equal [["only"]], verifier.partition_files(["only"], {})
+  end
+
+  def test_workers_agree_on_a_good_repository
+    serial = verify
+    assert_equal 0, serial[0][1] # errors
+    assert_equal 6, serial[0][3] # files
+    assert_same_in_workers serial
+  end
+
+  def test_workers_agree_on_a_corrupt_filelog
+    # junk on the end of one file log, and a mangled revision in another
+    File.open(store_file("silly/code.i"), "ab") {|f| f.write "junk" }
+    data = File.open(store_file("readme.i"), "rb") {|f| f.read }
+    data[-10, 10] = "x" * 10
+    File.open(store_file("readme.i"), "wb") {|f| f.write data }
+
+    serial = verify
+    assert_equal 2, serial[0][1]
+    assert serial[1].any? {|line| line =~ /^readme@1: unpacking / }
+    assert serial[1].any? {|line| line =~ /^silly\/code@\?: index off by 4 bytes/ }
+    assert_same_in_workers serial
+  end
+end
@@ -0,0 +1,145 @@
+##################################################################
+#                  Licensing Information                         #
+#                                                                #
+#  The following code is licensed, as standalone code, under     #
+#  the Ruby License, unless otherwise directed within the code.  #
+#                                                                #
+#  For information on the license of this code when distributed  #
+#  with and used in conjunction with the other modules in the    #
+#  Amp project, please see the root-level LICENSE file.          #
+#                                                                #
+#  © Michael J. Edgar and Ari Brown, 2009-2010                   #
+#                                                                #
+##################################################################
+
+require File.join(File.expand_path(File.dirname(__FILE__)), 'testutilities')
+require File.expand_path(File.join(File.dirname(__FILE__), "../lib/amp"))
+
+class TestWatchServer < AmpTestCase
+  Tree = Amp::Servers::WatchServer::Tree
+  
+  def setup
+    super
+    @root = File.join(tempdir, "tree")
+    FileUtils.mkdir_p File.join(@root, "dir")
+    FileUtils.mkdir_p File.join(@root, ".hg")
+    File.open(File.join(@root, "dir", "file"), "w") {|f| f << "a" }
+  end
+  
+  # inotify needs the C extension, on Linux. Without it there's nothing
+  # to test but the fallback.
+  def inotify?
+    fd = Amp::Support::Inotify.init
+    IO.for_fd(fd).close if fd
+    !!fd
+  end
+  
+  def test_reports_changes_since_token
+    return unless inotify?
+    tree = Tree.new @root, [".hg"]
+    token, paths = tree.changed_since ""
+    assert_nil paths
+    
+    File.open(File.join(@root, "dir", "file"), "a") {|f| f << "b" }
+    File.open(File.join(@root, ".hg", "dirstate"), "w") {|f| f << "c" }
+    token, paths = tree.changed_since token
+    assert_equal ["dir/file"], paths
+    
+    token, paths = tree.changed_since token
+    assert_equal [], paths
+  ensure
+    tree.close if tree
+  end
+  
+  def test_new_directories_are_watched
+    return unless inotify?
+    tree = Tree.new @root, [".hg"]
+    token, _ = tree.changed_since ""
+    
+    FileUtils.mkdir_p File.join(@root, "new", "deeper")
+    File.open(File.join(@root, "new", "deeper", "file"), "w") {|f| f << "a" }
+    token, paths = tree.changed_since token
+    assert_equal ["new/deeper/file"], paths
+    
+    File.open(File.join(@root, "new", "deeper", "other"), "w") {|f| f << "a" }
+    token, paths = tree.changed_since token
+    assert_equal ["new/deeper/other"], paths
+  ensure
+    tree.close if tree
+  end
+  
+  def test_moved_directories_are_marked
+    return unless inotify?
+    tree = Tree.new @root, [".hg"]
+    token, _ = tree.changed_since ""
+    
+    FileUtils.mv File.join(@root, "dir"), File.join(tempdir, "moved")
+    token, paths = tree.changed_since token
+    assert_equal ["dir/"], paths
+    
+    # it's not ours any more
+    File.open(File.join(tempdir, "moved", "file"), "a") {|f| f << "b" }
+    token, paths = tree.changed_since token
+    assert_equal [], paths
+  ensure
+    tree.close if tree
+  end
+  
+  def test_watch_state_round_trip
+    path = File.join(tempdir, "cache", "watchstate")
+    Amp::Repositories::Mercurial::WatchState.new("1.2.3:4", "tag", ["a", "b/c"]).write path
+    state = Amp::Repositories::Mercurial::WatchState.load path
+    assert_equal "1.2.3:4", state.token
+    assert_equal "tag", state.tag
+    assert_equal ["a", "b/c"], state.files
+    assert_nil Amp::Repositories::Mercurial::WatchState.load(path + ".missing")
+  end
+  
+  # Status through the server has to agree with a walk of the whole tree -
+  # including about files in ignored directories, which the walk never
+  # goes into. The server's answers are made up, so this runs anywhere.
+  def test_watched_status_matches_a_walk
+    tarball = File.expand_path(File.join(File.dirname(__FILE__), "localrepo_tests", "testrepo.tar.gz"))
+    assert system("tar", "-C", tempdir, "-xzf", tarball)
+    path = File.join(tempdir, "testrepo")
+    File.open(File.join(path, ".hgignore"), "w") {|f| f << "syntax: regexp\n^build$\n" }
+    
+    answers = [["t:1", nil], ["t:2", ["build/foo.o", "newfile"]]]
+    servers = class << Amp::Servers::WatchServer; self; end
+    servers.send :alias_method, :real_query, :query
+    servers.send(:define_method, :query) {|socket, token| answers.shift }
+    
+    status = lambda do
+      repo = Amp::Repositories::Mercurial::LocalRepository.new(path, false, Amp::AmpConfig.new)
+      result = repo.status(:node_1 => ".", :unknown => true, :modified => true,
+                           :added => true, :removed => true, :deleted => true)
+      result.delete :delta
+      result
+    end
+    
+    repo = Amp::Repositories::Mercurial::LocalRepository.new(path, false, Amp::AmpConfig.new)
+    server = UNIXServer.new Amp::Servers::WatchServer.default_socket_for(repo)
+    status.call # walks, and remembers what wasn't clean
+    
+    FileUtils.mkdir_p File.join(path, "build")
+    File.open(File.join(path, "build", "foo.o"), "w") {|f| f << "o" }
+    File.open(File.join(path, "newfile"), "w") {|f| f << "n" }
+    watched = status.call
+    assert answers.empty?
+    assert watched[:unknown].include?("newfile")
+    assert !watched[:unknown].include?("build/foo.o")
+    
+    server.close
+    File.unlink Amp::Servers::WatchServer.default_socket_for(repo)
+    assert_equal status.call, watched
+  ensure
+    servers.send :alias_method, :query, :real_query if servers
+  end
+  
+  def test_default_socket_is_in_the_metadata_directory
+    repo = Amp::Repositories::Git::LocalRepository.allocate
+    repo.root = @root
+    assert_equal File.join(@root, ".git", "watch.sock"),
+                 Amp::Servers::WatchServer.default_socket_for(repo)
+  end
+end